@@ -19,6 +19,9 @@
  * Atomic fetch-and-decrement
  *    int SNetAtomicCntFetchAndDec(snet_atomiccnt_t *cnt);
  *
+ * Atomic fetch-and-add
+ *    int SNetAtomicCntFetchAndAdd(snet_atomiccnt_t *cnt, int val);
+ *
  *
  * Auth: Daniel Prokesch <dlp@snet-home.org>
  * Date: 2011/08/02
@@ -54,6 +57,9 @@ static inline unsigned int SNetAtomicCntFetchAndInc(snet_atomiccnt_t *cnt)
 static inline unsigned int SNetAtomicCntIncAndFetch(snet_atomiccnt_t *cnt)
 { return __sync_add_and_fetch(&cnt->counter, 1); }
 
+static inline unsigned int SNetAtomicCntFetchAndAdd(snet_atomiccnt_t *cnt, int val)
+{ return __sync_fetch_and_add(&cnt->counter, val); }
+
 static inline unsigned int SNetAtomicCntFetchAndDec(snet_atomiccnt_t *cnt)
 { return __sync_fetch_and_sub(&cnt->counter, 1); }
 
@@ -106,6 +112,16 @@ static inline unsigned int SNetAtomicCntIncAndFetch(snet_atomiccnt_t *cnt)
   return tmp;
 }
 
+static inline unsigned int SNetAtomicCntFetchAndAdd(snet_atomiccnt_t *cnt, int val)
+{
+  int tmp;
+  (void) pthread_mutex_lock( &cnt->lock);
+  tmp = cnt->counter;
+  cnt->counter += val;
+  (void) pthread_mutex_unlock( &cnt->lock);
+  return tmp;
+}
+
 static inline unsigned int SNetAtomicCntFetchAndDec(snet_atomiccnt_t *cnt)
 {
   int tmp;
@@ -16,6 +16,7 @@
 //#include "record.h"
 /* forward declaration */
 struct record;
+struct snet_expr_list_t;
 
 typedef struct expression snet_expr_t;
 
@@ -63,6 +64,10 @@ extern snet_expr_t *SNetEcond( snet_expr_t *a, snet_expr_t *b, snet_expr_t *c);
 extern int SNetEevaluateInt( snet_expr_t *expr, struct record *rec); 
 extern bool SNetEevaluateBool( snet_expr_t *expr, struct record *rec); 
 
+/* *** */
+extern void SNetExprCompile( snet_expr_t *expr);
+extern void SNetExprListCompile( struct snet_expr_list_t *list);
+
 /* *** */
 void SNetExprDestroy( snet_expr_t *expr);
 #endif
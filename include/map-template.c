@@ -50,6 +50,7 @@ snet_map_t *MAP_FUNCTION(MAP_NAME, Create)(int size, ...)
   result->used = size;
   result->keys = SNetMemAlloc(size * sizeof(MAP_KEY));
   result->values = SNetMemAlloc(size * sizeof(MAP_VAL));
+  result->embedded = false;
 
   va_start(args, size);
   for (i = 0; i < size; i++) {
@@ -61,17 +62,15 @@ snet_map_t *MAP_FUNCTION(MAP_NAME, Create)(int size, ...)
   return result;
 }
 
-snet_map_t *MAP_FUNCTION(MAP_NAME, Copy)(snet_map_t *map)
+/* Copy the contents of a map into an empty map which has 'map->size' room. */
+static void MAP_FUNCTION(MAP_NAME, CopyElems)(snet_map_t *result, snet_map_t *map)
 {
   #if defined(MAP_KEY_COPY_FUN) || defined(MAP_VAL_COPY_FUN)
     int i;
   #endif
-  snet_map_t *result = SNetMemAlloc(sizeof(snet_map_t));
 
-  result->size = map->used;
   result->used = map->used;
 
-  result->keys = SNetMemAlloc(map->used * sizeof(MAP_KEY));
   #ifdef MAP_KEY_COPY_FUN
     for (i = 0; i < map->used; i++) {
       result->keys[i] = MAP_KEY_COPY_FUN(map->keys[i]);
@@ -80,7 +79,6 @@ snet_map_t *MAP_FUNCTION(MAP_NAME, Copy)(snet_map_t *map)
     memcpy(result->keys, map->keys, map->used * sizeof(MAP_KEY));
   #endif
 
-  result->values = SNetMemAlloc(map->used * sizeof(MAP_VAL));
   #ifdef MAP_VAL_COPY_FUN
     for (i = 0; i < map->used; i++) {
       result->values[i] = MAP_VAL_COPY_FUN(map->values[i]);
@@ -88,13 +86,56 @@ snet_map_t *MAP_FUNCTION(MAP_NAME, Copy)(snet_map_t *map)
   #else
     memcpy(result->values, map->values, map->used * sizeof(MAP_VAL));
   #endif
+}
+
+snet_map_t *MAP_FUNCTION(MAP_NAME, Copy)(snet_map_t *map)
+{
+  snet_map_t *result = SNetMemAlloc(sizeof(snet_map_t));
+
+  result->size = map->used;
+  result->keys = SNetMemAlloc(map->used * sizeof(MAP_KEY));
+  result->values = SNetMemAlloc(map->used * sizeof(MAP_VAL));
+  result->embedded = false;
+  MAP_FUNCTION(MAP_NAME, CopyElems)(result, map);
 
   return result;
 }
 
+/* Initialize an empty map on storage for 'size' elements from the caller. */
+void MAP_FUNCTION(MAP_NAME, Init)(
+    snet_map_t *map,
+    int size,
+    MAP_KEY *keys,
+    MAP_VAL *values)
+{
+  map->size = size;
+  map->used = 0;
+  map->keys = keys;
+  map->values = values;
+  map->embedded = true;
+}
 
+/* Copy the contents of a map into an empty initialized map. */
+void MAP_FUNCTION(MAP_NAME, Assign)(snet_map_t *map, snet_map_t *from)
+{
+  assert(map->used == 0);
+  if (from->used > map->size) {
+    if (!map->embedded) {
+      SNetMemFree(map->keys);
+      SNetMemFree(map->values);
+    }
+    map->size = from->used;
+    map->keys = SNetMemAlloc(from->used * sizeof(MAP_KEY));
+    map->values = SNetMemAlloc(from->used * sizeof(MAP_VAL));
+    map->embedded = false;
+  }
+  MAP_FUNCTION(MAP_NAME, CopyElems)(map, from);
+}
 
-void MAP_FUNCTION(MAP_NAME, Destroy)(snet_map_t *map)
+
+
+/* Release the contents of a map, but not the map structure itself. */
+void MAP_FUNCTION(MAP_NAME, Done)(snet_map_t *map)
 {
   #ifdef MAP_KEY_FREE_FUN
     int i;
@@ -114,8 +155,15 @@ void MAP_FUNCTION(MAP_NAME, Destroy)(snet_map_t *map)
     }
   #endif
 
-  SNetMemFree(map->keys);
-  SNetMemFree(map->values);
+  if (!map->embedded) {
+    SNetMemFree(map->keys);
+    SNetMemFree(map->values);
+  }
+}
+
+void MAP_FUNCTION(MAP_NAME, Destroy)(snet_map_t *map)
+{
+  MAP_FUNCTION(MAP_NAME, Done)(map);
   SNetMemFree(map);
 }
 
@@ -171,8 +219,10 @@ void MAP_FUNCTION(MAP_NAME, Set)(snet_map_t *map, MAP_KEY key, MAP_VAL val)
     map->values[map->used] = val;
     map->used++;
   } else {
-    MAP_KEY *keys = SNetMemAlloc((map->size + 1) * sizeof(MAP_KEY));
-    MAP_VAL *values = SNetMemAlloc((map->size + 1) * sizeof(MAP_VAL));
+    /* Embedded storage spills to the heap with room to grow. */
+    int size = map->embedded ? 2 * map->size : map->size + 1;
+    MAP_KEY *keys = SNetMemAlloc(size * sizeof(MAP_KEY));
+    MAP_VAL *values = SNetMemAlloc(size * sizeof(MAP_VAL));
 
     memcpy(keys, map->keys, map->size * sizeof(MAP_KEY));
     memcpy(values, map->values, map->size * sizeof(MAP_VAL));
@@ -180,13 +230,16 @@ void MAP_FUNCTION(MAP_NAME, Set)(snet_map_t *map, MAP_KEY key, MAP_VAL val)
     keys[map->used] = key;
     values[map->used] = val;
 
-    SNetMemFree(map->keys);
-    SNetMemFree(map->values);
+    if (!map->embedded) {
+      SNetMemFree(map->keys);
+      SNetMemFree(map->values);
+    }
 
     map->keys = keys;
     map->values = values;
+    map->embedded = false;
     map->used++;
-    map->size++;
+    map->size = size;
   }
 }
 
@@ -266,16 +319,23 @@ void MAP_FUNCTION(MAP_NAME, Deserialise)(
         void (*unpackValues)(void*, int, MAP_VAL*))
 {
   unpackInts(buf, 1, &map->used);
-  map->size = map->used;
+  if (!map->embedded || map->used > map->size) {
+    if (!map->embedded) {
+      SNetMemFree(map->keys);
+      SNetMemFree(map->values);
+    }
+    map->size = map->used;
+    map->keys = SNetMemAlloc(map->used * sizeof(MAP_KEY));
+    map->values = SNetMemAlloc(map->used * sizeof(MAP_VAL));
+    map->embedded = false;
+  }
 
-  map->keys = SNetMemAlloc(map->used * sizeof(MAP_KEY));
   #ifndef MAP_CANARY
     unpackKeys(buf, map->used, map->keys);
   #else
     unpackInts(buf, map->used, map->keys);
   #endif
 
-  map->values = SNetMemAlloc(map->used * sizeof(MAP_VAL));
   unpackValues(buf, map->used, map->values);
 }
 
@@ -52,16 +52,30 @@
       true \
     );)
 
+/* When 'embedded' is set the keys and values arrays are storage which is
+ * provided by the owner of the map, for instance inline in a record.
+ * Such storage is never freed by the map. When it overflows the map
+ * spills to heap allocated arrays. */
 typedef struct snet_map_t {
   int size, used;
   MAP_KEY_H *keys;
   MAP_VAL_H *values;
+  bool embedded;
 } snet_map_t;
 
 snet_map_t *MAP_FUNCTION(MAP_NAME_H, Create)(int size, ...);
 snet_map_t *MAP_FUNCTION(MAP_NAME_H, Copy)(snet_map_t *map);
 void MAP_FUNCTION(MAP_NAME_H, Destroy)(snet_map_t *map);
 
+void MAP_FUNCTION(MAP_NAME_H, Init)(
+    snet_map_t *map,
+    int size,
+    MAP_KEY_H *keys,
+    MAP_VAL_H *values
+);
+void MAP_FUNCTION(MAP_NAME_H, Assign)(snet_map_t *map, snet_map_t *from);
+void MAP_FUNCTION(MAP_NAME_H, Done)(snet_map_t *map);
+
 int MAP_FUNCTION(MAP_NAME_H, Size)(snet_map_t *map);
 
 MAP_KEY_H MAP_FUNCTION(MAP_NAME_H, FindVal)(snet_map_t *map, MAP_VAL_H val, MAP_KEY_H key);
@@ -6,6 +6,7 @@
 #define MEMFUN_H
 
 #include <stddef.h>
+#include <stdio.h>
 
 /* The processor cache line size for memory alignment. */
 #ifndef LINE_SIZE
@@ -102,4 +103,10 @@ void* SNetMemAlign( size_t size)
 char *SNetStrDup(const char *str)
       __attribute__((malloc));
 
+
+/*
+ * Print allocator statistics, if the allocator keeps any.
+ */
+void SNetMemPrintStats(FILE *file);
+
 #endif
@@ -2,6 +2,7 @@
 #define _RECORD_H_
 
 #include <stddef.h>
+#include <stdint.h>
 
 typedef struct record snet_record_t;
 typedef union record_types snet_record_types_t;
@@ -35,6 +36,20 @@ typedef struct {
   int subid[SNET_REC_SUBID_NUM];
 } snet_record_id_t;
 
+/* The time in nanoseconds at which a sampled record reached a node. */
+typedef struct {
+  int node;
+  uint64_t time;
+} snet_record_hop_t;
+
+/* The latency trace of a sampled data record. */
+typedef struct snet_record_trace {
+  uint64_t start;                 /* when the record entered the network */
+  int num_hops;
+  int max_hops;
+  snet_record_hop_t *hops;
+} snet_record_trace_t;
+
 
 
 
@@ -65,9 +80,13 @@ typedef struct {
   snet_int_map_t *tags;
   snet_int_map_t *btags;
   snet_ref_map_t *fields;
+  snet_label_mask_t tag_mask;     /* label masks of the maps */
+  snet_label_mask_t btag_mask;
+  snet_label_mask_t field_mask;
   int interface_id;
   snet_record_mode_t mode;
   snet_record_id_t rid;           /* system-wide unique id */
+  snet_record_trace_t *trace;     /* latency trace, if sampled */
   struct snet_stack *detref;
 } data_rec_t;
 
@@ -142,6 +161,7 @@ bool SNetRecordIdEquals (snet_record_id_t rid1, snet_record_id_t rid2);
 
 /* returns true if the record matches the pattern. */
 bool SNetRecPatternMatches(snet_variant_t *pat, snet_record_t *rec);
+void SNetRecFlowStrip( snet_variant_t *pat, snet_record_t *rec);
 void SNetRecFlowInherit( snet_variant_t *pat, snet_record_t *in_rec,
                              snet_record_t *out_rec);
 
@@ -191,6 +211,12 @@ void SNetRecRenameField( snet_record_t *rec, int id, int newId);
 
 
 void SNetRecIdGet(snet_record_id_t *id, snet_record_t *from);
+
+/* Start the latency trace of a sampled data record. */
+void SNetRecTraceStart(snet_record_t *rec, uint64_t now);
+
+/* Append the arrival at a node to the latency trace of a data record. */
+void SNetRecTraceHop(snet_record_t *rec, int node, uint64_t now);
 size_t SNetRecGetSize(snet_record_t *rec);
 
 void SNetRecSerialise(
@@ -14,6 +14,7 @@ typedef enum {
   mpi,
   scc,
   zmq,
+  shm,
 } snet_distrib_t;
 
 #endif
@@ -3,10 +3,32 @@
 
 typedef struct snet_variant_t snet_variant_t;
 
+#include <stdint.h>
 #include "list.h"
 
+/* Labels are small integers. Labels below LABEL_MASK_BITS are also kept
+ * as bits in a label mask, which turns membership tests and pattern
+ * matching into bitwise operations. Larger labels need a lookup. */
+typedef uint64_t snet_label_mask_t;
+
+#define LABEL_MASK_BITS         64
+#define LABEL_MASK_BIT(name) \
+  ((unsigned) (name) < LABEL_MASK_BITS ? (snet_label_mask_t) 1 << (name) : 0)
+
+/* Test a label in a mask, or evaluate 'lookup' when it is beyond the mask. */
+#define LABEL_MASK_TEST(mask, name, lookup) \
+  ((unsigned) (name) < LABEL_MASK_BITS ? \
+   ((mask) & LABEL_MASK_BIT(name)) != 0 : (lookup))
+
 struct snet_variant_t {
   snet_int_list_t *tags, *btags, *fields;
+
+  /* Label masks of the lists, which are kept up to date by all
+   * functions which modify a variant. */
+  snet_label_mask_t tag_mask, btag_mask, field_mask;
+
+  /* Whether the masks cover all labels of the variant. */
+  bool masked;
 };
 
 #define VARIANT_FOR_EACH_TAG(var, val)      LIST_FOR_EACH(var->tags, val)
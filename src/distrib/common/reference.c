@@ -1,5 +1,6 @@
 #include <assert.h>
 #include <pthread.h>
+#include <stdint.h>
 #include <string.h>
 
 #include "debug.h"
@@ -42,7 +43,10 @@ struct snet_ref {
 /* Count the number of references
  * to a data field from a remote location. */
 struct snet_refcount {
+  snet_ref_t            key;
+  struct snet_refcount *next;           /* hash chain */
   int                   count;
+  int                   pending;        /* unsent owner updates (<= 0) */
   void                 *data;
 
   /* The Threaded-Entity RTS (TERTS) uses a
@@ -58,16 +62,6 @@ struct snet_refcount {
   snet_result_list_t   *result_list;
 };
 
-#define MAP_NAME_H RefRefcount
-#define MAP_TYPE_NAME_H ref_refcount
-#define MAP_KEY_H snet_ref_t
-#define MAP_VAL_H snet_refcount_t*
-#include "map-template.h"
-#undef MAP_VAL_H
-#undef MAP_KEY_H
-#undef MAP_TYPE_NAME_H
-#undef MAP_NAME_H
-
 /* Define a list of streams. */
 #define LIST_NAME Stream
 #define LIST_TYPE_NAME stream
@@ -86,27 +80,195 @@ struct snet_refcount {
 #undef LIST_TYPE_NAME
 #undef LIST_NAME
 
+/* The number of independently locked shards per table. */
+#define REF_SHARD_BITS  6
+#define REF_SHARDS      (1 << REF_SHARD_BITS)
+
+/* The initial number of hash chains per shard. */
+#define REF_MIN_CHAINS  16
+
+/* A shard of a reference count table: a chained hash table and its lock. */
+typedef struct ref_shard {
+  pthread_mutex_t       lock;
+  snet_refcount_t     **chains;
+  int                   size;           /* a power of two */
+  int                   count;
+} __attribute__((aligned(LINE_SIZE))) ref_shard_t;
+
+/* Reference counts are hashed on (node, data) over many shards,
+ * such that workers which handle different fields rarely contend. */
+typedef struct ref_table {
+  ref_shard_t           shards[REF_SHARDS];
+} ref_table_t;
+
+static ref_table_t *localRefTable = NULL;
+static ref_table_t *remoteRefTable = NULL;
+
 bool SNetRefCompare(snet_ref_t r1, snet_ref_t r2)
 {
   return r1.node == r2.node && r1.data == r2.data;
 }
 
-#define MAP_NAME RefRefcount
-#define MAP_TYPE_NAME ref_refcount
-#define MAP_KEY snet_ref_t
-#define MAP_VAL snet_refcount_t*
-#define MAP_KEY_CMP SNetRefCompare
-#include "map-template.c"
-#undef MAP_KEY_CMP
-#undef MAP_VAL
-#undef MAP_KEY
-#undef MAP_TYPE_NAME
-#undef MAP_NAME
-
-static snet_ref_refcount_map_t *localRefMap = NULL;
-static snet_ref_refcount_map_t *remoteRefMap = NULL;
-static pthread_mutex_t localRefMutex = PTHREAD_MUTEX_INITIALIZER;
-static pthread_mutex_t remoteRefMutex = PTHREAD_MUTEX_INITIALIZER;
+/* Hash a reference on its location and data pointer. */
+static uint64_t RefHash(const snet_ref_t *ref)
+{
+  uint64_t h = (uint64_t) ref->data ^ ((uint64_t) ref->node << 48);
+
+  /* Finalizer of MurmurHash3 to mix all bits. */
+  h ^= h >> 33;
+  h *= UINT64_C(0xff51afd7ed558ccd);
+  h ^= h >> 33;
+  h *= UINT64_C(0xc4ceb9fe1a85ec53);
+  h ^= h >> 33;
+  return h;
+}
+
+/* Create an empty reference count table. */
+static ref_table_t *RefTableCreate(void)
+{
+  ref_table_t *table = SNetMemAlign(sizeof(ref_table_t));
+  int i, k;
+
+  for (i = 0; i < REF_SHARDS; ++i) {
+    ref_shard_t *shard = &table->shards[i];
+    pthread_mutex_init(&shard->lock, NULL);
+    shard->size = REF_MIN_CHAINS;
+    shard->count = 0;
+    shard->chains = SNetMemAlloc(REF_MIN_CHAINS * sizeof(snet_refcount_t *));
+    for (k = 0; k < REF_MIN_CHAINS; ++k) {
+      shard->chains[k] = NULL;
+    }
+  }
+  return table;
+}
+
+/* Destroy an empty reference count table. */
+static void RefTableDestroy(ref_table_t *table)
+{
+  int i;
+
+  for (i = 0; i < REF_SHARDS; ++i) {
+    assert(table->shards[i].count == 0);
+    pthread_mutex_destroy(&table->shards[i].lock);
+    SNetMemFree(table->shards[i].chains);
+  }
+  SNetMemFree(table);
+}
+
+/* Find the shard of a reference, which the caller must lock. */
+static ref_shard_t *RefShard(ref_table_t *table, const snet_ref_t *ref)
+{
+  return &table->shards[RefHash(ref) & (REF_SHARDS - 1)];
+}
+
+/* Find the hash chain of a reference within its shard. */
+static snet_refcount_t **RefChain(ref_shard_t *shard, const snet_ref_t *ref)
+{
+  return &shard->chains[(RefHash(ref) >> REF_SHARD_BITS) & (shard->size - 1)];
+}
+
+/* Lookup the reference count of a reference, or NULL. */
+static snet_refcount_t *RefFind(ref_shard_t *shard, const snet_ref_t *ref)
+{
+  snet_refcount_t *refInfo = *RefChain(shard, ref);
+
+  while (refInfo && !SNetRefCompare(refInfo->key, *ref)) {
+    refInfo = refInfo->next;
+  }
+  return refInfo;
+}
+
+/* Lookup the reference count of a reference which must exist. */
+static snet_refcount_t *RefGet(ref_shard_t *shard, const snet_ref_t *ref)
+{
+  snet_refcount_t *refInfo = RefFind(shard, ref);
+  assert(refInfo);
+  return refInfo;
+}
+
+/* Create a new reference count for a reference which is absent. */
+static snet_refcount_t *RefAdd(ref_shard_t *shard, const snet_ref_t *ref,
+                               int count, void *data)
+{
+  snet_refcount_t *refInfo = SNetMemAlloc(sizeof(snet_refcount_t));
+  snet_refcount_t **chain;
+
+  /* Double the number of chains when they become longer than one. */
+  if (shard->count >= shard->size) {
+    snet_refcount_t **old_chains = shard->chains;
+    int old_size = shard->size, i;
+
+    shard->size *= 2;
+    shard->chains = SNetMemAlloc(shard->size * sizeof(snet_refcount_t *));
+    for (i = 0; i < shard->size; ++i) {
+      shard->chains[i] = NULL;
+    }
+    for (i = 0; i < old_size; ++i) {
+      snet_refcount_t *move;
+      while ((move = old_chains[i]) != NULL) {
+        old_chains[i] = move->next;
+        chain = RefChain(shard, &move->key);
+        move->next = *chain;
+        *chain = move;
+      }
+    }
+    SNetMemFree(old_chains);
+  }
+
+  refInfo->key = *ref;
+  refInfo->count = count;
+  refInfo->pending = 0;
+  refInfo->data = data;
+  refInfo->stream_list = NULL;
+  pthread_cond_init(&refInfo->cond_var, NULL);
+  refInfo->result_list = NULL;
+
+  chain = RefChain(shard, ref);
+  refInfo->next = *chain;
+  *chain = refInfo;
+  shard->count += 1;
+  return refInfo;
+}
+
+/* Remove and free the reference count of a reference. */
+static void RefRemove(ref_shard_t *shard, const snet_ref_t *ref)
+{
+  snet_refcount_t **chain = RefChain(shard, ref);
+  snet_refcount_t *refInfo;
+
+  while (!SNetRefCompare((*chain)->key, *ref)) {
+    chain = &(*chain)->next;
+  }
+  refInfo = *chain;
+  *chain = refInfo->next;
+  shard->count -= 1;
+  pthread_cond_destroy(&refInfo->cond_var);
+  SNetMemFree(refInfo);
+}
+
+/* Inform the owner of a remote field of a change in our references.
+ * The owner frees a field only when all references are gone. Hence,
+ * while this location keeps a reference its decrements are combined
+ * and sent together when its last reference goes. Increments are sent
+ * immediately, such that the owner never counts too few references. */
+static void RefUpdateOwner(snet_refcount_t *refInfo, snet_ref_t *ref, int delta)
+{
+  refInfo->pending += delta;
+  if (refInfo->pending > 0) {
+    SNetDistribUpdateRef(ref, refInfo->pending);
+    refInfo->pending = 0;
+  }
+}
+
+/* Remove the reference count of a remote field which is unreferenced. */
+static void RefRelease(ref_shard_t *shard, snet_refcount_t *refInfo,
+                       snet_ref_t *ref)
+{
+  if (refInfo->pending) {
+    SNetDistribUpdateRef(ref, refInfo->pending);
+  }
+  RefRemove(shard, ref);
+}
 
 static size_t (*snet_ref_data_size)(void*) = NULL;
 
@@ -124,19 +286,15 @@ size_t SNetRefGetDataSize(void *data) {
 /* Called by toplevel distribution. */
 void SNetReferenceInit(void)
 {
-  localRefMap = SNetRefRefcountMapCreate(0);
-  remoteRefMap = SNetRefRefcountMapCreate(0);
+  localRefTable = RefTableCreate();
+  remoteRefTable = RefTableCreate();
 }
 
 /* Called by input manager. */
 void SNetReferenceDestroy(void)
 {
-  pthread_mutex_destroy(&localRefMutex);
-  pthread_mutex_destroy(&remoteRefMutex);
-  assert(SNetRefRefcountMapSize(localRefMap) == 0);
-  assert(SNetRefRefcountMapSize(remoteRefMap) == 0);
-  SNetRefRefcountMapDestroy(localRefMap);
-  SNetRefRefcountMapDestroy(remoteRefMap);
+  RefTableDestroy(localRefTable);
+  RefTableDestroy(remoteRefTable);
 }
 
 /* Called by input parser, or box output. */
@@ -160,18 +318,19 @@ snet_ref_t *SNetRefCopy(snet_ref_t *ref)
   if (SNetDistribIsNodeLocation(ref->node)) {
     result->data = (uintptr_t) COPYFUN(ref->interface, (void*)ref->data);
   } else {
-    pthread_mutex_lock(&remoteRefMutex);
-    snet_refcount_t *refInfo = SNetRefRefcountMapGet(remoteRefMap, *ref);
+    ref_shard_t *shard = RefShard(remoteRefTable, ref);
+    pthread_mutex_lock(&shard->lock);
+    snet_refcount_t *refInfo = RefGet(shard, ref);
 
     if (refInfo->data) {
       result->node = SNetDistribGetNodeId();
       result->data = (uintptr_t) COPYFUN(result->interface, refInfo->data);
     } else {
       refInfo->count++;
-      SNetDistribUpdateRef(ref, 1);
+      RefUpdateOwner(refInfo, ref, 1);
     }
 
-    pthread_mutex_unlock(&remoteRefMutex);
+    pthread_mutex_unlock(&shard->lock);
   }
 
   return result;
@@ -212,10 +371,11 @@ static void* GetRemoteData(snet_ref_t *ref)
 {
   void                  *result = NULL;
   snet_refcount_t       *refInfo;
+  ref_shard_t           *shard = RefShard(remoteRefTable, ref);
 
-  pthread_mutex_lock(&remoteRefMutex);
+  pthread_mutex_lock(&shard->lock);
 
-  refInfo = SNetRefRefcountMapGet(remoteRefMap, *ref);
+  refInfo = RefGet(shard, ref);
   if (refInfo->data == NULL) {
 
     /* Discern between Threaded-Entity Runtime and Front. */
@@ -236,7 +396,7 @@ static void* GetRemoteData(snet_ref_t *ref)
 
           // refInfo->count gets updated by SNetRefSet instead of here
           // to avoid a race between nodes when a pointer is recycled.
-          pthread_mutex_unlock(&remoteRefMutex);
+          pthread_mutex_unlock(&shard->lock);
           result = SNetStreamRead(sd);
           SNetStreamClose(sd, true);
         }
@@ -250,8 +410,8 @@ static void* GetRemoteData(snet_ref_t *ref)
           } else {
             SNetResultListAppendEnd(refInfo->result_list, &result);
           }
-          pthread_cond_wait(&refInfo->cond_var, &remoteRefMutex);
-          pthread_mutex_unlock(&remoteRefMutex);
+          pthread_cond_wait(&refInfo->cond_var, &shard->lock);
+          pthread_mutex_unlock(&shard->lock);
           assert(result != NULL);
         }
         break;
@@ -263,17 +423,16 @@ static void* GetRemoteData(snet_ref_t *ref)
 
   } else {
 
-    SNetDistribUpdateRef(ref, -1);
+    RefUpdateOwner(refInfo, ref, -1);
     if (--refInfo->count == 0) {
       result = refInfo->data;
       refInfo->data = NULL;
-      pthread_cond_destroy(&refInfo->cond_var);
-      SNetMemFree(SNetRefRefcountMapTake(remoteRefMap, *ref));
+      RefRelease(shard, refInfo, ref);
     } else {
       result = COPYFUN(ref->interface, refInfo->data);
     }
 
-    pthread_mutex_unlock(&remoteRefMutex);
+    pthread_mutex_unlock(&shard->lock);
   }
 
   return result;
@@ -310,17 +469,17 @@ void SNetRefDestroy(snet_ref_t *ref)
     return;
   }
 
-  pthread_mutex_lock(&remoteRefMutex);
-  snet_refcount_t *refInfo = SNetRefRefcountMapGet(remoteRefMap, *ref);
+  ref_shard_t *shard = RefShard(remoteRefTable, ref);
+  pthread_mutex_lock(&shard->lock);
+  snet_refcount_t *refInfo = RefGet(shard, ref);
 
-  SNetDistribUpdateRef(ref, -1);
+  RefUpdateOwner(refInfo, ref, -1);
   if (--refInfo->count == 0) {
     if (refInfo->data) FREEFUN(ref->interface, refInfo->data);
     refInfo->data = NULL;
-    pthread_cond_destroy(&refInfo->cond_var);
-    SNetMemFree(SNetRefRefcountMapTake(remoteRefMap, *ref));
+    RefRelease(shard, refInfo, ref);
   }
-  pthread_mutex_unlock(&remoteRefMutex);
+  pthread_mutex_unlock(&shard->lock);
 
   SNetMemFree(ref);
 }
@@ -330,37 +489,32 @@ void SNetRefDestroy(snet_ref_t *ref)
 void SNetRefIncoming(snet_ref_t *ref)
 {
   snet_refcount_t *refInfo;
+  ref_shard_t     *shard;
 
   if (SNetDistribIsNodeLocation(ref->node)) {
-    pthread_mutex_lock(&localRefMutex);
+    shard = RefShard(localRefTable, ref);
+    pthread_mutex_lock(&shard->lock);
 
-    refInfo = SNetRefRefcountMapGet(localRefMap, *ref);
+    refInfo = RefGet(shard, ref);
     if (--refInfo->count == 0) {
       refInfo->data = NULL;
-      pthread_cond_destroy(&refInfo->cond_var);
-      SNetMemFree(SNetRefRefcountMapTake(localRefMap, *ref));
+      RefRemove(shard, ref);
     } else {
       ref->data = (uintptr_t) COPYFUN(ref->interface, (void*)ref->data);
     }
 
-    pthread_mutex_unlock(&localRefMutex);
+    pthread_mutex_unlock(&shard->lock);
   } else {
-    pthread_mutex_lock(&remoteRefMutex);
+    shard = RefShard(remoteRefTable, ref);
+    pthread_mutex_lock(&shard->lock);
 
-    if (SNetRefRefcountMapContains(remoteRefMap, *ref)) {
-      refInfo = SNetRefRefcountMapGet(remoteRefMap, *ref);
+    if ((refInfo = RefFind(shard, ref)) != NULL) {
       refInfo->count++;
     } else {
-      refInfo = SNetMemAlloc(sizeof(snet_refcount_t));
-      refInfo->count = 1;
-      refInfo->data = NULL;
-      refInfo->stream_list = NULL;
-      pthread_cond_init(&refInfo->cond_var, NULL);
-      refInfo->result_list = NULL;
-      SNetRefRefcountMapSet(remoteRefMap, *ref, refInfo);
+      RefAdd(shard, ref, 1, NULL);
     }
 
-    pthread_mutex_unlock(&remoteRefMutex);
+    pthread_mutex_unlock(&shard->lock);
   }
 }
 
@@ -368,61 +522,57 @@ void SNetRefIncoming(snet_ref_t *ref)
 void SNetRefOutgoing(snet_ref_t *ref)
 {
   snet_refcount_t *refInfo;
+  ref_shard_t     *shard;
 
   if (SNetDistribIsNodeLocation(ref->node)) {
-    pthread_mutex_lock(&localRefMutex);
+    shard = RefShard(localRefTable, ref);
+    pthread_mutex_lock(&shard->lock);
 
-    if (SNetRefRefcountMapContains(localRefMap, *ref)) {
-      refInfo = SNetRefRefcountMapGet(localRefMap, *ref);
+    if ((refInfo = RefFind(shard, ref)) != NULL) {
       refInfo->count++;
       FREEFUN(ref->interface, (void*)ref->data);
     } else {
-      refInfo = SNetMemAlloc(sizeof(snet_refcount_t));
-      refInfo->count = 1;
-      refInfo->data = (void*) ref->data;
-      refInfo->stream_list = NULL;
-      pthread_cond_init(&refInfo->cond_var, NULL);
-      refInfo->result_list = NULL;
-      SNetRefRefcountMapSet(localRefMap, *ref, refInfo);
+      RefAdd(shard, ref, 1, (void*) ref->data);
     }
 
-    pthread_mutex_unlock(&localRefMutex);
+    pthread_mutex_unlock(&shard->lock);
   } else {
-    pthread_mutex_lock(&remoteRefMutex);
+    shard = RefShard(remoteRefTable, ref);
+    pthread_mutex_lock(&shard->lock);
 
-    refInfo = SNetRefRefcountMapGet(remoteRefMap, *ref);
+    refInfo = RefGet(shard, ref);
     if (--refInfo->count == 0) {
       if (refInfo->data) FREEFUN(ref->interface, refInfo->data);
       refInfo->data = NULL;
-      pthread_cond_destroy(&refInfo->cond_var);
-      SNetMemFree(SNetRefRefcountMapTake(remoteRefMap, *ref));
+      RefRelease(shard, refInfo, ref);
     }
 
-    pthread_mutex_unlock(&remoteRefMutex);
+    pthread_mutex_unlock(&shard->lock);
   }
 }
 
 /* Called by input manager. */
 void SNetRefUpdate(snet_ref_t *ref, int value)
 {
-  pthread_mutex_lock(&localRefMutex);
+  ref_shard_t *shard = RefShard(localRefTable, ref);
+  pthread_mutex_lock(&shard->lock);
 
-  snet_refcount_t *refInfo = SNetRefRefcountMapGet(localRefMap, *ref);
+  snet_refcount_t *refInfo = RefGet(shard, ref);
   refInfo->count += value;
   if (refInfo->count == 0) {
     FREEFUN(ref->interface, refInfo->data);
     refInfo->data = NULL;
-    pthread_cond_destroy(&refInfo->cond_var);
-    SNetMemFree(SNetRefRefcountMapTake(localRefMap, *ref));
+    RefRemove(shard, ref);
   }
-  pthread_mutex_unlock(&localRefMutex);
+  pthread_mutex_unlock(&shard->lock);
 }
 
 /* Called by input manager. */
 void SNetRefSet(snet_ref_t *ref, void *data)
 {
-  pthread_mutex_lock(&remoteRefMutex);
-  snet_refcount_t *refInfo = SNetRefRefcountMapGet(remoteRefMap, *ref);
+  ref_shard_t *shard = RefShard(remoteRefTable, ref);
+  pthread_mutex_lock(&shard->lock);
+  snet_refcount_t *refInfo = RefGet(shard, ref);
 
   /* Discern between Threaded-Entity runtime and Front. */
   int runtime = SNetRuntimeGet();
@@ -471,10 +621,9 @@ void SNetRefSet(snet_ref_t *ref, void *data)
   } else {
     FREEFUN(ref->interface, data);
     refInfo->data = NULL;
-    pthread_cond_destroy(&refInfo->cond_var);
-    SNetMemFree(SNetRefRefcountMapTake(remoteRefMap, *ref));
+    RefRelease(shard, refInfo, ref);
   }
 
-  pthread_mutex_unlock(&remoteRefMutex);
+  pthread_mutex_unlock(&shard->lock);
 }
 
@@ -38,6 +38,26 @@ inline static void MPIUnpack(mpi_buf_t *buf, void *dst,
   MPI_Unpack(buf->data, buf->size, &buf->offset, dst, count, type, MPI_COMM_WORLD);
 }
 
+/* Append raw bytes of a homogeneous array, assuming equal data
+ * representations on all nodes, which avoids per-call MPI_Pack overhead. */
+inline static void MPIPackRaw(mpi_buf_t *buf, const void *src, size_t size)
+{
+  if (buf->offset + size > buf->size) {
+    size_t grow = 2 * buf->size;
+    buf->size = (buf->offset + size > grow) ? buf->offset + size : grow;
+    buf->data = SNetMemResize(buf->data, buf->size);
+  }
+  memcpy(buf->data + buf->offset, src, size);
+  buf->offset += size;
+}
+
+/* Extract raw bytes of a homogeneous array. */
+inline static void MPIUnpackRaw(mpi_buf_t *buf, void *dst, size_t size)
+{
+  memcpy(dst, buf->data + buf->offset, size);
+  buf->offset += size;
+}
+
 void SNetMPISend(void *src, int size, int dest, int type);
 void SNetPackInt(void *buf, int count, int *src);
 void SNetUnpackInt(void *buf, int count, int *dst);
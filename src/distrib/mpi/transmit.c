@@ -36,10 +36,10 @@ void SNetMPISend(void *src, int size, int dest, int type)
 { MPI_Send(src, size, MPI_PACKED, dest, type, MPI_COMM_WORLD); }
 
 void SNetPackInt(void *buf, int count, int *src)
-{ MPIPack(buf, src, MPI_INT, count); }
+{ MPIPackRaw(buf, src, count * sizeof(int)); }
 
 void SNetUnpackInt(void *buf, int count, int *dst)
-{ MPIUnpack(buf, dst, MPI_INT, count); }
+{ MPIUnpackRaw(buf, dst, count * sizeof(int)); }
 
 void SNetPackByte(void *buf, int count, char *src)
 { MPIPack(buf, src, MPI_BYTE, count); }
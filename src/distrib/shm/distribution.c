@@ -0,0 +1,186 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <stdarg.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#ifdef __linux__
+#include <sys/prctl.h>
+#endif
+
+#include "debug.h"
+#include "distribution.h"
+#include "distribcommon.h"
+#include "shm.h"
+
+int node_location;
+shm_segment_t *shm_segment;
+
+static int num_nodes = 0;
+static pid_t *node_pids;
+
+/* Map a shared segment with one message ring per node followed by the heap. */
+static void ShmCreateSegment(size_t heap_size)
+{
+  const size_t  page = sysconf(_SC_PAGESIZE);
+  size_t        rings, length;
+  char          name[64];
+  char         *base;
+  int           fd, i;
+  pthread_mutexattr_t attr;
+
+  rings = offsetof(shm_segment_t, rings) + num_nodes * sizeof(shm_ring_t);
+  rings = (rings + page - 1) / page * page;
+  length = rings + heap_size;
+
+  /* The name is unlinked at once: the mapping is inherited by fork. */
+  snprintf(name, sizeof(name), "/snet-shm-%d", (int) getpid());
+  fd = shm_open(name, O_RDWR | O_CREAT | O_EXCL, 0600);
+  if (fd == -1) {
+    SNetUtilDebugFatal("[%s]: shm_open %s failed: %s",
+                       __func__, name, strerror(errno));
+  }
+  shm_unlink(name);
+  if (ftruncate(fd, length) == -1) {
+    SNetUtilDebugFatal("[%s]: ftruncate %zu failed: %s",
+                       __func__, length, strerror(errno));
+  }
+  base = mmap(NULL, length, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  if (base == MAP_FAILED) {
+    SNetUtilDebugFatal("[%s]: mmap %zu failed: %s",
+                       __func__, length, strerror(errno));
+  }
+  close(fd);
+
+  shm_segment = (shm_segment_t *) base;
+  shm_segment->num_nodes = num_nodes;
+  shm_segment->length = length;
+
+  pthread_mutexattr_init(&attr);
+  pthread_mutexattr_setpshared(&attr, PTHREAD_PROCESS_SHARED);
+  for (i = 0; i < num_nodes; ++i) {
+    shm_ring_t *ring = &shm_segment->rings[i];
+    pthread_mutex_init(&ring->lock, &attr);
+    sem_init(&ring->ready, 1, 0);
+    ring->head = 0;
+    ring->tail = 0;
+  }
+  pthread_mutexattr_destroy(&attr);
+
+  SNetShmHeapInit(&shm_segment->heap, base + rings, heap_size);
+}
+
+/* Create the shared segment and fork one process per additional node.
+ * This runs before the runtime system starts any threads. */
+void SNetDistribImplementationInit(int argc, char **argv, snet_info_t *info)
+{
+  size_t        heap_mb = SHM_HEAP_MB;
+  pid_t         pid;
+  int           i;
+
+  (void) info; /* NOT USED */
+
+  for (i = 0; i < argc; i++) {
+    if (strcmp(argv[i], "-np") == 0 && ++i < argc) {
+      num_nodes = atoi(argv[i]);
+    } else if (strcmp(argv[i], "-shmheap") == 0 && ++i < argc) {
+      heap_mb = atoi(argv[i]);
+    }
+  }
+
+  if (num_nodes <= 0) {
+    SNetUtilDebugFatal("Number of nodes not specified using -np flag!\n");
+  }
+  if (heap_mb == 0) {
+    SNetUtilDebugFatal("Invalid shared heap size given by -shmheap!\n");
+  }
+
+  ShmCreateSegment(heap_mb << 20);
+
+  node_location = ROOT_LOCATION;
+  node_pids = SNetMemAlloc(num_nodes * sizeof(pid_t));
+  node_pids[ROOT_LOCATION] = getpid();
+
+  /* Avoid duplicate output of buffered data by the children. */
+  fflush(stdout);
+  fflush(stderr);
+
+  for (i = 1; i < num_nodes; ++i) {
+    if ((pid = fork()) == -1) {
+      SNetUtilDebugFatal("[%s]: fork failed: %s", __func__, strerror(errno));
+    }
+    if (pid == 0) {
+      node_location = i;
+#ifdef __linux__
+      /* Do not outlive the root node when it terminates abnormally. */
+      prctl(PR_SET_PDEATHSIG, SIGKILL);
+#endif
+      break;
+    }
+    node_pids[i] = pid;
+  }
+}
+
+void SNetDistribGlobalStop(void)
+{
+  int i;
+
+  for (i = num_nodes - 1; i >= 0; i--) {
+    SNetShmSend(i, snet_stop, NULL);
+  }
+}
+
+/* The root node waits for the other nodes to terminate. */
+void SNetDistribLocalStop(void)
+{
+  int i, status;
+
+  if (node_location == ROOT_LOCATION) {
+    for (i = 1; i < num_nodes; ++i) {
+      while (waitpid(node_pids[i], &status, 0) == -1 && errno == EINTR) { }
+    }
+  }
+  SNetMemFree(node_pids);
+  node_pids = NULL;
+}
+
+int SNetDistribGetNodeId(void) { return node_location; }
+
+bool SNetDistribIsNodeLocation(int loc) { return node_location == loc; }
+
+bool SNetDistribIsRootNode(void) { return node_location == ROOT_LOCATION; }
+
+bool SNetDistribIsDistributed(void) { return true; }
+
+void SNetDistribPack(void *src, ...)
+{
+  va_list args;
+  shm_buf_t *buf;
+  size_t size;
+
+  va_start(args, src);
+  buf = va_arg(args, shm_buf_t *);
+  size = va_arg(args, size_t);
+  va_end(args);
+
+  ShmPack(buf, src, size);
+}
+
+void SNetDistribUnpack(void *dst, ...)
+{
+  va_list args;
+  shm_buf_t *buf;
+  size_t size;
+
+  va_start(args, dst);
+  buf = va_arg(args, shm_buf_t *);
+  size = va_arg(args, size_t);
+  va_end(args);
+
+  ShmUnpack(buf, dst, size);
+}
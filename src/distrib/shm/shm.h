@@ -0,0 +1,111 @@
+#ifndef SHM_H
+#define SHM_H
+
+#include <pthread.h>
+#include <semaphore.h>
+#include <string.h>
+
+#include "distribution.h"
+#include "memfun.h"
+#include "bool.h"
+
+/* Capacity in bytes of the message ring of one node. */
+#define SHM_RING_SIZE       (1024 * 1024)
+
+/* Default size in megabytes of the shared heap for field data. */
+#define SHM_HEAP_MB         256
+
+/* Number of power-of-two size classes of the shared heap. */
+#define SHM_HEAP_CLASSES    48
+
+/* Smallest size class: blocks of 2^SHM_HEAP_MIN_CLASS bytes. */
+#define SHM_HEAP_MIN_CLASS  5
+
+/* A message ring of a receiving node. Writers serialise on 'lock',
+ * the single reader is the input manager of the node.
+ * 'head' and 'tail' increase monotonically and are taken modulo the size. */
+typedef struct shm_ring {
+  pthread_mutex_t       lock;
+  sem_t                 ready;
+  volatile size_t       head;
+  volatile size_t       tail;
+  char                  data[SHM_RING_SIZE];
+} shm_ring_t;
+
+/* The shared heap: size classes with free lists and a bump pointer.
+ * All processes map the segment at the same address, so plain pointers
+ * into the heap are valid in every process. */
+typedef struct shm_heap {
+  pthread_mutex_t       lock;
+  char                 *base;
+  size_t                size;
+  size_t                brk;
+  void                 *free[SHM_HEAP_CLASSES];
+} shm_heap_t;
+
+/* The shared segment which is mapped before forking the nodes. */
+typedef struct shm_segment {
+  int                   num_nodes;
+  size_t                length;
+  shm_heap_t            heap;
+  shm_ring_t            rings[];
+} shm_segment_t;
+
+/* Every message in a ring starts with this header. */
+typedef struct shm_header {
+  int                   tag;
+  int                   source;
+  int                   size;
+} shm_header_t;
+
+/* A growable buffer for packing and unpacking messages. */
+typedef struct {
+  int                   offset;
+  size_t                size;
+  char                 *data;
+} shm_buf_t;
+
+extern int node_location;
+extern shm_segment_t *shm_segment;
+
+/* Append raw bytes to a buffer. */
+inline static void ShmPack(shm_buf_t *buf, const void *src, size_t size)
+{
+  if (buf->offset + size > buf->size) {
+    size_t grow = 2 * buf->size;
+    buf->size = (buf->offset + size > grow) ? buf->offset + size : grow;
+    buf->data = SNetMemResize(buf->data, buf->size);
+  }
+  memcpy(buf->data + buf->offset, src, size);
+  buf->offset += size;
+}
+
+/* Extract raw bytes from a buffer. */
+inline static void ShmUnpack(shm_buf_t *buf, void *dst, size_t size)
+{
+  memcpy(dst, buf->data + buf->offset, size);
+  buf->offset += size;
+}
+
+void SNetShmHeapInit(shm_heap_t *heap, char *base, size_t size);
+void *SNetShmAlloc(size_t size);
+void SNetShmRetain(void *ptr);
+void SNetShmFree(void *ptr);
+
+shm_buf_t *SNetShmBufGet(void);
+void SNetShmBufPut(shm_buf_t *buf);
+void SNetShmSend(int dest, int tag, shm_buf_t *buf);
+int SNetShmRecv(int *source, shm_buf_t *buf);
+
+void SNetPackInt(void *buf, int count, int *src);
+void SNetUnpackInt(void *buf, int count, int *dst);
+void SNetPackByte(void *buf, int count, char *src);
+void SNetUnpackByte(void *buf, int count, char *dst);
+void SNetPackLong(void *buf, int count, long *src);
+void SNetUnpackLong(void *buf, int count, long *dst);
+void SNetPackVoid(void *buf, int count, void **src);
+void SNetUnpackVoid(void *buf, int count, void **dst);
+void SNetPackRef(void *buf, int count, snet_ref_t **src);
+void SNetUnpackRef(void *buf, int count, snet_ref_t **dst);
+
+#endif
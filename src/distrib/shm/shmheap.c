@@ -0,0 +1,91 @@
+#include <stdint.h>
+
+#include "debug.h"
+#include "shm.h"
+
+/* Every heap block is preceded by its size class and a reference count,
+ * which is shared by all nodes which hold the block. */
+typedef struct shm_block {
+  size_t                klass;
+  size_t                refs;
+} shm_block_t;
+
+#define BLOCK_OF(ptr)   ((shm_block_t *) (ptr) - 1)
+
+/* Prepare an empty heap in the shared segment. */
+void SNetShmHeapInit(shm_heap_t *heap, char *base, size_t size)
+{
+  pthread_mutexattr_t   attr;
+  int                   i;
+
+  pthread_mutexattr_init(&attr);
+  pthread_mutexattr_setpshared(&attr, PTHREAD_PROCESS_SHARED);
+  pthread_mutex_init(&heap->lock, &attr);
+  pthread_mutexattr_destroy(&attr);
+
+  heap->base = base;
+  heap->size = size;
+  heap->brk = 0;
+  for (i = 0; i < SHM_HEAP_CLASSES; ++i) {
+    heap->free[i] = NULL;
+  }
+}
+
+/* Allocate a block from the shared heap with a reference count of one. */
+void *SNetShmAlloc(size_t size)
+{
+  shm_heap_t   *heap = &shm_segment->heap;
+  shm_block_t  *block;
+  size_t        klass = SHM_HEAP_MIN_CLASS;
+
+  while (((size_t) 1 << klass) < size + sizeof(shm_block_t)) {
+    ++klass;
+  }
+  if (klass >= SHM_HEAP_CLASSES) {
+    SNetUtilDebugFatal("[%s]: Invalid allocation of %zu bytes.",
+                       __func__, size);
+  }
+
+  pthread_mutex_lock(&heap->lock);
+  if ((block = heap->free[klass]) != NULL) {
+    heap->free[klass] = *(void **) block;
+  }
+  else if (heap->brk + ((size_t) 1 << klass) <= heap->size) {
+    block = (shm_block_t *) (heap->base + heap->brk);
+    heap->brk += (size_t) 1 << klass;
+  }
+  pthread_mutex_unlock(&heap->lock);
+
+  if (block == NULL) {
+    SNetUtilDebugFatal("[%s]: Shared heap exhausted by %zu bytes (see -shmheap).",
+                       __func__, size);
+  }
+  block->klass = klass;
+  block->refs = 1;
+  return block + 1;
+}
+
+/* Add a reference to a shared heap block, e.g. when sent to another node. */
+void SNetShmRetain(void *ptr)
+{
+  __sync_add_and_fetch(&BLOCK_OF(ptr)->refs, 1);
+}
+
+/* Drop a reference to a shared heap block and free it if it was the last. */
+void SNetShmFree(void *ptr)
+{
+  shm_heap_t   *heap = &shm_segment->heap;
+  shm_block_t  *block;
+
+  if (ptr == NULL) {
+    return;
+  }
+  block = BLOCK_OF(ptr);
+  if (__sync_sub_and_fetch(&block->refs, 1) == 0) {
+    size_t klass = block->klass;
+    pthread_mutex_lock(&heap->lock);
+    *(void **) block = heap->free[klass];
+    heap->free[klass] = block;
+    pthread_mutex_unlock(&heap->lock);
+  }
+}
@@ -0,0 +1,211 @@
+#include <errno.h>
+#include <sched.h>
+
+#include "debug.h"
+#include "memfun.h"
+#include "distribcommon.h"
+#include "interface_functions.h"
+#include "record.h"
+#include "reference.h"
+#include "shm.h"
+
+/* Initial size of message buffers. */
+#define SHM_BUF_SIZE    1000
+
+/* A message buffer which is reused for many messages. */
+typedef struct shm_send {
+  shm_buf_t             buf;
+  struct shm_send      *next;
+} shm_send_t;
+
+/* Idle message buffers. */
+static pthread_mutex_t  send_lock = PTHREAD_MUTEX_INITIALIZER;
+static shm_send_t      *send_idle;
+
+/* Obtain an empty message buffer. */
+shm_buf_t *SNetShmBufGet(void)
+{
+  shm_send_t   *send;
+
+  pthread_mutex_lock(&send_lock);
+  if ((send = send_idle) != NULL) {
+    send_idle = send->next;
+  }
+  pthread_mutex_unlock(&send_lock);
+
+  if (send == NULL) {
+    send = SNetNew(shm_send_t);
+    send->buf.size = SHM_BUF_SIZE;
+    send->buf.data = SNetMemAlloc(SHM_BUF_SIZE);
+  }
+  send->buf.offset = 0;
+  return &send->buf;
+}
+
+/* Return a message buffer after its message has been sent. */
+void SNetShmBufPut(shm_buf_t *buf)
+{
+  shm_send_t   *send = (shm_send_t *) buf;
+
+  pthread_mutex_lock(&send_lock);
+  send->next = send_idle;
+  send_idle = send;
+  pthread_mutex_unlock(&send_lock);
+}
+
+/* Copy bytes into a ring and wait for space when it is full. */
+static void ShmRingWrite(shm_ring_t *ring, const char *src, size_t size)
+{
+  while (size > 0) {
+    size_t space = SHM_RING_SIZE - (ring->tail - ring->head);
+    size_t pos = ring->tail % SHM_RING_SIZE;
+    size_t n = size;
+
+    if (space == 0) {
+      sched_yield();
+      continue;
+    }
+    if (n > space) n = space;
+    if (n > SHM_RING_SIZE - pos) n = SHM_RING_SIZE - pos;
+    memcpy(ring->data + pos, src, n);
+    /* Publish the data before the new tail. */
+    __sync_synchronize();
+    ring->tail += n;
+    src += n;
+    size -= n;
+  }
+}
+
+/* Copy bytes out of a ring and wait for them when they are not there yet. */
+static void ShmRingRead(shm_ring_t *ring, char *dst, size_t size)
+{
+  while (size > 0) {
+    size_t avail = ring->tail - ring->head;
+    size_t pos = ring->head % SHM_RING_SIZE;
+    size_t n = size;
+
+    if (avail == 0) {
+      sched_yield();
+      continue;
+    }
+    if (n > avail) n = avail;
+    if (n > SHM_RING_SIZE - pos) n = SHM_RING_SIZE - pos;
+    __sync_synchronize();
+    memcpy(dst, ring->data + pos, n);
+    /* Release the space only after copying. */
+    __sync_synchronize();
+    ring->head += n;
+    dst += n;
+    size -= n;
+  }
+}
+
+/* Append a message to the ring of a destination node.
+ * The reader is woken after the header, so messages larger
+ * than the ring stream through it while the writer holds the lock. */
+void SNetShmSend(int dest, int tag, shm_buf_t *buf)
+{
+  shm_ring_t   *ring = &shm_segment->rings[dest];
+  shm_header_t  header;
+
+  header.tag = tag;
+  header.source = node_location;
+  header.size = buf ? buf->offset : 0;
+
+  pthread_mutex_lock(&ring->lock);
+  ShmRingWrite(ring, (const char *) &header, sizeof(header));
+  sem_post(&ring->ready);
+  if (header.size > 0) {
+    ShmRingWrite(ring, buf->data, header.size);
+  }
+  pthread_mutex_unlock(&ring->lock);
+}
+
+/* Wait for the next message in the ring of this node and return its tag. */
+int SNetShmRecv(int *source, shm_buf_t *buf)
+{
+  shm_ring_t   *ring = &shm_segment->rings[node_location];
+  shm_header_t  header;
+
+  while (sem_wait(&ring->ready) == -1) {
+    if (errno != EINTR) {
+      SNetUtilDebugFatal("[%s]: sem_wait failed: %s", __func__, strerror(errno));
+    }
+  }
+  ShmRingRead(ring, (char *) &header, sizeof(header));
+  if ((size_t) header.size > buf->size) {
+    buf->data = SNetMemResize(buf->data, header.size);
+    buf->size = header.size;
+  }
+  ShmRingRead(ring, buf->data, header.size);
+  buf->offset = 0;
+  *source = header.source;
+  return header.tag;
+}
+
+void SNetPackInt(void *buf, int count, int *src)
+{ ShmPack(buf, src, count * sizeof(int)); }
+
+void SNetUnpackInt(void *buf, int count, int *dst)
+{ ShmUnpack(buf, dst, count * sizeof(int)); }
+
+void SNetPackByte(void *buf, int count, char *src)
+{ ShmPack(buf, src, count); }
+
+void SNetUnpackByte(void *buf, int count, char *dst)
+{ ShmUnpack(buf, dst, count); }
+
+void SNetPackLong(void *buf, int count, long *src)
+{ ShmPack(buf, src, count * sizeof(long)); }
+
+void SNetUnpackLong(void *buf, int count, long *dst)
+{ ShmUnpack(buf, dst, count * sizeof(long)); }
+
+void SNetPackVoid(void *buf, int count, void **src)
+{ ShmPack(buf, src, count * sizeof(void *)); }
+
+void SNetUnpackVoid(void *buf, int count, void **dst)
+{ ShmUnpack(buf, dst, count * sizeof(void *)); }
+
+void SNetPackRef(void *buf, int count, snet_ref_t **src)
+{
+  for (int i = 0; i < count; i++) {
+    SNetRefSerialise(src[i], buf, &SNetPackInt, &SNetPackByte);
+    SNetRefOutgoing(src[i]);
+  }
+}
+
+void SNetUnpackRef(void *buf, int count, snet_ref_t **dst)
+{
+  for (int i = 0; i < count; i++) {
+    dst[i] = SNetRefDeserialise(buf, &SNetUnpackInt, &SNetUnpackByte);
+    SNetRefIncoming(dst[i]);
+  }
+}
+
+void SNetDistribFetchRef(snet_ref_t *ref)
+{
+  shm_buf_t *buf = SNetShmBufGet();
+  SNetRefSerialise(ref, buf, &SNetPackInt, &SNetPackByte);
+  SNetShmSend(SNetRefNode(ref), snet_ref_fetch, buf);
+  SNetShmBufPut(buf);
+}
+
+void SNetDistribUpdateRef(snet_ref_t *ref, int count)
+{
+  shm_buf_t *buf = SNetShmBufGet();
+  SNetRefSerialise(ref, buf, &SNetPackInt, &SNetPackByte);
+  SNetPackInt(buf, 1, &count);
+  SNetShmSend(SNetRefNode(ref), snet_ref_update, buf);
+  SNetShmBufPut(buf);
+}
+
+/* With the data in the shared heap the interface packs only a pointer. */
+void SNetDistribSendData(snet_ref_t *ref, void *data, void *dest)
+{
+  shm_buf_t *buf = SNetShmBufGet();
+  SNetRefSerialise(ref, buf, &SNetPackInt, &SNetPackByte);
+  SNetInterfaceGet(SNetRefInterface(ref))->packfun(data, buf);
+  SNetShmSend((uintptr_t) dest, snet_ref_set, buf);
+  SNetShmBufPut(buf);
+}
@@ -3,6 +3,8 @@
 #include <string.h>
 #include <assert.h>
 #include <errno.h>
+#include <ctype.h>
+#include <stdint.h>
 
 #include "debug.h"
 #include "C4SNet.h"
@@ -80,6 +82,19 @@ static void SCCPackFun(c4snet_data_t *cdata, void *dest);
 static void *SCCUnpackFun(void *localBuf);
 #endif
 
+#ifdef ENABLE_DIST_SHM
+#include "shm.h"
+
+/* The shared heap is only defined by the shared memory distribution library,
+ * so C4SNet must still link against the other distribution libraries. */
+#pragma weak SNetShmAlloc
+#pragma weak SNetShmRetain
+#pragma weak SNetShmFree
+
+static void ShmPackFun(c4snet_data_t *data, void *buf);
+static void *ShmUnpackFun(void *buf);
+#endif
+
 /***************************** Auxiliary functions ****************************/
 
 static int sizeOfType(c4snet_type_t type)
@@ -172,11 +187,28 @@ static void C4SNetSerialise(FILE *file, c4snet_data_t *data)
   }
 }
 
+/* Read the text of one number into 'buf' after skipping white space.
+ * The caller holds the lock of 'file'. */
+static const char *ReadNumber(FILE *file, char *buf, size_t size)
+{
+  size_t n = 0;
+  int c;
+
+  while ((c = getc_unlocked(file)) != EOF && isspace(c)) { }
+  while (c != EOF && c != ',' && c != '<' && !isspace(c) && n < size - 1) {
+    buf[n++] = c;
+    c = getc_unlocked(file);
+  }
+  if (c != EOF) ungetc(c, file);
+  buf[n] = '\0';
+  return buf;
+}
+
 static void DeserialiseData(FILE *file, c4snet_type_t type, void *data)
 {
   char buf[6];
+  char num[128];
 
-  char *fmt = NULL;
   switch (type) {
     case CTYPE_char:
     case CTYPE_uchar:
@@ -195,20 +227,40 @@ static void DeserialiseData(FILE *file, c4snet_type_t type, void *data)
         return;
       }
 
-    case CTYPE_ushort: fmt = "%hu"; break;
-    case CTYPE_short: fmt = "%hd"; break;
-    case CTYPE_uint: fmt = "%u"; break;
-    case CTYPE_int: fmt = "%d"; break;
-    case CTYPE_ulong: fmt = "%lu"; break;
-    case CTYPE_long: fmt = "%ld"; break;
-    case CTYPE_float: fmt = "%f"; break;
-    case CTYPE_double: fmt = "%lf"; break;
-    case CTYPE_ldouble: fmt = "%Lf"; break;
-    case CTYPE_pointer: fmt = "%p"; break;
+    /* Convert numbers with strto* instead of a scanf per element. */
+    case CTYPE_ushort:
+      *(unsigned short *) data = strtoul(ReadNumber(file, num, sizeof(num)), NULL, 10);
+      break;
+    case CTYPE_short:
+      *(short *) data = strtol(ReadNumber(file, num, sizeof(num)), NULL, 10);
+      break;
+    case CTYPE_uint:
+      *(unsigned int *) data = strtoul(ReadNumber(file, num, sizeof(num)), NULL, 10);
+      break;
+    case CTYPE_int:
+      *(int *) data = strtol(ReadNumber(file, num, sizeof(num)), NULL, 10);
+      break;
+    case CTYPE_ulong:
+      *(unsigned long *) data = strtoul(ReadNumber(file, num, sizeof(num)), NULL, 10);
+      break;
+    case CTYPE_long:
+      *(long *) data = strtol(ReadNumber(file, num, sizeof(num)), NULL, 10);
+      break;
+    case CTYPE_float:
+      *(float *) data = strtof(ReadNumber(file, num, sizeof(num)), NULL);
+      break;
+    case CTYPE_double:
+      *(double *) data = strtod(ReadNumber(file, num, sizeof(num)), NULL);
+      break;
+    case CTYPE_ldouble:
+      *(long double *) data = strtold(ReadNumber(file, num, sizeof(num)), NULL);
+      break;
+    case CTYPE_pointer:
+      *(void **) data = (void *) (uintptr_t)
+                        strtoull(ReadNumber(file, num, sizeof(num)), NULL, 16);
+      break;
     default: SNetUtilDebugFatal("[%s]: FIXME invalid type %d.", __func__, type);
   }
-
-  (void) fscanf(file, fmt, data);
 }
 
 /* Deserializes textual data from a file. */
@@ -242,18 +294,20 @@ static c4snet_data_t *C4SNetDeserialise(FILE *file)
   else if(strncmp(buf, "pointer", size) == 0)         temp->type = CTYPE_pointer;
   else SNetUtilDebugFatal("[%s]: C4SNet interface encountered an unknown type.", __func__);
 
+  flockfile(file);
   if (temp->vtype == VTYPE_simple) {
     DeserialiseData(file, temp->type, &temp->data);
   } else {
     temp->data.ptr = MemAlloc(AllocatedSpace(temp));
     for (int i = 0; i < temp->size; i++) {
-      if (i > 0 && fgetc(file) != ',') {
+      if (i > 0 && getc_unlocked(file) != ',') {
         SNetUtilDebugFatal("[%s]: Parse error deserialising data.", __func__);
       }
       DeserialiseData(file, temp->type,
                       (char*) temp->data.ptr + i * C4SNetSizeof(temp));
     }
   }
+  funlockfile(file);
 
   return temp;
 }
@@ -326,6 +380,21 @@ void C4SNetInit( int id, snet_distrib_t distImpl)
                            "it.\n");
       #endif
       break;
+    case shm:
+      #ifdef ENABLE_DIST_SHM
+        if (SNetShmAlloc == NULL) {
+          SNetUtilDebugFatal("C4SNet uses shared memory, but the shared heap "
+                             "is not linked in.\n");
+        }
+        MemAlloc = &SNetShmAlloc;
+        MemFree = &SNetShmFree;
+        packfun = (void (*)(void*, void*)) &ShmPackFun;
+        unpackfun = &ShmUnpackFun;
+      #else
+        SNetUtilDebugFatal("C4SNet supports shared memory, but is not "
+                           "configured to use it.\n");
+      #endif
+      break;
     default:
       SNetUtilDebugFatal("C4SNet doesn't support the selected distribution "
                          "layer (%d).\n", distImpl);
@@ -570,3 +639,24 @@ static void *SCCUnpackFun(void *buf)
   return result;
 }
 #endif
+
+#ifdef ENABLE_DIST_SHM
+/* Arrays live in the shared heap: pass a reference instead of a copy. */
+static void ShmPackFun(c4snet_data_t *data, void *buf)
+{
+  SNetDistribPack(data, buf, sizeof(c4snet_data_t));
+
+  if (data->vtype == VTYPE_array) {
+    SNetShmRetain(data->data.ptr);
+  }
+}
+
+static void *ShmUnpackFun(void *buf)
+{
+  c4snet_data_t *result = SNetMemAlloc(sizeof(c4snet_data_t));
+  SNetDistribUnpack(result, buf, sizeof(c4snet_data_t));
+
+  result->ref_count = 1;
+  return result;
+}
+#endif
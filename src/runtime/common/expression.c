@@ -12,6 +12,7 @@
 #include "expression.h"
 
 #include "record.h"
+#include "list.h"
 #include "memfun.h"
 
 
@@ -49,9 +50,13 @@ union snet_expr_content_t {
   bool *bval;
 } ;
 
+/* A flat program compiled from an expression tree. */
+typedef struct expr_prog expr_prog_t;
+
 struct expression {
   snet_expr_type_t type;
   union snet_expr_content_t content;
+  expr_prog_t *prog;
 };
 
 
@@ -60,6 +65,7 @@ static snet_expr_t *CreateExpr( snet_expr_type_t t) {
 
   new = SNetMemAlloc( sizeof( snet_expr_t));
   new->type = t;
+  new->prog = NULL;
   
   switch( t) {
     case CONSTI:
@@ -114,6 +120,9 @@ void SNetExprDestroy( snet_expr_t *expr) {
       }
       SNetMemFree(expr->content.expr);
   }
+  if( expr->prog != NULL) {
+    SNetMemFree( expr->prog);
+  }
   SNetMemFree( expr);
 }
 
@@ -341,6 +350,321 @@ static bool isLessOp( snet_expr_t *expr, snet_record_t *rec)
   return( result);
 }
 
+/*
+--------------------------------------------------------------------------------
+*/
+
+/*
+ * Expressions are compiled into a flat program for a small stack machine
+ * when the entity which owns them is created. The program is evaluated
+ * in a single loop instead of by recursion over the tree. Every distinct
+ * tag gets a slot, which is looked up in the record at most once per
+ * evaluation. Expressions which fail to type check or which exceed the
+ * limits below are not compiled and are evaluated on the tree instead.
+ */
+#define EXPR_MAX_STACK  32
+#define EXPR_MAX_SLOTS  32
+
+typedef enum {
+  OP_PUSH,              /* push the constant argument */
+  OP_LOAD,              /* push the tag in slot argument */
+  OP_ABS,
+  OP_MIN,
+  OP_MAX,
+  OP_ADD,
+  OP_MUL,
+  OP_SUB,
+  OP_DIV,
+  OP_MOD,
+  OP_EQ,
+  OP_NE,
+  OP_GT,
+  OP_GE,
+  OP_LT,
+  OP_LE,
+  OP_NOT,
+  OP_JZ_OR_POP,         /* jump if the top is false, else pop it */
+  OP_JNZ_OR_POP,        /* jump if the top is true, else pop it */
+  OP_END                /* return the top */
+} expr_opcode_t;
+
+typedef struct {
+  expr_opcode_t op;
+  int arg;
+} expr_instr_t;
+
+struct expr_prog {
+  bool is_bool;
+  int num_slots;
+  int slot_label[EXPR_MAX_SLOTS];
+  bool slot_btag[EXPR_MAX_SLOTS];
+  expr_instr_t code[];
+};
+
+typedef struct {
+  expr_prog_t *prog;
+  int num_instr;
+  int depth;
+  int max_depth;
+} expr_compile_t;
+
+/* Count the nodes of a tree to bound the size of its program. */
+static int CountNodes( snet_expr_t *expr)
+{
+  switch( expr->type) {
+    case CONSTI:
+    case CONSTB:
+    case TAG:
+    case BTAG:
+      return 1;
+    case ABS:
+    case NOT:
+      return 1 + CountNodes( EXPR_OP( expr, 0));
+    case COND:
+      return 1 + CountNodes( EXPR_OP( expr, 0)) +
+             CountNodes( EXPR_OP( expr, 1)) + CountNodes( EXPR_OP( expr, 2));
+    default:
+      return 1 + CountNodes( EXPR_OP( expr, 0)) +
+             CountNodes( EXPR_OP( expr, 1));
+  }
+}
+
+/* Append an instruction and track the depth of the stack. */
+static void Emit( expr_compile_t *c, expr_opcode_t op, int arg, int effect)
+{
+  c->prog->code[c->num_instr].op = op;
+  c->prog->code[c->num_instr].arg = arg;
+  c->num_instr += 1;
+  c->depth += effect;
+  if( c->depth > c->max_depth) {
+    c->max_depth = c->depth;
+  }
+}
+
+/* Find or assign the slot of a tag or binding tag. */
+static int TagSlot( expr_compile_t *c, snet_expr_t *expr)
+{
+  expr_prog_t *prog = c->prog;
+  bool btag = ( expr->type == BTAG);
+  int i;
+
+  for( i = 0; i < prog->num_slots; i++) {
+    if( prog->slot_label[i] == *( expr->content.ival) &&
+        prog->slot_btag[i] == btag) {
+      return i;
+    }
+  }
+  if( prog->num_slots == EXPR_MAX_SLOTS) {
+    return -1;
+  }
+  prog->slot_label[i] = *( expr->content.ival);
+  prog->slot_btag[i] = btag;
+  prog->num_slots += 1;
+
+  return i;
+}
+
+/* Translate a binary node type into an opcode. */
+static expr_opcode_t BinOpcode( snet_expr_type_t type)
+{
+  switch( type) {
+    case MIN: return OP_MIN;
+    case MAX: return OP_MAX;
+    case ADD: return OP_ADD;
+    case MUL: return OP_MUL;
+    case SUB: return OP_SUB;
+    case DIV: return OP_DIV;
+    case MOD: return OP_MOD;
+    case EQ:  return OP_EQ;
+    case NE:  return OP_NE;
+    case GT:  return OP_GT;
+    case GE:  return OP_GE;
+    case LT:  return OP_LT;
+    default:  return OP_LE;
+  }
+}
+
+/* Compile a subtree which must yield a boolean if 'want_bool' is set. */
+static bool CompileNode( expr_compile_t *c, snet_expr_t *expr, bool want_bool)
+{
+  bool operand_bool;
+  int slot, jump;
+
+  if( isBoolean( expr) != want_bool) {
+    return false;
+  }
+
+  switch( expr->type) {
+    case CONSTI:
+      Emit( c, OP_PUSH, *( expr->content.ival), 1);
+      break;
+    case CONSTB:
+      Emit( c, OP_PUSH, *( expr->content.bval) ? 1 : 0, 1);
+      break;
+    case TAG:
+    case BTAG:
+      if( ( slot = TagSlot( c, expr)) < 0) {
+        return false;
+      }
+      Emit( c, OP_LOAD, slot, 1);
+      break;
+    case ABS:
+      if( !CompileNode( c, EXPR_OP( expr, 0), false)) {
+        return false;
+      }
+      Emit( c, OP_ABS, 0, 0);
+      break;
+    case NOT:
+      if( !CompileNode( c, EXPR_OP( expr, 0), true)) {
+        return false;
+      }
+      Emit( c, OP_NOT, 0, 0);
+      break;
+    case AND:
+    case OR:
+      if( !CompileNode( c, EXPR_OP( expr, 0), true)) {
+        return false;
+      }
+      jump = c->num_instr;
+      Emit( c, expr->type == AND ? OP_JZ_OR_POP : OP_JNZ_OR_POP, 0, -1);
+      if( !CompileNode( c, EXPR_OP( expr, 1), true)) {
+        return false;
+      }
+      c->prog->code[jump].arg = c->num_instr;
+      break;
+    case MIN:
+    case MAX:
+    case ADD:
+    case MUL:
+    case SUB:
+    case DIV:
+    case MOD:
+    case EQ:
+    case NE:
+    case GT:
+    case GE:
+    case LT:
+    case LE:
+      /* Only (in)equality compares booleans, like isEqualOp. */
+      operand_bool = ( expr->type == EQ || expr->type == NE) &&
+                     isBoolean( EXPR_OP( expr, 0));
+      if( !CompileNode( c, EXPR_OP( expr, 0), operand_bool) ||
+          !CompileNode( c, EXPR_OP( expr, 1), operand_bool)) {
+        return false;
+      }
+      Emit( c, BinOpcode( expr->type), 0, -1);
+      break;
+    default:
+      /* Conditionals are not supported by the evaluator either. */
+      return false;
+  }
+
+  return( c->max_depth <= EXPR_MAX_STACK);
+}
+
+/* Compile an expression into a flat program, unless already done. */
+extern void SNetExprCompile( snet_expr_t *expr)
+{
+  expr_compile_t c;
+  size_t size;
+
+  if( expr == NULL || expr->prog != NULL) {
+    return;
+  }
+
+  /* Every node emits at most two instructions, plus the final one. */
+  size = sizeof( expr_prog_t) +
+         ( 2 * CountNodes( expr) + 1) * sizeof( expr_instr_t);
+  c.prog = SNetMemAlloc( size);
+  c.prog->is_bool = isBoolean( expr);
+  c.prog->num_slots = 0;
+  c.num_instr = 0;
+  c.depth = 0;
+  c.max_depth = 0;
+
+  if( CompileNode( &c, expr, c.prog->is_bool)) {
+    Emit( &c, OP_END, 0, 0);
+    expr->prog = c.prog;
+  } else {
+    SNetMemFree( c.prog);
+  }
+}
+
+/* Compile all expressions of a list. */
+extern void SNetExprListCompile( snet_expr_list_t *list)
+{
+  snet_expr_t *expr;
+
+  if( list != NULL) {
+    LIST_FOR_EACH( list, expr) {
+      SNetExprCompile( expr);
+    }
+  }
+}
+
+/* Evaluate a compiled program for a record. */
+static int RunProg( const expr_prog_t *prog, snet_record_t *rec)
+{
+  int stack[EXPR_MAX_STACK];
+  int slots[EXPR_MAX_SLOTS];
+  unsigned int loaded = 0;
+  int *top = stack - 1;
+  const expr_instr_t *pc = prog->code;
+
+  for (;;) {
+    switch( pc->op) {
+      case OP_PUSH:
+        *++top = pc->arg;
+        break;
+      case OP_LOAD:
+        if( !( loaded & ( 1U << pc->arg))) {
+          slots[pc->arg] = prog->slot_btag[pc->arg]
+                         ? SNetRecGetBTag( rec, prog->slot_label[pc->arg])
+                         : SNetRecGetTag( rec, prog->slot_label[pc->arg]);
+          loaded |= ( 1U << pc->arg);
+        }
+        *++top = slots[pc->arg];
+        break;
+      case OP_ABS:
+        *top = abs( *top);
+        break;
+      case OP_NOT:
+        *top = !*top;
+        break;
+      case OP_MIN: --top; *top = minOp( top[0], top[1]); break;
+      case OP_MAX: --top; *top = maxOp( top[0], top[1]); break;
+      case OP_ADD: --top; *top = top[0] + top[1]; break;
+      case OP_MUL: --top; *top = top[0] * top[1]; break;
+      case OP_SUB: --top; *top = top[0] - top[1]; break;
+      case OP_DIV: --top; *top = top[0] / top[1]; break;
+      case OP_MOD: --top; *top = top[0] % top[1]; break;
+      case OP_EQ:  --top; *top = ( top[0] == top[1]); break;
+      case OP_NE:  --top; *top = ( top[0] != top[1]); break;
+      case OP_GT:  --top; *top = ( top[0] >  top[1]); break;
+      case OP_GE:  --top; *top = ( top[0] >= top[1]); break;
+      case OP_LT:  --top; *top = ( top[0] <  top[1]); break;
+      case OP_LE:  --top; *top = ( top[0] <= top[1]); break;
+      case OP_JZ_OR_POP:
+        if( *top == 0) {
+          pc = prog->code + pc->arg;
+          continue;
+        }
+        --top;
+        break;
+      case OP_JNZ_OR_POP:
+        if( *top != 0) {
+          pc = prog->code + pc->arg;
+          continue;
+        }
+        --top;
+        break;
+      case OP_END:
+        return *top;
+    }
+    ++pc;
+  }
+}
+
 extern bool SNetEevaluateBool( snet_expr_t *expr, snet_record_t *rec) 
 {
   bool result;
@@ -348,6 +672,9 @@ extern bool SNetEevaluateBool( snet_expr_t *expr, snet_record_t *rec)
   if( expr == NULL) {
     result = true;
   }
+  else if( expr->prog != NULL && expr->prog->is_bool) {
+    result = ( RunProg( expr->prog, rec) != 0);
+  }
   else {
     switch( expr->type) {
       case CONSTB:
@@ -363,13 +690,13 @@ extern bool SNetEevaluateBool( snet_expr_t *expr, snet_record_t *rec)
         result = isGreaterOp( expr, rec);
       break;
       case GE:
-        result = ( isGreaterOp( expr, rec) || isEqualOp( expr, rec));
+        result = !( isLessOp( expr, rec));
       break;
       case LT:
         result = isLessOp( expr, rec);
       break;
       case LE:
-        result = ( isLessOp( expr, rec) || isEqualOp( expr, rec));
+        result = !( isGreaterOp( expr, rec));
       break;
       case AND:
         result = ( SNetEevaluateBool( EXPR_OP( expr, 0), rec) &&
@@ -401,6 +728,9 @@ extern int SNetEevaluateInt( snet_expr_t *expr, snet_record_t *rec)
   if( expr == NULL) {
     result = true;
   }
+  else if( expr->prog != NULL && !expr->prog->is_bool) {
+    result = RunProg( expr->prog, rec);
+  }
   else {
     switch( expr->type) {
       case CONSTI:
@@ -1,6 +1,7 @@
 #include <stdarg.h>
 #include <assert.h>
 #include <string.h>
+#include <pthread.h>
 #include "interface_functions.h"
 #include "distribution.h"
 #include "record.h"
@@ -10,23 +11,205 @@
 #include "variant.h"
 #include "atomiccnt.h"
 
+/* The number of labels of each kind which a data record stores inline. */
+#define REC_INLINE_LABELS       4
+
+/* A data record is allocated as one block together with its label maps
+ * and inline storage for their keys and values. Maps only spill to
+ * separately allocated arrays when a record exceeds REC_INLINE_LABELS
+ * tags, binding tags or fields. */
+typedef struct data_rec_block {
+  snet_record_t          rec;
+  snet_int_map_t         tags;
+  snet_int_map_t         btags;
+  snet_ref_map_t         fields;
+  int                    tag_keys[REC_INLINE_LABELS];
+  int                    tag_vals[REC_INLINE_LABELS];
+  int                    btag_keys[REC_INLINE_LABELS];
+  int                    btag_vals[REC_INLINE_LABELS];
+  int                    field_keys[REC_INLINE_LABELS];
+  snet_ref_t            *field_vals[REC_INLINE_LABELS];
+} data_rec_block_t;
+
 static snet_atomiccnt_t recid_sequencer __attribute__ ((aligned (LINE_SIZE)))
                         = SNET_ATOMICCNT_INITIALIZER(0);
 
+#if HAVE___THREAD
+/* Threads reserve record ids from the sequencer in blocks, which double
+ * in size from RECID_BLOCK_MIN up to RECID_BLOCK_MAX ids. */
+#define RECID_BLOCK_MIN         16
+#define RECID_BLOCK_MAX         1024
+
+/* A range of record ids which is reserved by one thread. */
+typedef struct recid_block {
+  volatile unsigned      next;          /* next unused id */
+  volatile unsigned      end;           /* end of the reserved range */
+  unsigned               size;          /* size of the next reservation */
+  struct recid_block    *next_block;    /* list of all blocks */
+  struct recid_block    *next_orphan;   /* list of blocks of exited threads */
+} recid_block_t;
+
+static __thread recid_block_t *recid_self;
+static recid_block_t   *recid_blocks;
+static recid_block_t   *recid_orphans;
+static pthread_mutex_t  recid_orphan_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_key_t    recid_key;
+static pthread_once_t   recid_once = PTHREAD_ONCE_INIT;
+
+/* Keep the unused ids of an exiting thread for a future thread. */
+static void RecIdBlockOrphan(void *arg)
+{
+  recid_block_t *block = arg;
+
+  pthread_mutex_lock(&recid_orphan_lock);
+  block->next_orphan = recid_orphans;
+  recid_orphans = block;
+  pthread_mutex_unlock(&recid_orphan_lock);
+}
+
+static void RecIdInit(void)
+{
+  pthread_key_create(&recid_key, RecIdBlockOrphan);
+}
+
+/* Obtain an id block for the current thread: adopt an orphan or create one. */
+static recid_block_t *RecIdBlockGet(void)
+{
+  recid_block_t *block;
+
+  pthread_once(&recid_once, RecIdInit);
+
+  pthread_mutex_lock(&recid_orphan_lock);
+  if ((block = recid_orphans) != NULL) {
+    recid_orphans = block->next_orphan;
+  }
+  pthread_mutex_unlock(&recid_orphan_lock);
+
+  if (block == NULL) {
+    block = SNetNew(recid_block_t);
+    block->next = block->end = 0;
+    block->size = RECID_BLOCK_MIN;
+    do {
+      block->next_block = recid_blocks;
+    } while (!CAS(&recid_blocks, block->next_block, block));
+  }
+  block->next_orphan = NULL;
+
+  pthread_setspecific(recid_key, block);
+  recid_self = block;
+  return block;
+}
+#endif
+
 /*****************************************************************************
  * Helper functions
  ****************************************************************************/
 static void GenerateRecId(snet_record_id_t *rid)
 {
   assert( SNET_REC_SUBID_NUM == 2 );
+#if HAVE___THREAD
+  {
+    recid_block_t *block = recid_self ? recid_self : RecIdBlockGet();
+    if (block->next == block->end) {
+      const unsigned first = SNetAtomicCntFetchAndAdd(&recid_sequencer,
+                                                      block->size);
+      block->end = first + block->size;
+      block->next = first;
+      if (block->size < RECID_BLOCK_MAX) {
+        block->size *= 2;
+      }
+    }
+    rid->subid[0] = block->next++;
+  }
+#else
   rid->subid[0] = SNetAtomicCntFetchAndInc(&recid_sequencer);
+#endif
   rid->subid[1] = SNetDistribGetNodeId();
 }
 
+/* Allocate a data record with empty inline label maps. */
+static snet_record_t *DataRecAlloc(void)
+{
+  data_rec_block_t *block = SNetNew(data_rec_block_t);
+  snet_record_t *rec = &block->rec;
+
+  REC_DESCR( rec) = REC_data;
+  SNetIntMapInit(&block->tags, REC_INLINE_LABELS,
+                 block->tag_keys, block->tag_vals);
+  SNetIntMapInit(&block->btags, REC_INLINE_LABELS,
+                 block->btag_keys, block->btag_vals);
+  SNetRefMapInit(&block->fields, REC_INLINE_LABELS,
+                 block->field_keys, block->field_vals);
+  DATA_REC( rec, tags) = &block->tags;
+  DATA_REC( rec, btags) = &block->btags;
+  DATA_REC( rec, fields) = &block->fields;
+  DATA_REC( rec, tag_mask) = 0;
+  DATA_REC( rec, btag_mask) = 0;
+  DATA_REC( rec, field_mask) = 0;
+  DATA_REC( rec, trace) = NULL;
+  return rec;
+}
+
+/* Duplicate the latency trace of a sampled data record. */
+static snet_record_trace_t *TraceCopy(const snet_record_trace_t *trace)
+{
+  snet_record_trace_t *copy = SNetNew(snet_record_trace_t);
+
+  *copy = *trace;
+  if (trace->max_hops > 0) {
+    copy->hops = SNetNewN(trace->max_hops, snet_record_hop_t);
+    memcpy(copy->hops, trace->hops, trace->num_hops * sizeof(snet_record_hop_t));
+  }
+  return copy;
+}
+
+/* Free the latency trace of a sampled data record. */
+static void TraceDestroy(snet_record_trace_t *trace)
+{
+  SNetMemFree(trace->hops);
+  SNetDelete(trace);
+}
+
+/* Recompute the label masks of a data record from its maps. */
+static void DataRecUpdateMasks(snet_record_t *rec)
+{
+  int name, val;
+  snet_ref_t *field;
+
+  DATA_REC( rec, tag_mask) = 0;
+  DATA_REC( rec, btag_mask) = 0;
+  DATA_REC( rec, field_mask) = 0;
+  RECORD_FOR_EACH_TAG(rec, name, val) {
+    DATA_REC( rec, tag_mask) |= LABEL_MASK_BIT(name);
+  }
+  RECORD_FOR_EACH_BTAG(rec, name, val) {
+    DATA_REC( rec, btag_mask) |= LABEL_MASK_BIT(name);
+  }
+  RECORD_FOR_EACH_FIELD(rec, name, field) {
+    DATA_REC( rec, field_mask) |= LABEL_MASK_BIT(name);
+  }
+  (void) val;
+  (void) field;
+}
+
 /* return number of created records */
 unsigned SNetGetRecCounter(void)
 {
+#if HAVE___THREAD
+  /* Discount the reserved ids which have not been used yet. */
+  unsigned reserved = recid_sequencer.counter, unused = 0;
+  recid_block_t *block;
+
+  for (block = recid_blocks; block; block = block->next_block) {
+    const unsigned next = block->next, end = block->end;
+    if (end > next) {
+      unused += end - next;
+    }
+  }
+  return reserved - unused;
+#else
   return recid_sequencer.counter;
+#endif
 }
 
 /*****************************************************************************
@@ -52,6 +235,18 @@ bool SNetRecPatternMatches(snet_variant_t *pat, snet_record_t *rec)
 {
   int val;
 
+  /* All labels of the pattern below LABEL_MASK_BITS must be present. */
+  if ((pat->field_mask & ~DATA_REC(rec, field_mask)) |
+      (pat->tag_mask & ~DATA_REC(rec, tag_mask)) |
+      (pat->btag_mask & ~DATA_REC(rec, btag_mask)))
+  {
+    return false;
+  }
+  if (pat->masked) {
+    return true;
+  }
+
+  /* Look up the remaining labels, small labels test their mask bit. */
   VARIANT_FOR_EACH_FIELD(pat, val) {
     if (!SNetRecHasField(rec, val)) {
       return false;
@@ -91,6 +286,34 @@ void SNetRecFlowInherit( snet_variant_t *pat, snet_record_t *in_rec,
       SNetRecSetTag( out_rec, name, val);
     }
   }
+
+  /* Output records continue the latency trace of their input. */
+  if (DATA_REC( in_rec, trace) && !DATA_REC( out_rec, trace)) {
+    DATA_REC( out_rec, trace) = TraceCopy( DATA_REC( in_rec, trace));
+  }
+}
+
+/* Remove the labels which SNetRecFlowInherit does not inherit:
+ * the tags and fields of the pattern and all binding tags. */
+void SNetRecFlowStrip( snet_variant_t *pat, snet_record_t *rec)
+{
+  snet_int_map_t *btags = DATA_REC( rec, btags);
+  int name;
+
+  VARIANT_FOR_EACH_FIELD(pat, name) {
+    if (SNetRecHasField( rec, name)) {
+      SNetRefDestroy( SNetRecTakeField( rec, name));
+    }
+  }
+  VARIANT_FOR_EACH_TAG(pat, name) {
+    if (SNetRecHasTag( rec, name)) {
+      SNetRecTakeTag( rec, name);
+    }
+  }
+  while (btags->used > 0) {
+    SNetIntMapTake( btags, btags->keys[btags->used - 1]);
+  }
+  DATA_REC( rec, btag_mask) = 0;
 }
 
 snet_record_t *SNetRecCreate( snet_record_descr_t descr, ...)
@@ -98,15 +321,16 @@ snet_record_t *SNetRecCreate( snet_record_descr_t descr, ...)
   snet_record_t *rec;
   va_list args;
 
-  rec = SNetMemAlloc( sizeof( snet_record_t));
-  REC_DESCR( rec) = descr;
+  if (descr == REC_data) {
+    rec = DataRecAlloc();
+  } else {
+    rec = SNetMemAlloc( sizeof( snet_record_t));
+    REC_DESCR( rec) = descr;
+  }
 
   va_start( args, descr);
   switch (descr) {
     case REC_data:
-      DATA_REC( rec, btags) = SNetIntMapCreate(0);
-      DATA_REC( rec, tags) = SNetIntMapCreate(0);
-      DATA_REC( rec, fields) = SNetRefMapCreate(0);
       DATA_REC( rec, mode) = MODE_binary;
       GenerateRecId( &DATA_REC( rec, rid) );
       DATA_REC( rec, interface_id) = 0;
@@ -165,15 +389,20 @@ snet_record_t *SNetRecCopy( snet_record_t *rec)
 
   switch (REC_DESCR( rec)) {
     case REC_data:
-      new_rec = SNetMemAlloc( sizeof( snet_record_t));
-      REC_DESCR( new_rec) = REC_data;
-      DATA_REC( new_rec, fields) = SNetRefMapCopy(DATA_REC(rec, fields));
-      DATA_REC( new_rec, tags) = SNetIntMapCopy( DATA_REC( rec, tags));
-      DATA_REC( new_rec, btags) = SNetIntMapCopy( DATA_REC( rec, btags));
+      new_rec = DataRecAlloc();
+      SNetRefMapAssign( DATA_REC( new_rec, fields), DATA_REC( rec, fields));
+      SNetIntMapAssign( DATA_REC( new_rec, tags), DATA_REC( rec, tags));
+      SNetIntMapAssign( DATA_REC( new_rec, btags), DATA_REC( rec, btags));
+      DATA_REC( new_rec, tag_mask) = DATA_REC( rec, tag_mask);
+      DATA_REC( new_rec, btag_mask) = DATA_REC( rec, btag_mask);
+      DATA_REC( new_rec, field_mask) = DATA_REC( rec, field_mask);
       SNetRecSetInterfaceId( new_rec, SNetRecGetInterfaceId( rec));
       SNetRecSetDataMode( new_rec, SNetRecGetDataMode( rec));
       SNetRecDetrefCopy( new_rec, rec);
       GenerateRecId( &DATA_REC( new_rec, rid) );		// generate a new Id for the new message
+      if (DATA_REC( rec, trace)) {
+        DATA_REC( new_rec, trace) = TraceCopy( DATA_REC( rec, trace));
+      }
       break;
     case REC_sort_end:
       new_rec = SNetRecCreate( REC_DESCR( rec),  SORT_E_REC( rec, level),
@@ -222,9 +451,12 @@ void SNetRecDestroy( snet_record_t *rec)
       RECORD_FOR_EACH_FIELD(rec, name, field) {
         SNetRefDestroy(field);
       }
-      SNetRefMapDestroy( DATA_REC( rec, fields));
-      SNetIntMapDestroy( DATA_REC( rec, tags));
-      SNetIntMapDestroy( DATA_REC( rec, btags));
+      SNetRefMapDone( DATA_REC( rec, fields));
+      SNetIntMapDone( DATA_REC( rec, tags));
+      SNetIntMapDone( DATA_REC( rec, btags));
+      if (DATA_REC( rec, trace)) {
+        TraceDestroy( DATA_REC( rec, trace));
+      }
       (void) name;
       break;
     case REC_sync:
@@ -403,6 +635,7 @@ int SNetRecGetLevel( snet_record_t *rec)
 void SNetRecSetTag( snet_record_t *rec, int name, int val)
 {
   SNetIntMapSet(DATA_REC(rec, tags), name, val);
+  DATA_REC(rec, tag_mask) |= LABEL_MASK_BIT(name);
 }
 
 int SNetRecGetTag( snet_record_t *rec, int name)
@@ -412,17 +645,21 @@ int SNetRecGetTag( snet_record_t *rec, int name)
 
 int SNetRecTakeTag( snet_record_t *rec, int name)
 {
+  DATA_REC(rec, tag_mask) &= ~LABEL_MASK_BIT(name);
   return SNetIntMapTake(DATA_REC(rec, tags), name);
 }
 
 bool SNetRecHasTag( snet_record_t *rec, int name)
 {
-  return SNetIntMapContains(DATA_REC(rec, tags), name);
+  return LABEL_MASK_TEST(DATA_REC(rec, tag_mask), name,
+                         SNetIntMapContains(DATA_REC(rec, tags), name));
 }
 
 void SNetRecRenameTag( snet_record_t *rec, int oldName, int newName)
 {
   SNetIntMapRename(DATA_REC( rec, tags), oldName, newName);
+  DATA_REC( rec, tag_mask) &= ~LABEL_MASK_BIT(oldName);
+  DATA_REC( rec, tag_mask) |= LABEL_MASK_BIT(newName);
 }
 
 /*****************************************************************************/
@@ -430,6 +667,7 @@ void SNetRecRenameTag( snet_record_t *rec, int oldName, int newName)
 void SNetRecSetBTag( snet_record_t *rec, int name, int val)
 {
   SNetIntMapSet(DATA_REC(rec, btags), name, val);
+  DATA_REC(rec, btag_mask) |= LABEL_MASK_BIT(name);
 }
 
 int SNetRecGetBTag( snet_record_t *rec, int name)
@@ -439,17 +677,21 @@ int SNetRecGetBTag( snet_record_t *rec, int name)
 
 int SNetRecTakeBTag( snet_record_t *rec, int name)
 {
+  DATA_REC(rec, btag_mask) &= ~LABEL_MASK_BIT(name);
   return SNetIntMapTake(DATA_REC(rec, btags), name);
 }
 
 bool SNetRecHasBTag( snet_record_t *rec, int name)
 {
-  return SNetIntMapContains(DATA_REC(rec, btags), name);
+  return LABEL_MASK_TEST(DATA_REC(rec, btag_mask), name,
+                         SNetIntMapContains(DATA_REC(rec, btags), name));
 }
 
 void SNetRecRenameBTag( snet_record_t *rec, int oldName, int newName)
 {
   SNetIntMapRename(DATA_REC( rec, btags), oldName, newName);
+  DATA_REC( rec, btag_mask) &= ~LABEL_MASK_BIT(oldName);
+  DATA_REC( rec, btag_mask) |= LABEL_MASK_BIT(newName);
 }
 
 /*****************************************************************************/
@@ -457,6 +699,7 @@ void SNetRecRenameBTag( snet_record_t *rec, int oldName, int newName)
 void SNetRecSetField( snet_record_t *rec, int name, snet_ref_t *val)
 {
   SNetRefMapSet(DATA_REC(rec, fields), name, val);
+  DATA_REC(rec, field_mask) |= LABEL_MASK_BIT(name);
 }
 
 snet_ref_t *SNetRecGetField( snet_record_t *rec, int name)
@@ -466,17 +709,21 @@ snet_ref_t *SNetRecGetField( snet_record_t *rec, int name)
 
 snet_ref_t *SNetRecTakeField( snet_record_t *rec, int name)
 {
+  DATA_REC(rec, field_mask) &= ~LABEL_MASK_BIT(name);
   return SNetRefMapTake(DATA_REC(rec, fields), name);
 }
 
 bool SNetRecHasField( snet_record_t *rec, int name)
 {
-  return SNetRefMapContains(DATA_REC(rec, fields), name);
+  return LABEL_MASK_TEST(DATA_REC(rec, field_mask), name,
+                         SNetRefMapContains(DATA_REC(rec, fields), name));
 }
 
 void SNetRecRenameField( snet_record_t *rec, int oldName, int newName)
 {
   SNetRefMapRename(DATA_REC( rec, fields), oldName, newName);
+  DATA_REC( rec, field_mask) &= ~LABEL_MASK_BIT(oldName);
+  DATA_REC( rec, field_mask) |= LABEL_MASK_BIT(newName);
 }
 
 /*****************************************************************************/
@@ -489,6 +736,36 @@ void SNetRecIdGet(snet_record_id_t *id, snet_record_t *from)
   *id = DATA_REC(from, rid);
 }
 
+void SNetRecTraceStart(snet_record_t *rec, uint64_t now)
+{
+  snet_record_trace_t *trace;
+
+  if (REC_DESCR( rec) != REC_data) {
+    SNetRecUnknown(__func__, rec);
+  }
+  if ((trace = DATA_REC( rec, trace)) == NULL) {
+    trace = DATA_REC( rec, trace) = SNetNew(snet_record_trace_t);
+    trace->hops = NULL;
+    trace->max_hops = 0;
+  }
+  trace->start = now;
+  trace->num_hops = 0;
+}
+
+void SNetRecTraceHop(snet_record_t *rec, int node, uint64_t now)
+{
+  snet_record_trace_t *trace = DATA_REC( rec, trace);
+
+  if (trace->num_hops == trace->max_hops) {
+    trace->max_hops = trace->max_hops ? 2 * trace->max_hops : 8;
+    trace->hops = SNetMemResize(trace->hops,
+                                trace->max_hops * sizeof(snet_record_hop_t));
+  }
+  trace->hops[trace->num_hops].node = node;
+  trace->hops[trace->num_hops].time = now;
+  trace->num_hops += 1;
+}
+
 /*****************************************************************************/
 
 
@@ -556,6 +833,7 @@ snet_record_t *SNetRecDeserialise(
       SNetIntMapDeserialise(DATA_REC(result, btags), buf, unpackInts, unpackInts);
       SNetIntMapDeserialise(DATA_REC(result, tags), buf, unpackInts, unpackInts);
       SNetRefMapDeserialise(DATA_REC(result, fields), buf, unpackInts, unpackRefs);
+      DataRecUpdateMasks(result);
 
       unpackInts(buf, 1, &enumConversion);
       DATA_REC( result, mode) = enumConversion;
@@ -6,6 +6,30 @@ struct snet_variant {
   snet_int_list_t *tags, *btags, *fields;
 };
 
+/* Compute the label mask of a list and clear 'masked' if it is partial. */
+static snet_label_mask_t IntlistMask(snet_int_list_t *list, bool *masked)
+{
+  snet_label_mask_t mask = 0;
+  int name;
+
+  LIST_FOR_EACH(list, name) {
+    if (LABEL_MASK_BIT(name) == 0) {
+      *masked = false;
+    }
+    mask |= LABEL_MASK_BIT(name);
+  }
+  return mask;
+}
+
+/* Recompute the label masks after the lists of a variant changed. */
+static void VariantUpdateMasks(snet_variant_t *var)
+{
+  var->masked = true;
+  var->tag_mask = IntlistMask(var->tags, &var->masked);
+  var->btag_mask = IntlistMask(var->btags, &var->masked);
+  var->field_mask = IntlistMask(var->fields, &var->masked);
+}
+
 snet_variant_t *SNetVariantCreate( snet_int_list_t *fields,
                                    snet_int_list_t *tags,
                                    snet_int_list_t *btags)
@@ -15,6 +39,7 @@ snet_variant_t *SNetVariantCreate( snet_int_list_t *fields,
   variant->tags= tags;
   variant->btags= btags;
   variant->fields = fields;
+  VariantUpdateMasks(variant);
 
   return variant;
 }
@@ -26,6 +51,7 @@ snet_variant_t *SNetVariantCreateEmpty(void)
   variant->tags = SNetIntListCreate(0);
   variant->btags = SNetIntListCreate(0);
   variant->fields = SNetIntListCreate(0);
+  VariantUpdateMasks(variant);
 
   return variant;
 }
@@ -65,6 +91,7 @@ void SNetVariantAddAll( snet_variant_t *to, snet_variant_t *from, bool overwrite
   IntlistAddAll(to->fields, from->fields, overwrite);
   IntlistAddAll(to->tags, from->tags, overwrite);
   IntlistAddAll(to->btags, from->btags, overwrite);
+  VariantUpdateMasks(to);
 }
 
 
@@ -81,17 +108,20 @@ void SNetVariantAddTag( snet_variant_t *var, int name)
 {
   //FIXME: Already exists?
   SNetIntListAppendEnd(var->tags, name);
+  VariantUpdateMasks(var);
 }
 
 void SNetVariantRemoveTag( snet_variant_t *var, int name)
 {
   //FIXME: not present?
   SNetIntListRemove(var->tags, name);
+  VariantUpdateMasks(var);
 }
 
 bool SNetVariantHasTag( snet_variant_t *var, int name)
 {
-  return SNetIntListContains(var->tags, name);
+  return LABEL_MASK_TEST(var->tag_mask, name,
+                         SNetIntListContains(var->tags, name));
 }
 
 int SNetVariantNumTags( snet_variant_t *var)
@@ -105,17 +135,20 @@ void SNetVariantAddBTag( snet_variant_t *var, int name)
 {
   //FIXME: Already exists?
   SNetIntListAppendEnd(var->btags, name);
+  VariantUpdateMasks(var);
 }
 
 void SNetVariantRemoveBTag( snet_variant_t *var, int name)
 {
   //FIXME: not present?
   SNetIntListRemove(var->btags, name);
+  VariantUpdateMasks(var);
 }
 
 bool SNetVariantHasBTag( snet_variant_t *var, int name)
 {
-  return SNetIntListContains(var->btags, name);
+  return LABEL_MASK_TEST(var->btag_mask, name,
+                         SNetIntListContains(var->btags, name));
 }
 
 int SNetVariantNumBTags( snet_variant_t *var)
@@ -129,17 +162,20 @@ void SNetVariantAddField( snet_variant_t *var, int name)
 {
   //FIXME: Already exists?
   SNetIntListAppendEnd(var->fields, name);
+  VariantUpdateMasks(var);
 }
 
 void SNetVariantRemoveField( snet_variant_t *var, int name)
 {
   //FIXME: not present?
   SNetIntListRemove(var->fields, name);
+  VariantUpdateMasks(var);
 }
 
 bool SNetVariantHasField( snet_variant_t *var, int name)
 {
-  return SNetIntListContains(var->fields, name);
+  return LABEL_MASK_TEST(var->field_mask, name,
+                         SNetIntListContains(var->fields, name));
 }
 
 int SNetVariantNumFields( snet_variant_t *var)
@@ -20,6 +20,7 @@ typedef enum snet_comm {
   SNET_COMM_connect = 20,       /* setup a new cross-location stream */
   SNET_COMM_stop    = 30,       /* terminate remote input manager */
   SNET_COMM_record  = 40,       /* communicate a record */
+  SNET_COMM_batch   = 50,       /* communicate a batch of records */
 } snet_comm_t;
 
 /* The message structure which is constructed by SNetDistribReceiveMessage. */
@@ -37,5 +38,7 @@ typedef struct snet_mesg {
 void SNetDistribReceiveMessage(snet_mesg_t *mesg);
 void SNetDistribTransmitConnect(connect_t *connect);
 void SNetDistribTransmitRecord(snet_record_t *rec, connect_t *connect);
+void SNetDistribTransmitFlush(bool expired_only);
+void SNetDistribTransmitDrain(void);
 
 #endif
@@ -1,6 +1,10 @@
 #include <stdio.h>
 #include <assert.h>
+#include <pthread.h>
+#include <sched.h>
+#include <unistd.h>
 #include "debug.h"
+#include "debugtime.h"
 #include "distribcommon.h"
 #include "distribfront.h"
 #include "pack.h"
@@ -9,20 +13,242 @@
 
 extern const char* SNetCommName(int i);
 extern bool SNetDebugDF(void);
+extern int SNetOptBatchDelay(void);
+extern uint64_t SNetTraceClock(void);
+extern void SNetTraceMessage(bool send, uint64_t start, int peer);
+
+/* Initial size of send and receive buffers. */
+#define MPI_BUF_SIZE    1000
+
+/* Send a batch of records once it has grown to this many bytes. */
+#define MPI_BATCH_BYTES (8 * 1024)
+
+/* A send buffer which is reused for many non-blocking sends. */
+typedef struct mpi_send {
+  struct mpi_send      *next;
+  MPI_Request           request;
+  int                   dest;
+  mpi_buf_t             buf;
+} mpi_send_t;
+
+/* Per destination pool of idle send buffers
+ * and the batch of records which is being collected for it. */
+typedef struct mpi_pool {
+  pthread_mutex_t       lock;
+  mpi_send_t           *idle;
+  mpi_send_t           *batch;
+  int                   batch_count;
+  double                batch_start;
+} __attribute__((aligned(LINE_SIZE))) mpi_pool_t;
+
+/* Send buffer pools indexed by destination location. */
+static mpi_pool_t      *send_pools;
+static int              send_num_pools;
+static pthread_once_t   send_once = PTHREAD_ONCE_INIT;
+
+/* Sends which were started by workers: a lock-free stack. */
+static mpi_send_t      *send_posted;
+
+/* Sends which are awaiting completion: owned by the input manager. */
+static mpi_send_t      *send_active;
+
+/* The number of destinations with a non-empty batch of records. */
+static int              send_batches;
+
+/* Receive buffer of the input manager. */
+static mpi_buf_t        recv_buf;
+
+/* Records of a received batch which remain to be delivered, and their sender. */
+static int              recv_batch;
+static int              recv_source;
+
+/* Allocate the send buffer pools once. */
+static void SNetDistribSendInit(void)
+{
+  int i;
+
+  MPI_Comm_size(MPI_COMM_WORLD, &send_num_pools);
+  send_pools = SNetNewAlignN(send_num_pools, mpi_pool_t);
+  for (i = 0; i < send_num_pools; ++i) {
+    pthread_mutex_init(&send_pools[i].lock, NULL);
+    send_pools[i].idle = NULL;
+    send_pools[i].batch = NULL;
+    send_pools[i].batch_count = 0;
+  }
+}
+
+/* Find the send buffer pool of a destination. */
+static mpi_pool_t *SNetDistribSendPool(int dest)
+{
+  pthread_once(&send_once, SNetDistribSendInit);
+  assert(dest >= 0 && dest < send_num_pools);
+  return &send_pools[dest];
+}
+
+/* Take an empty send buffer from a locked pool. */
+static mpi_send_t *SNetDistribSendTake(mpi_pool_t *pool, int dest)
+{
+  mpi_send_t   *send;
+
+  if ((send = pool->idle) != NULL) {
+    pool->idle = send->next;
+  } else {
+    send = SNetNew(mpi_send_t);
+    send->dest = dest;
+    send->buf.size = MPI_BUF_SIZE;
+    send->buf.data = SNetMemAlloc(MPI_BUF_SIZE);
+  }
+  send->buf.offset = 0;
+  return send;
+}
+
+/* Obtain an empty send buffer for a destination. */
+static mpi_send_t *SNetDistribSendGet(int dest)
+{
+  mpi_pool_t   *pool = SNetDistribSendPool(dest);
+  mpi_send_t   *send;
+
+  pthread_mutex_lock(&pool->lock);
+  send = SNetDistribSendTake(pool, dest);
+  pthread_mutex_unlock(&pool->lock);
+  return send;
+}
+
+/* Return a completed send buffer to the pool of its destination. */
+static void SNetDistribSendPut(mpi_send_t *send)
+{
+  mpi_pool_t   *pool = &send_pools[send->dest];
+
+  pthread_mutex_lock(&pool->lock);
+  send->next = pool->idle;
+  pool->idle = send;
+  pthread_mutex_unlock(&pool->lock);
+}
+
+/* Start a non-blocking send and leave its completion to the input manager. */
+static void SNetDistribSendStart(mpi_send_t *send, int type)
+{
+  uint64_t      start = SNetTraceClock();
+
+  MPI_Isend(send->buf.data, send->buf.offset, MPI_PACKED, send->dest, type,
+            MPI_COMM_WORLD, &send->request);
+  SNetTraceMessage(true, start, send->dest);
+  do {
+    send->next = send_posted;
+  } while (!__sync_bool_compare_and_swap(&send_posted, send->next, send));
+}
+
+/* Send the batch of records of a locked pool. */
+static void SNetDistribBatchSend(mpi_pool_t *pool)
+{
+  mpi_send_t   *send = pool->batch;
+
+  if (send) {
+    /* The number of records precedes the records. */
+    memcpy(send->buf.data, &pool->batch_count, sizeof(int));
+    if (SNetDebugDF()) {
+      printf("[%s.%d]: sending %d records in %d bytes\n", __func__,
+             SNetDistribGetNodeId(), pool->batch_count, send->buf.offset);
+    }
+    pool->batch = NULL;
+    pool->batch_count = 0;
+    __sync_fetch_and_sub(&send_batches, 1);
+    SNetDistribSendStart(send, SNET_COMM_batch);
+  }
+}
+
+/* Send pending batches of records: all, or only those past their deadline. */
+void SNetDistribTransmitFlush(bool expired_only)
+{
+  const double  delay = 1e-6 * SNetOptBatchDelay();
+  double        now = 0;
+  int           i;
+
+  if (send_batches == 0) {
+    return;
+  }
+  if (expired_only) {
+    now = SNetRealTime();
+  }
+  for (i = 0; i < send_num_pools; ++i) {
+    mpi_pool_t *pool = &send_pools[i];
+    if (pool->batch && (!expired_only || now - pool->batch_start >= delay)) {
+      pthread_mutex_lock(&pool->lock);
+      SNetDistribBatchSend(pool);
+      pthread_mutex_unlock(&pool->lock);
+    }
+  }
+}
+
+/* Reclaim the buffers of completed sends; return true if none are pending. */
+static bool SNetDistribSendPoll(void)
+{
+  mpi_send_t   *send, **prev;
+  int           done;
+
+  if (send_posted) {
+    mpi_send_t *posted = __sync_lock_test_and_set(&send_posted, NULL);
+    while ((send = posted) != NULL) {
+      posted = send->next;
+      send->next = send_active;
+      send_active = send;
+    }
+  }
+  for (prev = &send_active; (send = *prev) != NULL; ) {
+    MPI_Test(&send->request, &done, MPI_STATUS_IGNORE);
+    if (done) {
+      *prev = send->next;
+      SNetDistribSendPut(send);
+    } else {
+      prev = &send->next;
+    }
+  }
+  return send_active == NULL && send_posted == NULL;
+}
+
+/* Complete all pending sends and release all send buffers. */
+void SNetDistribTransmitDrain(void)
+{
+  mpi_send_t   *send;
+  int           i;
+
+  SNetDistribTransmitFlush(false);
+  while (SNetDistribSendPoll() == false) {
+    sched_yield();
+  }
+  for (i = 0; i < send_num_pools; ++i) {
+    while ((send = send_pools[i].idle) != NULL) {
+      send_pools[i].idle = send->next;
+      SNetMemFree(send->buf.data);
+      SNetDelete(send);
+    }
+  }
+  if (recv_buf.data) {
+    SNetMemFree(recv_buf.data);
+    recv_buf.data = NULL;
+    recv_buf.size = 0;
+  }
+}
 
 /* Initiate a new connection. */
 void SNetDistribTransmitConnect(connect_t *connect)
 {
   const int     num_ints = sizeof(connect_t) / sizeof(int);
-  mpi_buf_t     buf = {0, 100, SNetMemAlloc(100)};
+  mpi_pool_t   *pool = SNetDistribSendPool(connect->dest_loc);
+  mpi_send_t   *send;
 
-  SNetPackInt(&buf, num_ints, (int *) connect);
+  /* Keep the order of messages to this destination. */
+  pthread_mutex_lock(&pool->lock);
+  SNetDistribBatchSend(pool);
+  send = SNetDistribSendTake(pool, connect->dest_loc);
+  pthread_mutex_unlock(&pool->lock);
+
+  SNetPackInt(&send->buf, num_ints, (int *) connect);
   if (SNetDebugDF()) {
     printf("[%s.%d]: sending %d connect bytes\n",
-           __func__, SNetDistribGetNodeId(), buf.offset);
+           __func__, SNetDistribGetNodeId(), send->buf.offset);
   }
-  SNetMPISend(buf.data, buf.offset, connect->dest_loc, SNET_COMM_connect);
-  SNetMemFree(buf.data);
+  SNetDistribSendStart(send, SNET_COMM_connect);
 }
 
 /* Accept an incoming connection. */
@@ -36,17 +262,44 @@ static connect_t* SNetDistribReceiveConnect(mpi_buf_t *buf)
   return connect;
 }
 
+/* Append a record to the batch for its destination. */
+static void SNetDistribBatchRecord(snet_record_t *rec, connect_t *connect)
+{
+  mpi_pool_t   *pool = SNetDistribSendPool(connect->dest_loc);
+  mpi_send_t   *send;
+
+  pthread_mutex_lock(&pool->lock);
+  if ((send = pool->batch) == NULL) {
+    send = pool->batch = SNetDistribSendTake(pool, connect->dest_loc);
+    send->buf.offset = sizeof(int);
+    pool->batch_start = SNetRealTime();
+    __sync_fetch_and_add(&send_batches, 1);
+  }
+  SNetPackInt(&send->buf, 2, (int *) connect);
+  SNetRecSerialise(rec, &send->buf, &SNetPackInt, &SNetPackRef);
+  pool->batch_count += 1;
+  if (send->buf.offset >= MPI_BATCH_BYTES) {
+    SNetDistribBatchSend(pool);
+  }
+  pthread_mutex_unlock(&pool->lock);
+}
+
 void SNetDistribTransmitRecord(snet_record_t *rec, connect_t *connect)
 {
-  mpi_buf_t buf = {0, 1000, SNetMemAlloc(1000)};
-  SNetPackInt(&buf, 2, (int *) connect);
+  mpi_send_t   *send;
+
+  if (SNetOptBatchDelay() > 0) {
+    SNetDistribBatchRecord(rec, connect);
+    return;
+  }
+  send = SNetDistribSendGet(connect->dest_loc);
+  SNetPackInt(&send->buf, 2, (int *) connect);
   if (SNetDebugDF()) {
-    printf("[%s.%d]: sending %d record bytes for type %s\n",
-           __func__, SNetDistribGetNodeId(), buf.offset, SNetRecTypeName(rec));
+    printf("[%s.%d]: sending %d record bytes for type %s\n", __func__,
+           SNetDistribGetNodeId(), send->buf.offset, SNetRecTypeName(rec));
   }
-  SNetRecSerialise(rec, &buf, &SNetPackInt, &SNetPackRef);
-  SNetMPISend(buf.data, buf.offset, connect->dest_loc, SNET_COMM_record);
-  SNetMemFree(buf.data);
+  SNetRecSerialise(rec, &send->buf, &SNetPackInt, &SNetPackRef);
+  SNetDistribSendStart(send, SNET_COMM_record);
 }
 
 void SNetDistribReceiveRecord(snet_mesg_t *mesg, mpi_buf_t *buf)
@@ -65,10 +318,43 @@ void SNetDistribReceiveMessage(snet_mesg_t *mesg)
   MPI_Status    status;
   int           count;
   int           interface;
-  mpi_buf_t     buf = { 0, 1000, SNetMemAlloc(1000) };
+  int           arrived = false;
+  uint64_t      start;
+  mpi_buf_t     buf = recv_buf;
+
+  /* Deliver the remaining records of a received batch first. */
+  if (recv_batch > 0) {
+    recv_batch -= 1;
+    memset(mesg, 0, sizeof(*mesg));
+    mesg->type = SNET_COMM_record;
+    mesg->source = recv_source;
+    SNetDistribReceiveRecord(mesg, &recv_buf);
+    return;
+  }
+  if (buf.data == NULL) {
+    buf.size = MPI_BUF_SIZE;
+    buf.data = SNetMemAlloc(MPI_BUF_SIZE);
+  }
 
-  /* Wait for a new message to arrive. */
-  MPI_Probe(MPI_ANY_SOURCE, MPI_ANY_TAG, MPI_COMM_WORLD, &status);
+  /* Wait for a new message to arrive, meanwhile complete pending sends
+   * and send batches of records when their deadline has passed.
+   * Workers may open a batch at any time, so with the opt-in -B we never
+   * block in MPI_Probe, but doze a quarter of the delay while idle. */
+  while (!arrived) {
+    const int delay = SNetOptBatchDelay();
+    SNetDistribTransmitFlush(true);
+    if (SNetDistribSendPoll() && send_batches == 0 && delay == 0) {
+      MPI_Probe(MPI_ANY_SOURCE, MPI_ANY_TAG, MPI_COMM_WORLD, &status);
+      arrived = true;
+    } else {
+      MPI_Iprobe(MPI_ANY_SOURCE, MPI_ANY_TAG, MPI_COMM_WORLD, &arrived, &status);
+      if (!arrived && send_batches == 0 && delay > 0) {
+        usleep((delay + 3) / 4);
+      } else if (!arrived) {
+        sched_yield();
+      }
+    }
+  }
   /* Get number of top-level elements in 'count'. */
   MPI_Get_count(&status, MPI_PACKED, &count);
   /* Find out how much space is needed for the message. */
@@ -79,8 +365,10 @@ void SNetDistribReceiveMessage(snet_mesg_t *mesg)
     buf.size = buf.offset;
   }
   /* Load the message into buf. */
+  start = SNetTraceClock();
   MPI_Recv(buf.data, count, MPI_PACKED, status.MPI_SOURCE, status.MPI_TAG,
            MPI_COMM_WORLD, &status);
+  SNetTraceMessage(false, start, status.MPI_SOURCE);
   /* Reset to beginning of message buffer. */
   buf.offset = 0;
 
@@ -102,6 +390,16 @@ void SNetDistribReceiveMessage(snet_mesg_t *mesg)
       SNetDistribReceiveRecord(mesg, &buf);
       break;
 
+    case SNET_COMM_batch:
+      memcpy(&recv_batch, buf.data, sizeof(int));
+      buf.offset = sizeof(int);
+      assert(recv_batch >= 1);
+      recv_batch -= 1;
+      recv_source = mesg->source;
+      mesg->type = SNET_COMM_record;
+      SNetDistribReceiveRecord(mesg, &buf);
+      break;
+
     case snet_ref_set:
       mesg->ref = SNetRefDeserialise(&buf, &SNetUnpackInt, &SNetUnpackByte);
       interface = SNetRefInterface(mesg->ref);
@@ -127,6 +425,7 @@ void SNetDistribReceiveMessage(snet_mesg_t *mesg)
                          __func__, SNetDistribGetNodeId(), status.MPI_TAG);
   }
 
-  SNetMemFree(buf.data);
+  /* Keep the receive buffer for the next message. */
+  recv_buf = buf;
 }
 
@@ -14,17 +14,26 @@
 static const char snet_front_help_text[] =
 "Usage: <executable name> [options...]\n"
 "The Front runtime system for S-Net supports the following options:\n"
+"\t-B <usec>\tBatch distributed records for at most <usec> microseconds (default 0).\n"
 "\t-c <spec>\tSet concurrent box invocations according to <spec>.\n"
 "\t-d \t\tEnable debugging output.\n"
+"\t-e <filename>\tExport a Chrome trace of worker activity to <filename>.\n"
+"\t-E <count>\tRetain the last <count> trace events per worker.\n"
 "\t-g \t\tDisable garbage collection of network nodes (debugging).\n"
 "\t-h \t\tDisplay this help text.\n"
 "\t-i <filename>\tRead input records from file <filename>.\n"
 "\t-I <port>\tInput records from socket at portnumber <port>.\n"
+"\t-l <count>\tMeasure the latency of every <count>th input record.\n"
+"\t-L <filename>\tWrite the latency report to <filename> instead of stderr.\n"
+"\t-m <filename>\tDump node and worker metrics to <filename> on exit.\n"
+"\t-M <seconds>\tAlso dump the metrics every <seconds> while running.\n"
 "\t-o <filename>\tOutput to the file <filename>.\n"
 "\t-O <addr:port>\tOutput to destination host <addr> and port <port>.\n"
+"\t-q \t\tSchedule work with work-stealing deques instead of lists.\n"
 "\t-r \t\tEnable dynamic control of the number of worker threads.\n"
 "\t-rs [<host:port> | <conffile>] Use distributed resource management service.\n"
 "\t-s <size(K|M)>\tSet thread stack size to <size> K or M.\n"
+"\t-S <count>\tRetire idle split instances beyond <count> per split.\n"
 "\t-t <depth>\tEnable function call tracing with call stack <depth>.\n"
 "\t-T <count>\tLimit the number of thieves to <count>.\n"
 "\t-v \t\tEnable informational messages.\n"
@@ -0,0 +1,128 @@
+#include <stdio.h>
+#include <assert.h>
+#include "debug.h"
+#include "distribcommon.h"
+#include "distribfront.h"
+#include "shm.h"
+#include "reference.h"
+#include "snetentities.h"
+
+extern const char* SNetCommName(int i);
+extern bool SNetDebugDF(void);
+
+/* Receive buffer of the input manager. */
+static shm_buf_t        recv_buf;
+
+/* Messages are copied into the ring of the destination at once. */
+void SNetDistribTransmitFlush(bool expired_only)
+{
+  (void) expired_only; /* NOT USED */
+}
+
+/* Release the receive buffer. */
+void SNetDistribTransmitDrain(void)
+{
+  if (recv_buf.data) {
+    SNetMemFree(recv_buf.data);
+    recv_buf.data = NULL;
+    recv_buf.size = 0;
+  }
+}
+
+/* Initiate a new connection. */
+void SNetDistribTransmitConnect(connect_t *connect)
+{
+  const int     num_ints = sizeof(connect_t) / sizeof(int);
+  shm_buf_t    *buf = SNetShmBufGet();
+
+  SNetPackInt(buf, num_ints, (int *) connect);
+  if (SNetDebugDF()) {
+    printf("[%s.%d]: sending %d connect bytes\n",
+           __func__, SNetDistribGetNodeId(), buf->offset);
+  }
+  SNetShmSend(connect->dest_loc, SNET_COMM_connect, buf);
+  SNetShmBufPut(buf);
+}
+
+/* Accept an incoming connection. */
+static connect_t* SNetDistribReceiveConnect(shm_buf_t *buf)
+{
+  const int     num_ints = sizeof(connect_t) / sizeof(int);
+  connect_t    *connect = SNetNew(connect_t);
+
+  SNetUnpackInt(buf, num_ints, (int *) connect);
+
+  return connect;
+}
+
+void SNetDistribTransmitRecord(snet_record_t *rec, connect_t *connect)
+{
+  shm_buf_t    *buf = SNetShmBufGet();
+
+  SNetPackInt(buf, 2, (int *) connect);
+  SNetRecSerialise(rec, buf, &SNetPackInt, &SNetPackRef);
+  if (SNetDebugDF()) {
+    printf("[%s.%d]: sending %d record bytes for type %s\n", __func__,
+           SNetDistribGetNodeId(), buf->offset, SNetRecTypeName(rec));
+  }
+  SNetShmSend(connect->dest_loc, SNET_COMM_record, buf);
+  SNetShmBufPut(buf);
+}
+
+static void SNetDistribReceiveRecord(snet_mesg_t *mesg, shm_buf_t *buf)
+{
+  int           from[2];
+
+  SNetUnpackInt(buf, 2, from);
+  assert(from[0] == mesg->source);
+  mesg->conn = from[1];
+  mesg->rec = SNetRecDeserialise(buf, &SNetUnpackInt, &SNetUnpackRef);
+}
+
+/* Accept an incoming message from the shared memory ring of this node. */
+void SNetDistribReceiveMessage(snet_mesg_t *mesg)
+{
+  int           interface;
+
+  memset(mesg, 0, sizeof(*mesg));
+  mesg->type = SNetShmRecv(&mesg->source, &recv_buf);
+  if (SNetDebugDF()) {
+    printf("[%s.%d]: received tag %s from %d\n", __func__,
+           SNetDistribGetNodeId(), SNetCommName(mesg->type), mesg->source);
+  }
+
+  switch (mesg->type) {
+
+    case SNET_COMM_connect:
+      mesg->connect = SNetDistribReceiveConnect(&recv_buf);
+      break;
+
+    case SNET_COMM_record:
+      SNetDistribReceiveRecord(mesg, &recv_buf);
+      break;
+
+    case snet_ref_set:
+      mesg->ref = SNetRefDeserialise(&recv_buf, &SNetUnpackInt, &SNetUnpackByte);
+      interface = SNetRefInterface(mesg->ref);
+      mesg->data = (uintptr_t) SNetInterfaceGet(interface)->unpackfun(&recv_buf);
+      break;
+
+    case snet_ref_fetch:
+      mesg->ref = SNetRefDeserialise(&recv_buf, &SNetUnpackInt, &SNetUnpackByte);
+      mesg->data = (uintptr_t) mesg->source;
+      break;
+
+    case snet_ref_update:
+      mesg->ref = SNetRefDeserialise(&recv_buf, &SNetUnpackInt, &SNetUnpackByte);
+      SNetUnpackInt(&recv_buf, 1, &mesg->val);
+      break;
+
+    case snet_stop:
+      mesg->type = SNET_COMM_stop;
+      break;
+
+    default:
+      SNetUtilDebugFatal("[%s.%d]: unrecognized message type %d\n",
+                         __func__, SNetDistribGetNodeId(), mesg->type);
+  }
+}
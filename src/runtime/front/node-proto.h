@@ -87,6 +87,27 @@ snet_stream_t *SNetCollectorStatic(
     bool is_det,
     node_t *peer);
 
+/* xdeque.c */
+
+
+/* Initialize an empty deque. */
+void SNetDequeInit(work_deque_t *deque);
+
+/* Free the arrays of a deque. */
+void SNetDequeDone(work_deque_t *deque);
+
+/* Owner: push an item at the bottom. */
+void SNetDequePush(work_deque_t *deque, work_item_t *item);
+
+/* Owner: pop an item from the bottom, or NULL if empty. */
+work_item_t *SNetDequePop(work_deque_t *deque);
+
+/* Thief: steal an item from the top, or NULL if empty or contended. */
+work_item_t *SNetDequeSteal(work_deque_t *deque);
+
+/* Return true iff a deque appears to be non-empty. */
+bool SNetDequeNonEmpty(work_deque_t *deque);
+
 /* xdet.c */
 
 int SNetDetGetLevel(void);
@@ -141,6 +162,9 @@ void SNetDistribStart(void);
 /* Cause dist layer to terminate. */
 void SNetDistribStop(void);
 
+/* Send pending batches of records, because a worker is out of work. */
+void SNetDistribFlush(void);
+
 /* Dummy function needed for networkinterface.c */
 snet_stream_t *SNetRouteUpdate(snet_info_t *info, snet_stream_t *in, int loc);
 void SNetRecDetrefStackSerialise(snet_record_t *rec, void *buf);
@@ -216,6 +240,9 @@ void SNetFifoDone(fifo_t *fifo);
 /* Delete a FIFO. */
 void SNetFifoDestroy(fifo_t *fifo);
 
+/* Obtain an unlinked node for an item, to be appended by SNetFifoPutTail. */
+fifo_node_t *SNetFifoNode(fifo_t *fifo, void *item);
+
 /* Append a new item at the tail of a FIFO. */
 void SNetFifoPut(fifo_t *fifo, void *item);
 
@@ -401,6 +428,18 @@ const char *SNetLandingTypeName(landing_type_t ltype);
 /* Give a string representation of the landing type */
 const char *SNetLandingName(landing_t *land);
 
+/* xlatency.c */
+
+
+/* Start the latency trace of a sampled input record. */
+void SNetLatencyStart(node_t *node, snet_record_t *rec);
+
+/* Account for the latency of a traced record which reached the output. */
+void SNetLatencyOutput(snet_record_t *rec);
+
+/* Write the latency report, if latency tracing is enabled. */
+void SNetLatencyReport(void);
+
 /* xmanager.c */
 
 
@@ -422,6 +461,33 @@ void SNetInputManagerRun(worker_t *worker);
 /* Convert a distributed communication protocol message type to a string. */
 const char* SNetCommName(int i);
 
+/* xmetrics.c */
+
+
+/* Assign a metrics index to a new node when metrics or latencies are enabled. */
+void SNetMetricsNodeNew(node_t *node);
+
+/* Lookup a node by its metrics index. */
+node_t *SNetMetricsNode(int id);
+
+/* Create the metrics of a new worker, if enabled. */
+worker_metrics_t *SNetMetricsWorkerCreate(void);
+
+/* Free the metrics of a worker. */
+void SNetMetricsWorkerDestroy(worker_metrics_t *met);
+
+/* Allocate a chunk of node counters for a worker. */
+node_metrics_t *SNetMetricsChunk(worker_metrics_t *met, int index);
+
+/* Account for the execution time of one box invocation. */
+void SNetMetricsBox(worker_t *worker, const node_t *node, uint64_t nsec);
+
+/* Open the metrics file and start periodic dumps, if enabled. */
+void SNetMetricsStart(worker_config_t *config);
+
+/* Stop periodic dumps and write the final metrics. */
+void SNetMetricsStop(void);
+
 /* xnameshift.c */
 
 
@@ -452,6 +518,9 @@ void SNetDistribStart(void);
 void SNetDistribGlobalStop(void);
 void SNetDistribWaitExit(snet_info_t *info);
 
+/* Nothing is batched for other locations. */
+void SNetDistribFlush(void);
+
 /* Needed frequently for record IDs and field references. */
 int SNetDistribGetNodeId(void);
 
@@ -533,6 +602,9 @@ void SNetObserverDestroy(void);
 /* Output a record to stdout */
 void SNetNodeOutput(snet_stream_desc_t *desc, snet_record_t *rec);
 
+/* Flush buffered output when a worker runs out of work. */
+void SNetOutputIdle(worker_t *worker);
+
 /* Terminate an output landing. */
 void SNetTermOutput(landing_t *land, fifo_t *fifo);
 
@@ -606,6 +678,9 @@ int SNetWaitForInput(int pipe, int sock, double delay);
 void SNetMasterDynamic(worker_config_t* config, int recv);
 void SNetBindLogicalProc(int proc);
 
+/* Classify how close two logical processors are in the local topology. */
+proc_distance_t SNetProcDistance(int proc, int other);
+
 /* Dynamic resource management via the resource server. */
 void SNetMasterResource(worker_config_t* config, int recv);
 
@@ -642,6 +717,9 @@ void SNetLocSplitIncrLevel(void);
 /* Decrement the indexed placement stack level by one. */
 void SNetLocSplitDecrLevel(void);
 
+/* Note the creation of a node which stores records across its input. */
+void SNetSplitAddStateful(void);
+
 /* Return the current indexed placement stack level. */
 int SNetSubnetGetLevel(void);
 
@@ -787,6 +865,16 @@ void SNetStreamWrite(snet_stream_desc_t *desc, snet_record_t *rec);
 /* Enqueue a record to a stream and add a note to the todo list. */
 void SNetWrite(snet_stream_desc_t **desc_ptr, snet_record_t *rec, bool last);
 
+/* Start a batch of writes to a stream. */
+void SNetWriteBegin(write_batch_t *batch, snet_stream_desc_t **desc_ptr);
+
+/* Add a record to a batch of writes. */
+void SNetWriteAppend(write_batch_t *batch, snet_record_t *rec);
+
+/* Publish a batch of writes. If 'last' then the caller is about to
+ * return and the first record may be processed right away. */
+void SNetWriteCommit(write_batch_t *batch, bool last);
+
 /* Dequeue a record and process it. */
 void SNetStreamWork(snet_stream_desc_t *desc, worker_t *worker);
 
@@ -900,12 +988,39 @@ bool SNetDebugWS(void);
 /* Whether to use a deterministic feedback */
 bool SNetFeedbackDeterministic(void);
 
+/* Whether to schedule work with work-stealing deques. */
+bool SNetOptDeque(void);
+
+/* The number of live instances per split beyond which idle ones retire. */
+int SNetOptSplitLimit(void);
+
+/* The deadline in microseconds for batching distributed records. */
+int SNetOptBatchDelay(void);
+
 /* Whether to use dynamic resource management. */
 bool SNetOptResource(void);
 
 /* Whether and how to connect to the resource management service. */
 const char* SNetOptResourceServer(void);
 
+/* The file to dump metrics to, if metrics are enabled. */
+const char* SNetOptMetrics(void);
+
+/* The interval in seconds between periodic metrics dumps, if positive. */
+double SNetOptMetricsInterval(void);
+
+/* Trace the latency of every so many input records, if positive. */
+int SNetOptLatency(void);
+
+/* The file to write the latency report to, or NULL for stderr. */
+const char* SNetOptLatencyFile(void);
+
+/* The file to export the event trace to, if tracing is enabled. */
+const char* SNetOptTrace(void);
+
+/* The number of recent events which each worker retains for the trace. */
+size_t SNetOptTraceSize(void);
+
 /* Whether to use optimized sync-star. */
 bool SNetZipperEnabled(void);
 
@@ -964,6 +1079,27 @@ void SNetVariantListString(snet_variant_list_t *vl, char *buf, size_t size);
 /* Convert a variant list type to a dynamically allocated string. */
 char *SNetGetVariantListString(snet_variant_list_t *vl);
 
+/* xtrace.c */
+
+
+/* Create the event ring of a new worker, if tracing is enabled. */
+trace_ring_t *SNetTraceWorkerCreate(void);
+
+/* Free the event ring of a worker. */
+void SNetTraceWorkerDestroy(trace_ring_t *ring);
+
+/* Return a time stamp for a distributed message, or 0 if not tracing. */
+uint64_t SNetTraceClock(void);
+
+/* Record the transfer of a distributed message by the current worker. */
+void SNetTraceMessage(bool send, uint64_t start, int peer);
+
+/* Remember the workers whose events will be exported at the end. */
+void SNetTraceStart(worker_config_t *config);
+
+/* Export the events of all workers as a Chrome Trace Event JSON file. */
+void SNetTraceStop(void);
+
 /* xtransfer.c */
 
 
@@ -1012,8 +1148,20 @@ void SNetWorkerDestroy(worker_t *worker);
 /* Add a new unit of work to the worker's todo list.
  * At return iterator should point to the new item.
  */
+/* Postpone wakeups for new work until SNetWorkerNotifyFlush. */
+void SNetWorkerNotifyDefer(worker_t *worker);
+
+/* Wake the input worker if it parked until more input is allowed. */
+void SNetWorkerNotifyInput(worker_t *worker);
+
+/* Issue the wakeups which were postponed by SNetWorkerNotifyDefer. */
+void SNetWorkerNotifyFlush(worker_t *worker);
+
 void SNetWorkerTodo(worker_t *worker, snet_stream_desc_t *desc);
 
+/* Add 'count' new units of work for one stream to the todo list. */
+void SNetWorkerTodoCount(worker_t *worker, snet_stream_desc_t *desc, int count);
+
 /* Steal a work item from another worker */
 void SNetWorkerStealVictim(worker_t *victim, worker_t *thief);
 
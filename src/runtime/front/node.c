@@ -117,6 +117,7 @@ node_t *SNetNodeNew(
   node->location = location;
   node->loc_split_level = SNetLocSplitGetLevel();
   node->subnet_level = SNetSubnetGetLevel();
+  SNetMetricsNodeNew(node);
 
   /* For all incoming streams: set destination to this node. */
   for (i = 0; i < num_ins; ++i) {
@@ -48,7 +48,11 @@ typedef struct snet_entity_t snet_entity_t;
 typedef struct worker worker_t;
 typedef struct landing landing_t;
 typedef struct hash_ptab hash_ptab_t;
+typedef struct node_metrics node_metrics_t;
+typedef struct worker_metrics worker_metrics_t;
+typedef struct trace_ring trace_ring_t;
 
+#include "xdeque.h"
 #include "xworker.h"
 #include "detref.h"
 
@@ -195,6 +199,15 @@ typedef struct output_arg {
   snetin_interface_t    *interfaces;
   size_t                 num_outputs;
   bool                   terminated;
+  char                  *buf;           /* collects output text */
+  size_t                 buf_len;       /* bytes in use in buf */
+  double                 flush_time;    /* time of last flush */
+  bool                   dirty;         /* output awaits a flush */
+  lock_t                 flush_lock;    /* excludes idle workers' flushes */
+  char                 **label_xml;     /* escaped labels by id */
+  int                    num_label_xml;
+  char                 **iface_xml;     /* escaped interfaces by id */
+  int                    num_iface_xml;
 } output_arg_t;
 
 /* Argument for parallel dispatcher nodes */
@@ -217,6 +230,7 @@ typedef struct split_arg {
   bool                  is_det;
   bool                  is_detsup;
   bool                  is_byloc;
+  bool                  is_stateful;    /* instances contain sync or zipper */
   snet_entity_t         *entity;
 } split_arg_t;
 
@@ -287,6 +301,7 @@ struct node {
   int                   location;
   int                   loc_split_level;
   int                   subnet_level;
+  int                   metrics_id;     /* index in the metrics tables */
   union node_types {
     box_arg_t           box;
     collector_arg_t     collector;
@@ -425,11 +440,24 @@ typedef struct landing_parallel {
   landing_detenter_t    detenter;
 } landing_parallel_t;
 
+/* A live instance of a split: the stream to the subnetwork for one index. */
+typedef struct split_inst {
+  snet_stream_desc_t   *desc;           /* stream to the instance */
+  struct split_inst    *newer;          /* more recently used instance */
+  struct split_inst    *older;          /* less recently used instance */
+  int                   index;          /* the split tag value */
+} split_inst_t;
+
 /* Node instantiation for split */
 typedef struct landing_split {
   snet_stream_desc_t   *colldesc;
   hashtab_t            *hashtab;
-  int                   split_count;
+  int                   split_count;    /* number of live instances */
+  int                   split_peak;     /* largest number of live instances */
+  split_inst_t         *newest;         /* most recently used instance */
+  split_inst_t         *oldest;         /* least recently used instance */
+  size_t                num_created;    /* instances created so far */
+  size_t                num_evicted;    /* instances retired when idle */
   landing_t            *collland;
   landing_detenter_t    detenter;
 } landing_split_t;
@@ -483,7 +511,9 @@ typedef struct landing_remote {
 typedef struct matching matching_t;
 typedef struct landing_zipper {
   snet_stream_desc_t   *outdesc;
-  matching_t           *head;
+  matching_t           *head;           /* first group of matchings */
+  struct snet_hashtable *groups;        /* groups indexed by unmatched mask */
+  unsigned long         seqnr;          /* number of matchings created */
 } landing_zipper_t;
 
 /* Node instantiation for identity */
@@ -556,6 +586,16 @@ struct snet_stream_desc_t {
   fifo_t                fifo;           /* a FIFO queue for records */
   int                   refs;           /* reference counter */
 };
+
+/* A batch of records which are appended to one stream at once. */
+typedef struct write_batch {
+  snet_stream_desc_t   *desc;           /* destination stream */
+  worker_t             *worker;         /* the writing worker */
+  fifo_node_t          *first;          /* first unpublished FIFO node */
+  fifo_node_t          *last;           /* last unpublished FIFO node */
+  int                   count;          /* number of batched records */
+} write_batch_t;
+
 #define DESC_LAND_SPEC(desc,type)       LAND_SPEC((desc)->landing, type)
 #define DESC_NODE(desc)                 ((desc)->landing->node)
 #define DESC_NODE_SPEC(desc,type)       NODE_SPEC(DESC_NODE(desc), type)
@@ -574,6 +614,15 @@ struct snet_stream_desc_t {
 #define FAS(ptr, val)           __sync_fetch_and_sub(ptr, val)
 #define BAR()                   __sync_synchronize()
 
+#if defined(__i386__) || defined(__x86_64__)
+#define PAUSE()                 __builtin_ia32_pause()
+#else
+#define PAUSE()                 BAR()
+#endif
+
+/* Number of times to spin on a held landing lock before yielding. */
+#define LANDING_SPINS   100
+
 #define CAS_LOCKING     1
 
 static inline void lock_landing(landing_t *landing, worker_t *worker)
@@ -584,7 +633,13 @@ static inline void lock_landing(landing_t *landing, worker_t *worker)
   assert(landing->worker == NULL);
   /* lock destination landing */
   while (!CAS(&landing->id, 0, worker->id)) {
-    sched_yield();
+    int spins = 0;
+    while (landing->id && ++spins < LANDING_SPINS) {
+      PAUSE();
+    }
+    if (landing->id) {
+      sched_yield();
+    }
   }
   assert(landing->id == worker->id);
   landing->worker = worker;
@@ -683,5 +738,7 @@ static inline void unlock_worker(worker_t *victim, worker_t *thief)
   } else assert(0)
 
 #include "node-proto.h"
+#include "xmetrics.h"
+#include "xtrace.h"
 
 #endif
@@ -7,6 +7,11 @@ static void SNetNodeBoxData(box_context_t *box)
 {
   box_arg_t     *barg = LAND_NODE_SPEC(box->land, box);
   snet_handle_t   hnd;
+  write_batch_t   batch;
+
+  /* Collect the output of the box function in a batch of writes. */
+  SNetWriteBegin(&batch, &box->outdesc);
+  batch.worker->write_batch = &batch;
 
   /* data record */
   hnd.rec = box->rec;
@@ -21,7 +26,20 @@ static void SNetNodeBoxData(box_context_t *box)
   /* box entity */
   hnd.ent = barg->entity;
 
-  (*barg->boxfun)( &hnd);
+  if (batch.worker->metrics || batch.worker->trace) {
+    uint64_t start = SNetMetricsClock();
+    (*barg->boxfun)( &hnd);
+    if (batch.worker->metrics) {
+      SNetMetricsBox(batch.worker, box->land->node,
+                     SNetMetricsClock() - start);
+    }
+    SNetTraceSpan(batch.worker, TraceBox, barg->boxname, start, -1);
+  } else {
+    (*barg->boxfun)( &hnd);
+  }
+
+  batch.worker->write_batch = NULL;
+  SNetWriteCommit(&batch, false);
 
   if (REC_DESCR( box->rec) == REC_data ||
       REC_DESCR( box->rec) == REC_trigger_initialiser) {
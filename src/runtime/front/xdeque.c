@@ -0,0 +1,134 @@
+/*
+ * A Chase-Lev work-stealing deque of work items.
+ *
+ * The owner pushes and pops at the bottom without atomic
+ * read-modify-write operations, except when it competes with
+ * thieves for the last item. Thieves steal from the top by
+ * a compare-and-swap on the top index. When the array is full
+ * the owner doubles it. Thieves may still be reading from an
+ * old array, therefore these are retired until the deque is done.
+ */
+
+#include "node.h"
+
+#define DEQUE_INITIAL_SIZE      64
+
+#define DEQUE_LOAD(ptr)         __atomic_load_n(ptr, __ATOMIC_RELAXED)
+#define DEQUE_STORE(ptr, val)   __atomic_store_n(ptr, val, __ATOMIC_RELAXED)
+
+/* Allocate a new array for a deque. */
+static work_deque_array_t *DequeArrayCreate(long size)
+{
+  work_deque_array_t *array = SNetMemAlloc(sizeof(work_deque_array_t) +
+                                           size * sizeof(work_item_t *));
+  array->prev = NULL;
+  array->size = size;
+  return array;
+}
+
+/* Initialize an empty deque. */
+void SNetDequeInit(work_deque_t *deque)
+{
+  deque->top = 0;
+  deque->bottom = 0;
+  deque->array = DequeArrayCreate(DEQUE_INITIAL_SIZE);
+}
+
+/* Free the arrays of a deque. */
+void SNetDequeDone(work_deque_t *deque)
+{
+  work_deque_array_t *array = deque->array;
+
+  while (array) {
+    work_deque_array_t *prev = array->prev;
+    SNetMemFree(array);
+    array = prev;
+  }
+  deque->array = NULL;
+}
+
+/* Copy the items of a full array into an array of twice its size. */
+static work_deque_array_t *DequeGrow(work_deque_t *deque, long top, long bottom)
+{
+  work_deque_array_t *old = deque->array;
+  work_deque_array_t *new = DequeArrayCreate(2 * old->size);
+  long i;
+
+  for (i = top; i < bottom; ++i) {
+    new->items[i & (new->size - 1)] = old->items[i & (old->size - 1)];
+  }
+  new->prev = old;
+  __atomic_store_n(&deque->array, new, __ATOMIC_RELEASE);
+  return new;
+}
+
+/* Owner: push an item at the bottom. */
+void SNetDequePush(work_deque_t *deque, work_item_t *item)
+{
+  long                  bottom = DEQUE_LOAD(&deque->bottom);
+  long                  top = __atomic_load_n(&deque->top, __ATOMIC_ACQUIRE);
+  work_deque_array_t   *array = deque->array;
+
+  if (bottom - top >= array->size) {
+    array = DequeGrow(deque, top, bottom);
+  }
+  DEQUE_STORE(&array->items[bottom & (array->size - 1)], item);
+  __atomic_thread_fence(__ATOMIC_RELEASE);
+  DEQUE_STORE(&deque->bottom, bottom + 1);
+}
+
+/* Owner: pop an item from the bottom, or NULL if empty. */
+work_item_t *SNetDequePop(work_deque_t *deque)
+{
+  long                  bottom = DEQUE_LOAD(&deque->bottom) - 1;
+  work_deque_array_t   *array = deque->array;
+  work_item_t          *item = NULL;
+  long                  top;
+
+  DEQUE_STORE(&deque->bottom, bottom);
+  __atomic_thread_fence(__ATOMIC_SEQ_CST);
+  top = DEQUE_LOAD(&deque->top);
+
+  if (top <= bottom) {
+    item = DEQUE_LOAD(&array->items[bottom & (array->size - 1)]);
+    if (top == bottom) {
+      /* Compete with thieves for the last item. */
+      if (!__atomic_compare_exchange_n(&deque->top, &top, top + 1, false,
+                                       __ATOMIC_SEQ_CST, __ATOMIC_RELAXED)) {
+        item = NULL;
+      }
+      DEQUE_STORE(&deque->bottom, bottom + 1);
+    }
+  } else {
+    DEQUE_STORE(&deque->bottom, bottom + 1);
+  }
+  return item;
+}
+
+/* Thief: steal an item from the top, or NULL if empty or contended. */
+work_item_t *SNetDequeSteal(work_deque_t *deque)
+{
+  long                  top = __atomic_load_n(&deque->top, __ATOMIC_ACQUIRE);
+  long                  bottom;
+  work_item_t          *item = NULL;
+
+  __atomic_thread_fence(__ATOMIC_SEQ_CST);
+  bottom = __atomic_load_n(&deque->bottom, __ATOMIC_ACQUIRE);
+
+  if (top < bottom) {
+    work_deque_array_t *array = __atomic_load_n(&deque->array,
+                                                __ATOMIC_ACQUIRE);
+    item = DEQUE_LOAD(&array->items[top & (array->size - 1)]);
+    if (!__atomic_compare_exchange_n(&deque->top, &top, top + 1, false,
+                                     __ATOMIC_SEQ_CST, __ATOMIC_RELAXED)) {
+      item = NULL;
+    }
+  }
+  return item;
+}
+
+/* Return true iff a deque appears to be non-empty. */
+bool SNetDequeNonEmpty(work_deque_t *deque)
+{
+  return DEQUE_LOAD(&deque->top) < DEQUE_LOAD(&deque->bottom);
+}
@@ -0,0 +1,22 @@
+#ifndef _XDEQUE_H
+#define _XDEQUE_H
+
+typedef struct work_deque_array work_deque_array_t;
+typedef struct work_deque work_deque_t;
+
+/* A circular array of work items for a work-stealing deque. */
+struct work_deque_array {
+  work_deque_array_t   *prev;           /* retired smaller array */
+  long                  size;           /* a power of two */
+  struct work_item     *items[];
+};
+
+/* A Chase-Lev work-stealing deque: the owner pushes and pops
+ * at the bottom, while thieves steal from the top. */
+struct work_deque {
+  long                  top __attribute__((aligned(LINE_SIZE)));
+  long                  bottom __attribute__((aligned(LINE_SIZE)));
+  work_deque_array_t   *array;
+};
+
+#endif
@@ -200,8 +200,10 @@ void SNetDetLeaveDequeue(landing_t *landing)
   landing_collector_t   *leave = LAND_SPEC(landing, collector);
   snet_record_t         *rec;
   detref_t              *detref;
+  write_batch_t          batch;
 
   trace(__func__);
+  SNetWriteBegin(&batch, &leave->outdesc);
   /* Loop over detrefs until sequence numbers don't match. */
   while ((detref = SNetFifoPeekFirst(&leave->detfifo)) != NULL) {
 
@@ -219,7 +221,7 @@ void SNetDetLeaveDequeue(landing_t *landing)
 
     /* Forward the queued records */
     while ((rec = SNetFifoGet(&detref->recfifo)) != NULL) {
-      SNetWrite(&leave->outdesc, rec, false);
+      SNetWriteAppend(&batch, rec);
     }
 
     /* Deallocate empty detref */
@@ -248,10 +250,11 @@ void SNetDetLeaveDequeue(landing_t *landing)
     {
       /* Forward the queued records */
       while ((rec = SNetFifoGet(&item->recfifo)) != NULL) {
-        SNetWrite(&leave->outdesc, rec, false);
+        SNetWriteAppend(&batch, rec);
       }
     }
   }
+  SNetWriteCommit(&batch, false);
 }
 
 /* Record leaves a deterministic network */
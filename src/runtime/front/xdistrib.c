@@ -43,6 +43,12 @@ void SNetDistribStop(void)
   SNetInputManagerStop();
 }
 
+/* Send pending batches of records, because a worker is out of work. */
+void SNetDistribFlush(void)
+{
+  SNetDistribTransmitFlush(false);
+}
+
 /* Dummy function needed for networkinterface.c */
 snet_stream_t *SNetRouteUpdate(snet_info_t *info, snet_stream_t *in, int loc)
 {
@@ -264,6 +264,7 @@ snet_stream_t *SNetDripBack(
   darg->output = output;
   darg->back_patterns = back_patterns;
   darg->guards = guards;
+  SNetExprListCompile( guards);
   darg->stopping = 0;
 
   /* Create the instance network */
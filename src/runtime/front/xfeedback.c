@@ -391,6 +391,7 @@ snet_stream_t *SNetFeedback(
   farg->output = output;
   farg->back_patterns = back_patterns;
   farg->guards = guards;
+  SNetExprListCompile( guards);
   farg->stopping = 0;
 
   /* Create the instance network */
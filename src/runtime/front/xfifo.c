@@ -7,16 +7,32 @@
  * The FIFO is implemented as a linked list with an extra
  * tail pointer. There is always at least one node at the head,
  * which has an empty data item pointer.
+ *
+ * Nodes are recycled within the FIFO: the reader only advances
+ * the head pointer and never frees a node. The writer keeps
+ * a pointer 'first' to the oldest node which is still linked
+ * in front of the head. All nodes from 'first' up to, but not
+ * including, the head have been consumed and are reused by the
+ * writer. Only when this cache is exhausted a new node is taken
+ * from the heap. In steady state a put and get therefore
+ * perform no heap allocation. The cache is bounded by the
+ * largest number of items which were ever queued at once
+ * and is released when the FIFO is cleaned up.
  */
 
 #include "node.h"
 
+/* Publish and observe the head pointer between reader and writer. */
+#define FIFO_LOAD(ptr)          __atomic_load_n(ptr, __ATOMIC_ACQUIRE)
+#define FIFO_STORE(ptr, val)    __atomic_store_n(ptr, val, __ATOMIC_RELEASE)
+
 /* Initialize FIFO with a node with an empty item pointer. */
 void SNetFifoInit(fifo_t *fifo)
 {
   fifo->head = fifo->tail = SNetNew(fifo_node_t);
   fifo->head->next = NULL;
   fifo->head->item = NULL;
+  fifo->first = fifo->head_copy = fifo->head;
 }
 
 /* Create a new FIFO */
@@ -33,8 +49,15 @@ void SNetFifoDone(fifo_t *fifo)
   assert(fifo->head == fifo->tail);
   assert(fifo->head->next == NULL);
   assert(fifo->head->item == NULL);
+  /* Release the cache of consumed nodes. */
+  while (fifo->first != fifo->head) {
+    fifo_node_t *node = fifo->first;
+    fifo->first = node->next;
+    SNetDelete(node);
+  }
   SNetDelete(fifo->head);
   fifo->head = fifo->tail = NULL;
+  fifo->first = fifo->head_copy = NULL;
 }
 
 /* Delete a FIFO. */
@@ -44,16 +67,45 @@ void SNetFifoDestroy(fifo_t *fifo)
   SNetDelete(fifo);
 }
 
+/* Obtain a node from the cache of consumed nodes or else from the heap. */
+static inline fifo_node_t *SNetFifoNewNode(fifo_t *fifo)
+{
+  fifo_node_t   *node;
+
+  if (fifo->first == fifo->head_copy) {
+    /* Refresh our view on how far the reader has progressed. */
+    fifo->head_copy = FIFO_LOAD(&fifo->head);
+  }
+  if (fifo->first != fifo->head_copy) {
+    node = fifo->first;
+    fifo->first = node->next;
+  } else {
+    node = SNetNew(fifo_node_t);
+  }
+  return node;
+}
+
+/* Obtain an unlinked node for an item, to be appended by SNetFifoPutTail. */
+fifo_node_t *SNetFifoNode(fifo_t *fifo, void *item)
+{
+  fifo_node_t   *node = SNetFifoNewNode(fifo);
+
+  assert(item);
+  node->next = NULL;
+  node->item = item;
+  return node;
+}
+
 /* Append a new item at the tail of a FIFO. */
 void SNetFifoPut(fifo_t *fifo, void *item)
 {
-  fifo_node_t   *node = SNetNew(fifo_node_t);
+  fifo_node_t   *node = SNetFifoNewNode(fifo);
   fifo_node_t   *tail = fifo->tail;
 
   assert(item);
   node->next = NULL;
   node->item = item;
-  tail->next = node;
+  FIFO_STORE(&tail->next, node);
   fifo->tail = node;
 }
 
@@ -62,12 +114,13 @@ void *SNetFifoGet(fifo_t *fifo)
 {
   void          *item = NULL;
   fifo_node_t   *head = fifo->head;
+  fifo_node_t   *next = FIFO_LOAD(&head->next);
 
-  if (head->next) {
-    item = head->next->item;
-    head->next->item = NULL;
-    fifo->head = head->next;
-    SNetDelete(head);
+  if (next) {
+    item = next->item;
+    next->item = NULL;
+    /* The old head node now becomes available to the writer. */
+    FIFO_STORE(&fifo->head, next);
     assert(item);
   }
   return item;
@@ -76,21 +129,11 @@ void *SNetFifoGet(fifo_t *fifo)
 /* A fused send/recv if caller owns both sides. */
 void *SNetFifoPutGet(fifo_t *fifo, void *item)
 {
-  fifo_node_t   *node = fifo->head;
-
   /* Preserve sequential ordering when FIFO is non-empty. */
-  if (node->next) {
-    /* Store new input item. */
-    node->item = item;
-    /* Remove node from head. */
-    fifo->head = node->next;
-    /* Retrieve new output item. */
-    item = fifo->head->item;
-    fifo->head->item = NULL;
-    /* Append node at the tail. */
-    node->next = NULL;
-    fifo->tail->next = node;
-    fifo->tail = node;
+  if (fifo->head->next) {
+    /* The node for the new item is recycled from the cache. */
+    SNetFifoPut(fifo, item);
+    item = SNetFifoGet(fifo);
   }
   return item;
 }
@@ -149,7 +192,7 @@ fifo_node_t *SNetFifoGetTail(fifo_t *fifo, fifo_node_t **tail_ptr)
 void SNetFifoPutTail(fifo_t *fifo, fifo_node_t *node, fifo_node_t *tail)
 {
   if (node) {
-    fifo->tail->next = node;
+    FIFO_STORE(&fifo->tail->next, node);
     fifo->tail = tail;
   } else {
     assert(!tail);
@@ -12,8 +12,10 @@ struct fifo_node {
 
 /* A FIFO queue */
 struct fifo {
-  fifo_node_t  *head;
-  fifo_node_t  *tail;
+  fifo_node_t  *head;           /* reader: dummy node before first item */
+  fifo_node_t  *tail;           /* writer: last node */
+  fifo_node_t  *first;          /* writer: oldest consumed node for reuse */
+  fifo_node_t  *head_copy;      /* writer: last observed value of head */
 };
 
 /* Get the first FIFO node. */
@@ -11,6 +11,7 @@ struct filter_instr {
   snet_filter_opcode_t opcode;
   int name, newName;
   snet_expr_t *expr;
+  bool move;            /* field can be taken from the input record */
 };
 
 
@@ -26,6 +27,7 @@ snet_filter_instr_t *SNetCreateFilterInstruction( snet_filter_opcode_t opcode, .
   instr->name = -1;
   instr->newName = -1;
   instr->expr = NULL;
+  instr->move = false;
 
   va_start( args, opcode);
   switch (opcode) {
@@ -35,6 +37,7 @@ snet_filter_instr_t *SNetCreateFilterInstruction( snet_filter_opcode_t opcode, .
     case snet_btag:
       instr->name = va_arg( args, int);
       instr->expr = va_arg( args, snet_expr_t*);
+      SNetExprCompile( instr->expr);
       break;
     case snet_field:
       instr->newName = va_arg( args, int);
@@ -118,6 +121,116 @@ static bool FilterIsBypass(
   return true;
 }
 
+/**
+ * Classify the field instructions of all instruction lists: a field
+ * which is consumed by the input pattern and is the source of only one
+ * instruction can be moved from the input record to the output record.
+ */
+static void FilterClassify(
+    snet_variant_t *input_variant,
+    snet_expr_list_t *guard_exprs,
+    snet_filter_instr_list_list_t **instr_lists)
+{
+  snet_filter_instr_list_t *instr_list;
+  snet_filter_instr_t   *instr, *other;
+  snet_expr_t           *expr;
+  int                    i, j, k;
+
+  LIST_ENUMERATE(guard_exprs, i, expr) {
+    LIST_FOR_EACH(instr_lists[i], instr_list) {
+      LIST_ENUMERATE(instr_list, j, instr) {
+        if (instr->opcode == snet_field) {
+          int uses = 0;
+          LIST_ENUMERATE(instr_list, k, other) {
+            if (other->opcode == snet_field && other->name == instr->name) {
+              ++uses;
+            }
+          }
+          instr->move = (uses == 1 &&
+                         SNetVariantHasField(input_variant, instr->name));
+        }
+      }
+    }
+    (void) expr; /* prevent compiler warnings */
+  }
+}
+
+/**
+ * Turn the incoming record into the output of an instruction list
+ * without allocating a new record, its label maps or its detrefs.
+ * The result is the same as a new record which is filled by the
+ * instructions followed by SNetRecFlowInherit.
+ */
+static void FilterInPlace(
+    snet_record_t *rec,
+    snet_variant_t *input_variant,
+    snet_filter_instr_list_t *instr_list)
+{
+  const int              num = SNetFilterInstrListLength(instr_list);
+  int                    vals[num + 1];
+  snet_ref_t            *refs[num + 1];
+  bool                   inherited[num + 1];
+  snet_filter_instr_t   *instr;
+  int                    i;
+
+  /* Evaluate all instructions on the incoming labels first. */
+  LIST_ENUMERATE(instr_list, i, instr) {
+    switch (instr->opcode) {
+      case snet_tag:
+      case snet_btag:
+        vals[i] = SNetEevaluateInt( instr->expr, rec);
+        break;
+      case snet_field:
+        refs[i] = instr->move ? SNetRecTakeField(rec, instr->name)
+                              : SNetRecGetField(rec, instr->name);
+        break;
+      default:
+        break;
+    }
+  }
+
+  /* What remains are the labels which flow inheritance preserves. */
+  SNetRecFlowStrip( input_variant, rec);
+
+  /* Inherited labels take precedence over instruction results. */
+  LIST_ENUMERATE(instr_list, i, instr) {
+    switch (instr->opcode) {
+      case snet_tag:
+        inherited[i] = SNetRecHasTag( rec, instr->name);
+        break;
+      case snet_field:
+        inherited[i] = SNetRecHasField( rec, instr->newName);
+        break;
+      default:
+        inherited[i] = false;
+        break;
+    }
+  }
+
+  LIST_ENUMERATE(instr_list, i, instr) {
+    switch (instr->opcode) {
+      case snet_tag:
+        if (!inherited[i]) {
+          SNetRecSetTag( rec, instr->name, vals[i]);
+        }
+        break;
+      case snet_btag:
+        SNetRecSetBTag( rec, instr->name, vals[i]);
+        break;
+      case snet_field:
+        if (!inherited[i]) {
+          SNetRecSetField( rec, instr->newName, refs[i]);
+        } else {
+          SNetRefDestroy( refs[i]);
+        }
+        break;
+      case create_record: /* NOP */
+        break;
+      default: assert(0);
+    }
+  }
+}
+
 /* Apply filter to incoming data record. Return the last outgoing record. */
 static snet_record_t *ApplyFilter(
     snet_record_t       *rec,
@@ -130,16 +243,22 @@ static snet_record_t *ApplyFilter(
   snet_filter_instr_t   *instr;
   snet_filter_instr_list_t *instr_list;
   bool                   done = false;
-  int                    i;
+  int                    i, j, num;
 
   LIST_ENUMERATE( farg->guard_exprs, i, expr) {
-    if (SNetEevaluateBool( expr, rec) && !done) {
+    if (!done && SNetEevaluateBool( expr, rec)) {
       done = true;
 
-      LIST_FOR_EACH(farg->filter_instructions[i], instr_list) {
+      num = SNetFilterInstrListListLength(farg->filter_instructions[i]);
+      LIST_ENUMERATE(farg->filter_instructions[i], j, instr_list) {
         if (out_rec != NULL) {
           SNetWrite(&land->outdesc, out_rec, false);
         }
+        if (j == num - 1) {
+          /* The last output reuses the input record. */
+          FilterInPlace(rec, farg->input_variant, instr_list);
+          return rec;
+        }
         out_rec = SNetRecCreate( REC_data);
         SNetRecSetInterfaceId( out_rec, SNetRecGetInterfaceId( rec));
         SNetRecSetDataMode( out_rec, SNetRecGetDataMode( rec));
@@ -279,6 +398,8 @@ static snet_stream_t* CreateFilter( snet_stream_t *input,
     farg->output = output;
     farg->input_variant = input_variant;
     farg->guard_exprs = guard_exprs;
+    SNetExprListCompile( guard_exprs);
+    FilterClassify(input_variant, guard_exprs, instr_list);
     farg->filter_instructions = instr_list;
     farg->entity = SNetEntityCreate( ENTITY_filter, location, SNetLocvecGet(info),
                                      "<filter>", NULL, (void*)farg);
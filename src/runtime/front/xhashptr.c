@@ -5,295 +5,291 @@
 #include "bool.h"
 #include "memfun.h"
 
-/* Calculate the number of elements in a static array. */
-#define NUM_ELEMS(x)    (sizeof(x) / sizeof((x)[0]))
-
 /* Limit a scalar to a bounded range. */
 #define LIMIT(x,l,u)    ((x) < (l) ? (l) : (x) > (u) ? (u) : (x))
 
-/* First power in the ideal primes table. */
-#define FIRST_POWER     5
+/* Smallest power of the table capacity. */
+#define FIRST_POWER     3
 
-/* Last power in the ideal primes table. */
+/* Largest power of the table capacity. */
 #define LAST_POWER      30
 
-/* Hash a pointer to a table index. */
-#define HASH_PTR(p,n)   ((hash_t) (p) % (n))
-
-/* The type of a hashed pointer. */
-typedef uintptr_t hash_t;
-
-/* Ideal primes for division hashing from planetmath.org/goodhashtableprimes */
-static struct ideal_primes {
-  size_t power;
-  size_t prime;
-} ideal_primes[] = {
-  {  5, 53 },
-  {  6, 97 },
-  {  7, 193 },
-  {  8, 389 },
-  {  9, 769 },
-  { 10, 1543 },
-  { 11, 3079 },
-  { 12, 6151 },
-  { 13, 12289 },
-  { 14, 24593 },
-  { 15, 49157 },
-  { 16, 98317 },
-  { 17, 196613 },
-  { 18, 393241 },
-  { 19, 786433 },
-  { 20, 1572869 },
-  { 21, 3145739 },
-  { 22, 6291469 },
-  { 23, 12582917 },
-  { 24, 25165843 },
-  { 25, 50331653 },
-  { 26, 100663319 },
-  { 27, 201326611 },
-  { 28, 402653189 },
-  { 29, 805306457 },
-  { 30, 1610612741 },
-};
-static const size_t num_ideal_primes = NUM_ELEMS(ideal_primes);
-
-/* A hashed node stores a keyword/value pair. */
-typedef struct hash_node {
-  struct hash_node      *next;
+/* Fibonacci hashing: multiply by 2^64 divided by the golden ratio
+ * and take the high bits, which spreads aligned addresses evenly. */
+#define HASH_GOLDEN     UINT64_C(0x9E3779B97F4A7C15)
+
+/* Hash a pointer to a table index for a capacity of 2^power. */
+#define HASH_PTR(p,power) \
+        ((size_t) (((uint64_t) (uintptr_t) (p) * HASH_GOLDEN) >> (64 - (power))))
+
+/* The number of old slots to migrate per store or remove. */
+#define MIGRATE_STEP    8
+
+/* A slot of the old table which has been migrated to the new table. */
+static char hash_moved;
+#define HASH_MOVED      ((void *) &hash_moved)
+
+/* A slot stores a keyword/value pair; an empty slot has a NULL key. */
+typedef struct hash_slot {
   void                  *key;
   void                  *val;
-} hash_node_t;
-
-/* Pointer hash table stores hash nodes and a free list.
- * The table is a big array of small lists.
- * When auto_resize is true grow table when capacity is reached. */
+} hash_slot_t;
+
+/* One table of slots with a power of two capacity. */
+typedef struct hash_array {
+  size_t                 power;
+  size_t                 mask;
+  hash_slot_t           *slots;
+} hash_array_t;
+
+/* Pointer hash table uses open addressing with linear probing.
+ * Growing is incremental: while 'old' is non-empty every store or remove
+ * migrates a few of its slots into 'cur' and lookups consult both.
+ * When auto_resize is true grow table when 75% full. */
 typedef struct hash_ptab {
-  size_t        power;
-  size_t        prime;
-  size_t        count;
-  size_t        freed;
-  bool          auto_resize;
-  hash_node_t  *free;
-  hash_node_t **tab;
+  hash_array_t           cur;
+  hash_array_t           old;
+  size_t                 migrated;
+  size_t                 count;
+  bool                   auto_resize;
 } hash_ptab_t;
 
+/* Allocate an empty table of 2^power slots. */
+static void HashArrayInit(hash_array_t *arr, size_t power)
+{
+  size_t i;
+
+  arr->power = power;
+  arr->mask = ((size_t) 1 << power) - 1;
+  arr->slots = SNetNewN(arr->mask + 1, hash_slot_t);
+  for (i = 0; i <= arr->mask; ++i) {
+    arr->slots[i].key = NULL;
+  }
+}
+
+/* Find the slot of a key, or NULL. */
+static hash_slot_t *HashArrayFind(hash_array_t *arr, void *key)
+{
+  size_t i = HASH_PTR(key, arr->power);
+
+  while (arr->slots[i].key != key) {
+    if (arr->slots[i].key == NULL) {
+      return NULL;
+    }
+    i = (i + 1) & arr->mask;
+  }
+  return &arr->slots[i];
+}
+
+/* Insert a key which is not yet present. */
+static void HashArrayInsert(hash_array_t *arr, void *key, void *val)
+{
+  size_t i = HASH_PTR(key, arr->power);
+
+  while (arr->slots[i].key != NULL) {
+    assert(arr->slots[i].key != key);
+    i = (i + 1) & arr->mask;
+  }
+  arr->slots[i].key = key;
+  arr->slots[i].val = val;
+}
+
+/* Remove a slot and shift back subsequent entries of its probe sequence. */
+static void HashArrayErase(hash_array_t *arr, hash_slot_t *slot)
+{
+  size_t hole = slot - arr->slots;
+  size_t i = hole;
+
+  for (;;) {
+    size_t home;
+    i = (i + 1) & arr->mask;
+    if (arr->slots[i].key == NULL) {
+      break;
+    }
+    /* An entry can fill the hole if its home is not within (hole, i]. */
+    home = HASH_PTR(arr->slots[i].key, arr->power);
+    if (((i - home) & arr->mask) >= ((i - hole) & arr->mask)) {
+      arr->slots[hole] = arr->slots[i];
+      hole = i;
+    }
+  }
+  arr->slots[hole].key = NULL;
+}
+
+/* Migrate up to 'step' slots from the old table to the current table. */
+static void HashPtrMigrate(hash_ptab_t *tab, size_t step)
+{
+  hash_array_t *old = &tab->old;
+
+  while (old->slots && step-- > 0) {
+    hash_slot_t *slot = &old->slots[tab->migrated];
+    if (slot->key != NULL && slot->key != HASH_MOVED) {
+      HashArrayInsert(&tab->cur, slot->key, slot->val);
+      slot->key = HASH_MOVED;
+    }
+    if (++tab->migrated > old->mask) {
+      SNetDeleteN(old->mask + 1, old->slots);
+      old->slots = NULL;
+      tab->migrated = 0;
+    }
+  }
+}
+
+/* Find the slot of a key in either table, or NULL. */
+static hash_slot_t *HashPtrFind(hash_ptab_t *tab, void *key)
+{
+  hash_slot_t *slot = HashArrayFind(&tab->cur, key);
+
+  if (slot == NULL && tab->old.slots) {
+    slot = HashArrayFind(&tab->old, key);
+  }
+  return slot;
+}
+
 /* Create a new hash table for pointer hashing of 2^power size. */
 struct hash_ptab* SNetHashPtrTabCreate(size_t power, bool auto_resize)
 {
-  size_t        prime;
-  hash_ptab_t  *tab;
-  size_t        i;
-
-  power = LIMIT(power, FIRST_POWER, LAST_POWER);
-  prime = ideal_primes[power - FIRST_POWER].prime;
-  tab = SNetNew(hash_ptab_t);
-  tab->tab = SNetNewN(prime, hash_node_t *);
+  hash_ptab_t  *tab = SNetNew(hash_ptab_t);
 
-  tab->power = power;
-  tab->prime = prime;
+  HashArrayInit(&tab->cur, LIMIT(power, FIRST_POWER, LAST_POWER));
+  tab->old.slots = NULL;
+  tab->migrated = 0;
   tab->count = 0;
-  tab->freed = 0;
   tab->auto_resize = auto_resize;
-  tab->free = NULL;
-  for (i = 0; i < prime; ++i) {
-    tab->tab[i] = NULL;
-  }
   return tab;
 }
 
 /* Destroy a hash table for pointer lookup. */
 void SNetHashPtrTabDestroy(struct hash_ptab *tab)
 {
-  size_t        i;
-  hash_node_t   *node, *next;
-
-  /* Loop over table. */
-  for (i = 0; i < tab->prime; ++i) {
-    /* Destroy each list. */
-    for (node = tab->tab[i]; node; node = next) {
-      next = node->next;
-      SNetDelete(node);
-    }
+  if (tab->old.slots) {
+    SNetDeleteN(tab->old.mask + 1, tab->old.slots);
   }
-  /* Destroy free list. */
-  for (node = tab->free; node; node = next) {
-    next = node->next;
-    SNetDelete(node);
-  }
-  SNetDelete(tab->tab);
+  SNetDeleteN(tab->cur.mask + 1, tab->cur.slots);
   SNetDelete(tab);
 }
 
-/* Resize a pointer hash table to a new power size. */
+/* Resize a pointer hash table to a new power size at once. */
 void SNetHashPtrTabResize(struct hash_ptab *tab, size_t new_power)
 {
   new_power = LIMIT(new_power, FIRST_POWER, LAST_POWER);
 
-  if (new_power != tab->power) {
-    /* Allocate a new table. */
-    size_t new_prime = ideal_primes[new_power - FIRST_POWER].prime;
-    hash_node_t **new_tab = SNetNewN(new_prime, hash_node_t *);
-    size_t i;
-    for (i = 0; i < new_prime; ++i) {
-      new_tab[i] = NULL;
-    }
-    /* Loop over old table and rehash nodes into the new table. */
-    for (i = 0; i < tab->prime; ++i) {
-      hash_node_t   *node, *next;
-      for (node = tab->tab[i]; node; node = next) {
-        hash_t hash = HASH_PTR(node->key, new_prime);
-        next = node->next;
-        node->next = new_tab[hash];
-        new_tab[hash] = node;
-      }
-    }
-    /* Delete old table. */
-    SNetDeleteN(tab->prime, tab->tab);
-    /* Store new configuration into table. */
-    tab->tab = new_tab;
-    tab->prime = new_prime;
-    tab->power = new_power;
+  /* Complete a pending incremental resize first. */
+  HashPtrMigrate(tab, SIZE_MAX);
+
+  if (new_power != tab->cur.power &&
+      tab->count < ((size_t) 1 << new_power) - ((size_t) 1 << new_power) / 4)
+  {
+    tab->old = tab->cur;
+    tab->migrated = 0;
+    HashArrayInit(&tab->cur, new_power);
+    HashPtrMigrate(tab, SIZE_MAX);
   }
 }
 
-void *SNetHashPtrLookup(struct hash_ptab *tab, void *key);
-
 /* Store a pointer + value pair into a pointer hashing table. */
 void SNetHashPtrStore(struct hash_ptab *tab, void *key, void *val)
 {
-  hash_t        hash = HASH_PTR(key, tab->prime);
-  hash_node_t  *node;
-
-  assert(tab->tab[hash] == NULL || tab->tab[hash]->key != key);
-  
-  /* Obtain a new or unused node. */
-  if (tab->free) {
-    node = tab->free;
-    tab->free = node->next;
-    --tab->freed;
-  } else {
-    node = SNetNew(hash_node_t);
+  const size_t capacity = tab->cur.mask + 1;
+
+  assert(key != NULL && key != HASH_MOVED);
+  assert(HashPtrFind(tab, key) == NULL);
+
+  HashPtrMigrate(tab, MIGRATE_STEP);
+
+  /* Start growing when 75% full, or when completely full. */
+  if (4 * (tab->count + 1) > 3 * capacity &&
+      (tab->auto_resize || tab->count + 1 >= capacity) &&
+      tab->old.slots == NULL && tab->cur.power < LAST_POWER)
+  {
+    tab->old = tab->cur;
+    tab->migrated = 0;
+    HashArrayInit(&tab->cur, tab->old.power + 1);
+    HashPtrMigrate(tab, MIGRATE_STEP);
   }
 
-  /* Store keyword/value and add to table. */
-  node->key = key;
-  node->val = val;
-  node->next = tab->tab[hash];
-  tab->tab[hash] = node;
+  HashArrayInsert(&tab->cur, key, val);
   ++tab->count;
-
-  /* Resize when capacity is reached. */
-  if (tab->auto_resize && tab->count > (2 << tab->power)) {
-    SNetHashPtrTabResize(tab, 3 + tab->power);
-  }
 }
 
 /* Lookup a value in the pointer hashing table. */
 void *SNetHashPtrLookup(struct hash_ptab *tab, void *key)
 {
-  hash_t        hash = HASH_PTR(key, tab->prime);
-  hash_node_t  *node;
-
-  for (node = tab->tab[hash]; node; node = node->next) {
-    if (node->key == key) {
-      return node->val;
-    }
-  }
-  return NULL;
+  hash_slot_t *slot = HashPtrFind(tab, key);
+  return slot ? slot->val : NULL;
 }
 
 /* Remove a value from the pointer hashing table. */
 void *SNetHashPtrRemove(struct hash_ptab *tab, void *key)
 {
-  hash_t         hash = HASH_PTR(key, tab->prime);
-  hash_node_t   *node = tab->tab[hash];
-  hash_node_t   *prev = NULL;
+  hash_slot_t   *slot;
   void          *val = NULL;
 
-  /* Lookup node which stores keyword. */
-  while (node && node->key != key) {
-    prev = node;
-    node = node->next;
+  if ((slot = HashArrayFind(&tab->cur, key)) != NULL) {
+    val = slot->val;
+    HashArrayErase(&tab->cur, slot);
+    --tab->count;
   }
-  /* Remove node from table. */
-  if (node) {
-    val = node->val;
-    if (prev) {
-      prev->next = node->next;
-    } else {
-      tab->tab[hash] = node->next;
-    }
-    node->next = tab->free;
-    tab->free = node;
-    ++tab->freed;
+  else if (tab->old.slots && (slot = HashArrayFind(&tab->old, key)) != NULL) {
+    /* Keep probe sequences in the old table intact. */
+    val = slot->val;
+    slot->key = HASH_MOVED;
     --tab->count;
-
-    /* Retain between 12% and 25% of free items. */
-    if (4 * tab->freed > tab->prime) {
-      size_t limit = tab->prime / 8;
-      while (tab->free && tab->freed > limit) {
-        node = tab->free;
-        tab->free = node->next;
-        SNetDelete(node);
-        --tab->freed;
-      }
-    }
-  } else {
+  }
+  else {
     assert(false);
   }
+  HashPtrMigrate(tab, MIGRATE_STEP);
   return val;
 }
 
 /* Verify whether the table has zero elements. */
 bool SNetHashPtrTabEmpty(struct hash_ptab *tab)
 {
-  bool empty = true;
+  return tab->count == 0;
+}
+
+/* Return the key of the first used slot at or after 'pos' in the
+ * current table and then in the old table. */
+static void *HashPtrScan(struct hash_ptab *tab, size_t pos, bool in_old)
+{
   size_t i;
-  for (i = 0; i < tab->prime; ++i) {
-    if (tab->tab[i]) {
-      empty = false;
-      break;
+
+  if (!in_old) {
+    for (i = pos; i <= tab->cur.mask; ++i) {
+      if (tab->cur.slots[i].key) {
+        return tab->cur.slots[i].key;
+      }
+    }
+    pos = 0;
+  }
+  if (tab->old.slots) {
+    for (i = pos; i <= tab->old.mask; ++i) {
+      void *key = tab->old.slots[i].key;
+      if (key && key != HASH_MOVED) {
+        return key;
+      }
     }
   }
-  return empty;
+  return NULL;
 }
 
 /* Return the first key in the hash table. */
 void *SNetHashPtrFirst(struct hash_ptab *tab)
 {
-  void *first = NULL;
-  size_t i;
-  for (i = 0; i < tab->prime; ++i) {
-    if (tab->tab[i]) {
-      first = tab->tab[i]->key;
-      break;
-    }
-  }
-  return first;
+  return HashPtrScan(tab, 0, false);
 }
 
 /* Return the next key in the hash table after 'key'. */
 void *SNetHashPtrNext(struct hash_ptab *tab, void *key)
 {
-  hash_t        hash = HASH_PTR(key, tab->prime);
-  hash_node_t  *node = tab->tab[hash];
-  size_t        i;
-  void         *next = NULL;
+  hash_slot_t *slot = HashArrayFind(&tab->cur, key);
 
-  while (node && node->key != key) {
-    node = node->next;
-  }
-  assert(node);
-  if (node->next) {
-    next = node->next->key;
-  } else {
-    for (i = 1 + (size_t) hash; i < tab->prime; ++i) {
-      if (tab->tab[i]) {
-        next = tab->tab[i]->key;
-        break;
-      }
-    }
+  if (slot) {
+    return HashPtrScan(tab, 1 + (slot - tab->cur.slots), false);
   }
-  return next;
+  slot = HashArrayFind(&tab->old, key);
+  assert(slot);
+  return HashPtrScan(tab, 1 + (slot - tab->old.slots), true);
 }
 
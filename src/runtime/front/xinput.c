@@ -26,6 +26,10 @@ input_state_t SNetGetNextInputRecord(landing_t *land)
         SNetRecDestroy(record);
         iarg->state = INPUT_terminating;
       } else {
+        if (SNetOptLatency() &&
+            linp->num_inputs % SNetOptLatency() == 0) {
+          SNetLatencyStart(land->node, record);
+        }
         linp->num_inputs += 1;
         SNetWrite(&linp->outdesc, record, false);
         return INPUT_reading;
@@ -337,6 +337,11 @@ void SNetNewSplitLanding(snet_stream_desc_t *desc, snet_stream_desc_t *prev)
   lsplit->colldesc = NULL;
   lsplit->hashtab = HashtabCreate(4);
   lsplit->split_count = 0;
+  lsplit->split_peak = 0;
+  lsplit->newest = NULL;
+  lsplit->oldest = NULL;
+  lsplit->num_created = 0;
+  lsplit->num_evicted = 0;
   /* Create landing for future collector node */
   lsplit->collland = NewCollectorLanding(STREAM_DEST(nsplit->collector),
                                          prev, desc->landing);
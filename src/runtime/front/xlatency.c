@@ -0,0 +1,172 @@
+#include <string.h>
+#include <stdlib.h>
+#include "node.h"
+
+/* The time which sampled records spent from arriving at a node
+ * until they arrived at the next node on their path. */
+typedef struct latency_hop {
+  size_t                count;
+  uint64_t              sum;
+  uint64_t              max;
+} latency_hop_t;
+
+/* The number of input records which were sampled. */
+static size_t           latency_started;
+
+/* The end-to-end latencies of all traced records which reached the output.
+ * These are only updated by the output node, which is never concurrent. */
+static uint64_t        *latency_samples;
+static size_t           latency_num_samples;
+static size_t           latency_max_samples;
+
+/* Per node hop latencies, indexed by the metrics_id of the nodes. */
+static latency_hop_t   *latency_hops;
+static int              latency_num_hops;
+
+/* Start the latency trace of a sampled input record. */
+void SNetLatencyStart(node_t *node, snet_record_t *rec)
+{
+  const uint64_t now = SNetMetricsClock();
+
+  SNetRecTraceStart(rec, now);
+  SNetRecTraceHop(rec, node->metrics_id, now);
+  ++latency_started;
+}
+
+/* Return the hop latencies of a node. */
+static latency_hop_t *LatencyHop(int id)
+{
+  if (id >= latency_num_hops) {
+    int size = (2 * latency_num_hops > id) ? 2 * latency_num_hops : id + 1;
+    latency_hops = SNetMemResize(latency_hops, size * sizeof(latency_hop_t));
+    memset(latency_hops + latency_num_hops, 0,
+           (size - latency_num_hops) * sizeof(latency_hop_t));
+    latency_num_hops = size;
+  }
+  return &latency_hops[id];
+}
+
+/* Account for the latency of a traced record which reached the output. */
+void SNetLatencyOutput(snet_record_t *rec)
+{
+  const snet_record_trace_t *trace = DATA_REC(rec, trace);
+  const uint64_t             now = SNetMetricsClock();
+  int                        i;
+
+  if (latency_num_samples == latency_max_samples) {
+    latency_max_samples = latency_max_samples ? 2 * latency_max_samples : 1024;
+    latency_samples = SNetMemResize(latency_samples,
+                                    latency_max_samples * sizeof(uint64_t));
+  }
+  latency_samples[latency_num_samples++] = now - trace->start;
+
+  /* Attribute the time between successive hops to the earlier node. */
+  for (i = 0; i < trace->num_hops; ++i) {
+    const uint64_t next = (i + 1 < trace->num_hops)
+                        ? trace->hops[i + 1].time : now;
+    const uint64_t span = next - trace->hops[i].time;
+
+    if (trace->hops[i].node >= 0) {
+      latency_hop_t *hop = LatencyHop(trace->hops[i].node);
+      hop->count += 1;
+      hop->sum += span;
+      if (span > hop->max) {
+        hop->max = span;
+      }
+    }
+  }
+}
+
+/* Compare two latencies for sorting. */
+static int LatencyCompare(const void *p, const void *q)
+{
+  const uint64_t a = *(const uint64_t *) p;
+  const uint64_t b = *(const uint64_t *) q;
+
+  return (a > b) - (a < b);
+}
+
+/* Return a percentile of the sorted latencies in microseconds. */
+static double LatencyPercentile(double fraction)
+{
+  return latency_samples[(size_t) (fraction * (latency_num_samples - 1))] * 1e-3;
+}
+
+/* Write the latency report, if latency tracing is enabled. */
+void SNetLatencyReport(void)
+{
+  const char   *name = SNetOptLatencyFile();
+  FILE         *fp = stderr;
+  size_t        hist[METRICS_HIST_SIZE];
+  uint64_t      sum = 0;
+  size_t        i;
+  int           id, b, count = 0;
+
+  if (SNetOptLatency() == 0) {
+    return;
+  }
+  if (name && (fp = fopen(name, "w")) == NULL) {
+    SNetUtilDebugFatal("[%s]: Cannot open latency file %s: %s",
+                       __func__, name, strerror(errno));
+  }
+
+  /* Bucket 'b' counts the latencies of less than 2^b microseconds. */
+  memset(hist, 0, sizeof(hist));
+  for (i = 0; i < latency_num_samples; ++i) {
+    uint64_t usec = latency_samples[i] / 1000;
+    b = 0;
+    while (usec > 0 && b < METRICS_HIST_SIZE - 1) {
+      usec >>= 1;
+      ++b;
+    }
+    hist[b] += 1;
+    sum += latency_samples[i];
+  }
+  qsort(latency_samples, latency_num_samples, sizeof(uint64_t),
+        LatencyCompare);
+
+  fprintf(fp, "{\"location\":%d,\"sampled\":%zu,\"completed\":%zu",
+          SNetDistribGetNodeId(), latency_started, latency_num_samples);
+  if (latency_num_samples > 0) {
+    fprintf(fp, ",\"min_usec\":%.3f,\"mean_usec\":%.3f,\"p50_usec\":%.3f,"
+            "\"p90_usec\":%.3f,\"p99_usec\":%.3f,\"max_usec\":%.3f",
+            latency_samples[0] * 1e-3, sum * 1e-3 / latency_num_samples,
+            LatencyPercentile(0.50), LatencyPercentile(0.90),
+            LatencyPercentile(0.99),
+            latency_samples[latency_num_samples - 1] * 1e-3);
+  }
+  fputs(",\"hist_usec\":[", fp);
+  for (b = 0; b < METRICS_HIST_SIZE; ++b) {
+    fprintf(fp, "%s%zu", b ? "," : "", hist[b]);
+  }
+  fputs("],\"hops\":[", fp);
+  for (id = 0; id < latency_num_hops; ++id) {
+    const latency_hop_t *hop = &latency_hops[id];
+    node_t *node = SNetMetricsNode(id);
+
+    if (hop->count == 0 || node == NULL) {
+      continue;
+    }
+    fprintf(fp, "%s{\"id\":%d,\"type\":\"%s\"", count++ ? "," : "",
+            id, SNetNodeName(node));
+    if (NODE_TYPE(node) == NODE_box) {
+      fprintf(fp, ",\"box\":\"%s\"", NODE_SPEC(node, box)->boxname);
+    }
+    fprintf(fp, ",\"count\":%zu,\"mean_usec\":%.3f,\"max_usec\":%.3f}",
+            hop->count, hop->sum * 1e-3 / hop->count, hop->max * 1e-3);
+  }
+  fputs("]}\n", fp);
+
+  if (fp == stderr) {
+    fflush(fp);
+  } else {
+    fclose(fp);
+  }
+  SNetMemFree(latency_samples);
+  SNetMemFree(latency_hops);
+  latency_samples = NULL;
+  latency_num_samples = latency_max_samples = 0;
+  latency_hops = NULL;
+  latency_num_hops = 0;
+  latency_started = 0;
+}
@@ -289,6 +289,7 @@ void SNetInputManagerRun(worker_t *worker)
   while (SNetInputManagerDoTask(worker) == true) {
     SNetWorkerMaintenaince(worker);
   }
+  SNetDistribTransmitDrain();
   SNetDistribStop();
   SNetWorkerWait(worker);
 }
@@ -302,6 +303,7 @@ const char* SNetCommName(int i)
   return COMM(SNET_COMM_connect)
          COMM(SNET_COMM_stop)
          COMM(SNET_COMM_record)
+         COMM(SNET_COMM_batch)
          COMM(snet_ref_set)
          COMM(snet_ref_fetch)
          COMM(snet_ref_update)
@@ -0,0 +1,262 @@
+#include <string.h>
+#include <limits.h>
+#include <pthread.h>
+#include "node.h"
+#include "debugtime.h"
+
+/* All measured network nodes, indexed by their metrics_id. */
+static node_t         **metrics_nodes;
+static int              metrics_num_nodes;
+static int              metrics_max_nodes;
+static pthread_mutex_t  metrics_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/* The destination of the dumps and the workers to report on. */
+static FILE            *metrics_file;
+static worker_config_t *metrics_config;
+static double           metrics_start;
+
+/* The thread which dumps periodically while the network runs. */
+static pthread_t        metrics_thread;
+static pthread_cond_t   metrics_cond = PTHREAD_COND_INITIALIZER;
+static bool             metrics_running;
+
+/* Assign a metrics index to a new node when metrics or latencies are enabled. */
+void SNetMetricsNodeNew(node_t *node)
+{
+  node->metrics_id = -1;
+  if (SNetOptMetrics() || SNetOptLatency()) {
+    pthread_mutex_lock(&metrics_lock);
+    if (metrics_num_nodes == metrics_max_nodes) {
+      metrics_max_nodes = metrics_max_nodes ? 2 * metrics_max_nodes : 64;
+      metrics_nodes = SNetMemResize(metrics_nodes,
+                                    metrics_max_nodes * sizeof(node_t *));
+    }
+    node->metrics_id = metrics_num_nodes;
+    metrics_nodes[metrics_num_nodes++] = node;
+    pthread_mutex_unlock(&metrics_lock);
+  }
+}
+
+/* Lookup a node by its metrics index. */
+node_t *SNetMetricsNode(int id)
+{
+  node_t *node = NULL;
+
+  pthread_mutex_lock(&metrics_lock);
+  if (id >= 0 && id < metrics_num_nodes) {
+    node = metrics_nodes[id];
+  }
+  pthread_mutex_unlock(&metrics_lock);
+  return node;
+}
+
+/* Create the metrics of a new worker, if enabled. */
+worker_metrics_t *SNetMetricsWorkerCreate(void)
+{
+  worker_metrics_t *met = NULL;
+
+  if (SNetOptMetrics()) {
+    met = SNetNewAlign(worker_metrics_t);
+    memset(met, 0, sizeof(*met));
+  }
+  return met;
+}
+
+/* Free the metrics of a worker. */
+void SNetMetricsWorkerDestroy(worker_metrics_t *met)
+{
+  int i;
+
+  if (met) {
+    for (i = 0; i < METRICS_CHUNKS; ++i) {
+      SNetMemFree(met->chunks[i]);
+    }
+    SNetDelete(met);
+  }
+}
+
+/* Allocate a chunk of node counters for a worker. */
+node_metrics_t *SNetMetricsChunk(worker_metrics_t *met, int index)
+{
+  node_metrics_t *chunk = SNetNewN(METRICS_CHUNK_SIZE, node_metrics_t);
+
+  memset(chunk, 0, METRICS_CHUNK_SIZE * sizeof(node_metrics_t));
+  /* A concurrent dump must see the zeroes before the chunk. */
+  BAR();
+  met->chunks[index] = chunk;
+  return chunk;
+}
+
+/* Account for the execution time of one box invocation. */
+void SNetMetricsBox(worker_t *worker, const node_t *node, uint64_t nsec)
+{
+  node_metrics_t *slot = SNetMetricsSlot(worker->metrics, node);
+  uint64_t        usec = nsec / 1000;
+  int             bucket = 0;
+
+  if (slot) {
+    while (usec > 0 && bucket < METRICS_HIST_SIZE - 1) {
+      usec >>= 1;
+      ++bucket;
+    }
+    slot->box_calls += 1;
+    slot->box_nsec += nsec;
+    slot->box_hist[bucket] += 1;
+  }
+}
+
+/* Write the counters of all workers as one JSON object on a single line. */
+static void MetricsDump(bool final)
+{
+  worker_config_t *config = metrics_config;
+  FILE            *fp = metrics_file;
+  node_metrics_t   sum;
+  int              id, n, b, count = 0;
+
+  fprintf(fp, "{\"location\":%d,\"time\":%.6f,\"final\":%s,\"workers\":[",
+          SNetDistribGetNodeId(), SNetRealTime() - metrics_start,
+          final ? "true" : "false");
+  for (id = 1; id <= config->worker_count; ++id) {
+    worker_t *worker = config->workers[id];
+    if (worker && worker->metrics) {
+      fprintf(fp, "%s{\"id\":%d,\"role\":\"%s\","
+              "\"steals\":[%zu,%zu,%zu,%zu],\"parks\":%zu,\"unparks\":%zu,"
+              "\"notifies\":%zu,\"park_sec\":%.6f}",
+              count++ ? "," : "", id,
+              worker->role == DataWorker ? "data" : "manager",
+              worker->num_steals[ProcSameCore],
+              worker->num_steals[ProcSameCache],
+              worker->num_steals[ProcSameNuma],
+              worker->num_steals[ProcRemote],
+              worker->num_parks, worker->num_unparks, worker->num_notifies,
+              worker->metrics->park_nsec * 1e-9);
+    }
+  }
+  fputs("],\"nodes\":[", fp);
+
+  pthread_mutex_lock(&metrics_lock);
+  count = 0;
+  for (n = 0; n < metrics_num_nodes; ++n) {
+    node_t *node = metrics_nodes[n];
+
+    /* Aggregate the counters of all workers for this node. */
+    memset(&sum, 0, sizeof(sum));
+    for (id = 1; id <= config->worker_count; ++id) {
+      worker_t *worker = config->workers[id];
+      node_metrics_t *chunk;
+      if (worker && worker->metrics &&
+          (chunk = worker->metrics->chunks[n / METRICS_CHUNK_SIZE]) != NULL)
+      {
+        node_metrics_t *slot = &chunk[n % METRICS_CHUNK_SIZE];
+        sum.recs_in += slot->recs_in;
+        sum.recs_out += slot->recs_out;
+        if (slot->depth_max > sum.depth_max) {
+          sum.depth_max = slot->depth_max;
+        }
+        sum.box_calls += slot->box_calls;
+        sum.box_nsec += slot->box_nsec;
+        for (b = 0; b < METRICS_HIST_SIZE; ++b) {
+          sum.box_hist[b] += slot->box_hist[b];
+        }
+      }
+    }
+    if (sum.recs_in == 0 && sum.recs_out == 0) {
+      continue;
+    }
+
+    fprintf(fp, "%s{\"id\":%d,\"type\":\"%s\",\"location\":%d,"
+            "\"recs_in\":%zu,\"recs_out\":%zu,\"depth_max\":%d",
+            count++ ? "," : "", n, SNetNodeName(node), node->location,
+            sum.recs_in, sum.recs_out, sum.depth_max);
+    if (NODE_TYPE(node) == NODE_box) {
+      fprintf(fp, ",\"box\":\"%s\",\"box_calls\":%zu,\"box_sec\":%.6f,"
+              "\"box_hist_usec\":[", NODE_SPEC(node, box)->boxname,
+              sum.box_calls, sum.box_nsec * 1e-9);
+      for (b = 0; b < METRICS_HIST_SIZE; ++b) {
+        fprintf(fp, "%s%zu", b ? "," : "", sum.box_hist[b]);
+      }
+      fputc(']', fp);
+    }
+    fputc('}', fp);
+  }
+  pthread_mutex_unlock(&metrics_lock);
+
+  fputs("]}\n", fp);
+  fflush(fp);
+}
+
+/* Dump the metrics at every interval until the network stops. */
+static void *MetricsThread(void *arg)
+{
+  const double    interval = SNetOptMetricsInterval();
+  struct timespec ts;
+  double          when = SNetRealTime();
+
+  (void) arg; /* NOT USED */
+  pthread_mutex_lock(&metrics_lock);
+  while (metrics_running) {
+    when += interval;
+    ts.tv_sec = (time_t) when;
+    ts.tv_nsec = (long) ((when - ts.tv_sec) * 1e9);
+    pthread_cond_timedwait(&metrics_cond, &metrics_lock, &ts);
+    if (metrics_running) {
+      pthread_mutex_unlock(&metrics_lock);
+      MetricsDump(false);
+      pthread_mutex_lock(&metrics_lock);
+    }
+  }
+  pthread_mutex_unlock(&metrics_lock);
+  return NULL;
+}
+
+/* Open the metrics file and start periodic dumps, if enabled. */
+void SNetMetricsStart(worker_config_t *config)
+{
+  const char *name = SNetOptMetrics();
+  char        buf[PATH_MAX];
+
+  if (name == NULL) {
+    return;
+  }
+  /* Every location of a distributed network writes its own file. */
+  if (SNetDistribIsDistributed()) {
+    snprintf(buf, sizeof(buf), "%s.%d", name, SNetDistribGetNodeId());
+    name = buf;
+  }
+  if ((metrics_file = fopen(name, "w")) == NULL) {
+    SNetUtilDebugFatal("[%s]: Cannot open metrics file %s: %s",
+                       __func__, name, strerror(errno));
+  }
+  metrics_config = config;
+  metrics_start = SNetRealTime();
+
+  if (SNetOptMetricsInterval() > 0) {
+    metrics_running = true;
+    if (pthread_create(&metrics_thread, NULL, MetricsThread, NULL)) {
+      SNetUtilDebugFatal("[%s]: Failed to create a new thread.", __func__);
+    }
+  }
+}
+
+/* Stop periodic dumps and write the final metrics. */
+void SNetMetricsStop(void)
+{
+  if (metrics_running) {
+    pthread_mutex_lock(&metrics_lock);
+    metrics_running = false;
+    pthread_cond_signal(&metrics_cond);
+    pthread_mutex_unlock(&metrics_lock);
+    pthread_join(metrics_thread, NULL);
+  }
+  if (metrics_file) {
+    MetricsDump(true);
+    fclose(metrics_file);
+    metrics_file = NULL;
+    metrics_config = NULL;
+  }
+
+  SNetMemFree(metrics_nodes);
+  metrics_nodes = NULL;
+  metrics_num_nodes = 0;
+  metrics_max_nodes = 0;
+}
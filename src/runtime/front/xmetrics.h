@@ -0,0 +1,101 @@
+#ifndef _XMETRICS_H
+#define _XMETRICS_H
+
+#include <stdint.h>
+#include <time.h>
+
+/* Number of buckets in a histogram of box execution times:
+ * bucket 'b' counts the invocations which took less than 2^b microseconds,
+ * while the last bucket also holds everything which took longer. */
+#define METRICS_HIST_SIZE       24
+
+/* Per worker node counters are allocated in chunks of this many nodes. */
+#define METRICS_CHUNK_SIZE      256
+
+/* The maximum number of chunks, which limits the number of nodes measured. */
+#define METRICS_CHUNKS          1024
+
+/* The counters which one worker keeps for one network node. */
+struct node_metrics {
+  size_t                recs_in;        /* records processed by the node */
+  size_t                recs_out;       /* records written by the node */
+  int                   depth_max;      /* largest backlog of an input stream */
+  size_t                box_calls;      /* number of box function invocations */
+  uint64_t              box_nsec;       /* total execution time of the box */
+  size_t                box_hist[METRICS_HIST_SIZE];
+};
+
+/* The metrics of one worker. Only the owning worker updates them,
+ * while a dump may read them concurrently without locking. */
+struct worker_metrics {
+  node_metrics_t       *chunks[METRICS_CHUNKS];
+  uint64_t              park_nsec;      /* total time spent parked */
+};
+
+/* A monotonic time stamp in nanoseconds. */
+static inline uint64_t SNetMetricsClock(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t) ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+/* Locate the counters of a worker for a node. */
+static inline node_metrics_t *SNetMetricsSlot(worker_metrics_t *met,
+                                              const node_t *node)
+{
+  const int id = node->metrics_id;
+  node_metrics_t *chunk;
+
+  if (id < 0 || id >= METRICS_CHUNKS * METRICS_CHUNK_SIZE) {
+    return NULL;
+  }
+  if ((chunk = met->chunks[id / METRICS_CHUNK_SIZE]) == NULL) {
+    chunk = SNetMetricsChunk(met, id / METRICS_CHUNK_SIZE);
+  }
+  return &chunk[id % METRICS_CHUNK_SIZE];
+}
+
+/* Count a record which is processed by a node. */
+static inline void SNetMetricsRecIn(worker_t *worker, const node_t *node)
+{
+  node_metrics_t *slot;
+
+  if (worker->metrics && (slot = SNetMetricsSlot(worker->metrics, node))) {
+    slot->recs_in += 1;
+  }
+}
+
+/* Count records which are written by a node. */
+static inline void SNetMetricsRecOut(worker_t *worker, const node_t *node,
+                                     int count)
+{
+  node_metrics_t *slot;
+
+  if (worker->metrics && (slot = SNetMetricsSlot(worker->metrics, node))) {
+    slot->recs_out += count;
+  }
+}
+
+/* Remember the largest backlog of a stream towards a node. */
+static inline void SNetMetricsDepth(worker_t *worker, const node_t *node,
+                                    int depth)
+{
+  node_metrics_t *slot;
+
+  if (worker->metrics && (slot = SNetMetricsSlot(worker->metrics, node))) {
+    if (depth > slot->depth_max) {
+      slot->depth_max = depth;
+    }
+  }
+}
+
+/* Stamp a sampled record with the time at which it reaches a node. */
+static inline void SNetMetricsHop(const node_t *node, snet_record_t *rec)
+{
+  if (REC_DESCR(rec) == REC_data && DATA_REC(rec, trace)) {
+    SNetRecTraceHop(rec, node->metrics_id, SNetMetricsClock());
+  }
+}
+
+#endif
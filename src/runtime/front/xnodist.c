@@ -28,6 +28,11 @@ void SNetDistribWaitExit(snet_info_t *info)
   hello(__func__);
 }
 
+/* Nothing is batched for other locations. */
+void SNetDistribFlush(void)
+{
+}
+
 /* Needed frequently for record IDs and field references. */
 int SNetDistribGetNodeId(void)
 {
@@ -329,6 +329,7 @@ static node_t *FindObserver(const char *filename, struct sockaddr_in *addr)
     node->work = SNetNodeObserver2;
     node->stop = SNetStopObserver2;
     node->term = SNetTermObserver2;
+    SNetMetricsNodeNew(node);
 
     /* Make sure observer has enough room within the node union: */
     switch (true) {
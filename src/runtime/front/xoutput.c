@@ -1,38 +1,174 @@
+#include <string.h>
 #include "node.h"
+#include "debugtime.h"
 #include "interface_functions.h"
 
+/* Size of the buffer which collects the output text. */
+#define OUTPUT_BUF_SIZE         (64 * 1024)
+
+/* Flush the output file when this many seconds have passed. */
+#define OUTPUT_FLUSH_DELAY      0.1
+
+/* Write the buffered output text to the output file. */
+static void OutputDrain(output_arg_t *hnd)
+{
+  if (hnd->buf_len > 0) {
+    fwrite(hnd->buf, 1, hnd->buf_len, hnd->file);
+    hnd->buf_len = 0;
+  }
+}
+
+/* Write all buffered output to its destination. */
+static void OutputFlush(output_arg_t *hnd)
+{
+  OutputDrain(hnd);
+  fflush(hnd->file);
+  hnd->flush_time = SNetRealTime();
+  hnd->dirty = false;
+}
+
+/* Append text to the output buffer. */
+static void OutputPut(output_arg_t *hnd, const char *str, size_t len)
+{
+  if (hnd->buf_len + len > OUTPUT_BUF_SIZE) {
+    OutputDrain(hnd);
+    if (len >= OUTPUT_BUF_SIZE) {
+      fwrite(str, 1, len, hnd->file);
+      return;
+    }
+  }
+  memcpy(hnd->buf + hnd->buf_len, str, len);
+  hnd->buf_len += len;
+}
+
+/* Append a string constant to the output buffer. */
+#define OUTPUT_LIT(hnd, lit)    OutputPut(hnd, lit, sizeof(lit) - 1)
+
+/* Append a string to the output buffer. */
+static void OutputStr(output_arg_t *hnd, const char *str)
+{
+  OutputPut(hnd, str, strlen(str));
+}
+
+/* Append a decimal integer to the output buffer. */
+static void OutputInt(output_arg_t *hnd, int val)
+{
+  char          digits[16];
+  char         *p = digits + sizeof(digits);
+  unsigned      u = (val < 0) ? 0u - (unsigned) val : (unsigned) val;
+
+  do {
+    *--p = '0' + u % 10;
+    u /= 10;
+  } while (u);
+  if (val < 0) {
+    *--p = '-';
+  }
+  OutputPut(hnd, p, digits + sizeof(digits) - p);
+}
+
+/* Copy a string with XML special characters replaced by entities. */
+static char *OutputEscape(const char *str)
+{
+  char         *esc = SNetMemAlloc(6 * strlen(str) + 1);
+  char         *p = esc;
+
+  for (; *str; ++str) {
+    switch (*str) {
+      case '&': p = stpcpy(p, "&amp;"); break;
+      case '<': p = stpcpy(p, "&lt;"); break;
+      case '>': p = stpcpy(p, "&gt;"); break;
+      case '"': p = stpcpy(p, "&quot;"); break;
+      case '\'': p = stpcpy(p, "&apos;"); break;
+      default: *p++ = *str; break;
+    }
+  }
+  *p = '\0';
+  return esc;
+}
+
+/* Return the slot for an identifier in a cache of strings. */
+static char **OutputSlot(char ***cache, int *num, int id)
+{
+  if (id >= *num) {
+    int size = (2 * *num > id) ? 2 * *num : id + 1;
+    *cache = SNetMemResize(*cache, size * sizeof(char *));
+    memset(*cache + *num, 0, (size - *num) * sizeof(char *));
+    *num = size;
+  }
+  return &(*cache)[id];
+}
+
+/* Return the escaped label of a name, which is looked up only once. */
+static const char *OutputLabel(output_arg_t *hnd, int name)
+{
+  char        **slot, *label;
+
+  if (name < 0) {
+    return NULL;
+  }
+  slot = OutputSlot(&hnd->label_xml, &hnd->num_label_xml, name);
+  if (*slot == NULL && (label = SNetInIdToLabel(hnd->labels, name)) != NULL) {
+    *slot = OutputEscape(label);
+    SNetMemFree(label);
+  }
+  return *slot;
+}
+
+/* Return the escaped name of an interface, which is looked up only once. */
+static const char *OutputInterface(output_arg_t *hnd, int id)
+{
+  char        **slot, *interface;
+
+  if (id < 0) {
+    return NULL;
+  }
+  slot = OutputSlot(&hnd->iface_xml, &hnd->num_iface_xml, id);
+  if (*slot == NULL &&
+      (interface = SNetInIdToInterface(hnd->interfaces, id)) != NULL)
+  {
+    *slot = OutputEscape(interface);
+    SNetMemFree(interface);
+  }
+  return *slot;
+}
 
 /* This function prints records to stdout */
 static void printRec(snet_record_t *rec, output_arg_t *hnd)
 {
   snet_ref_t *field;
   int name, val;
-  char *label = NULL;
-  char *interface = NULL;
+  const char *label = NULL;
+  const char *interface = NULL;
   snet_record_mode_t mode;
 
   if (++hnd->num_outputs == 1) {
-    fprintf(hnd->file, "<?xml version=\"1.0\" encoding=\"ISO-8859-1\" ?>\n\n");
+    OUTPUT_LIT(hnd, "<?xml version=\"1.0\" encoding=\"ISO-8859-1\" ?>\n\n");
   }
 
   switch (REC_DESCR(rec)) {
     case REC_data:
       mode = SNetRecGetDataMode(rec);
       if (mode == MODE_textual) {
-        fprintf(hnd->file, "<record xmlns=\"snet-home.org\" type=\"data\" mode=\"textual\" >\n");
+        OUTPUT_LIT(hnd, "<record xmlns=\"snet-home.org\" type=\"data\" mode=\"textual\" >\n");
       } else {
-        fprintf(hnd->file, "<record xmlns=\"snet-home.org\" type=\"data\" mode=\"binary\" >\n");
+        OUTPUT_LIT(hnd, "<record xmlns=\"snet-home.org\" type=\"data\" mode=\"binary\" >\n");
       }
 
       /* Fields */
       RECORD_FOR_EACH_FIELD(rec, name, field) {
         int id = SNetRecGetInterfaceId(rec);
 
-        if ((label = SNetInIdToLabel(hnd->labels, name)) != NULL){
-          if ((interface = SNetInIdToInterface(hnd->interfaces, id)) != NULL) {
-            fprintf(hnd->file, "<field label=\"%s\" interface=\"%s\">", label,
-                    interface);
+        if ((label = OutputLabel(hnd, name)) != NULL){
+          if ((interface = OutputInterface(hnd, id)) != NULL) {
+            OUTPUT_LIT(hnd, "<field label=\"");
+            OutputStr(hnd, label);
+            OUTPUT_LIT(hnd, "\" interface=\"");
+            OutputStr(hnd, interface);
+            OUTPUT_LIT(hnd, "\">");
 
+            /* The interface writes to the file directly. */
+            OutputDrain(hnd);
             if (mode == MODE_textual) {
               SNetInterfaceGet(id)->serialisefun(hnd->file,
                                                  SNetRefGetData(field));
@@ -41,11 +177,8 @@ static void printRec(snet_record_t *rec, output_arg_t *hnd)
                                               SNetRefGetData(field));
             }
 
-            fprintf(hnd->file, "</field>\n");
-            SNetMemFree(interface);
+            OUTPUT_LIT(hnd, "</field>\n");
           }
-
-          SNetMemFree(label);
         } else{
           SNetUtilDebugFatal("Unknown field %d at output!", name);
         }
@@ -54,13 +187,15 @@ static void printRec(snet_record_t *rec, output_arg_t *hnd)
        /* Tags */
       int unknown_tag = 0;
       RECORD_FOR_EACH_TAG(rec, name, val) {
-        if ((label = SNetInIdToLabel(hnd->labels, name)) != NULL) {
-          fprintf(hnd->file, "<tag label=\"%s\">%d</tag>\n", label, val);
+        if ((label = OutputLabel(hnd, name)) != NULL) {
+          OUTPUT_LIT(hnd, "<tag label=\"");
+          OutputStr(hnd, label);
+          OUTPUT_LIT(hnd, "\">");
+          OutputInt(hnd, val);
+          OUTPUT_LIT(hnd, "</tag>\n");
         } else{
           unknown_tag = name;
         }
-
-        SNetMemFree(label);
       }
       if (unknown_tag) {
           SNetUtilDebugFatal("Unknown tag %d at output!", unknown_tag);
@@ -68,29 +203,35 @@ static void printRec(snet_record_t *rec, output_arg_t *hnd)
 
       /* BTags */
       RECORD_FOR_EACH_BTAG(rec, name, val) {
-        if ((label = SNetInIdToLabel(hnd->labels, name)) != NULL){
-          fprintf(hnd->file, "<btag label=\"%s\">%d</btag>\n", label, val);
+        if ((label = OutputLabel(hnd, name)) != NULL){
+          OUTPUT_LIT(hnd, "<btag label=\"");
+          OutputStr(hnd, label);
+          OUTPUT_LIT(hnd, "\">");
+          OutputInt(hnd, val);
+          OUTPUT_LIT(hnd, "</btag>\n");
         } else{
           SNetUtilDebugFatal("Unknown binding tag %d at output!", name);
         }
-
-        SNetMemFree(label);
       }
 
-      fprintf(hnd->file, "</record>\n");
+      OUTPUT_LIT(hnd, "</record>\n\n");
+      hnd->dirty = true;
+      /* Flush on a full buffer or when the delay has passed,
+       * otherwise the first worker to go idle flushes. */
+      if (SNetRealTime() - hnd->flush_time >= OUTPUT_FLUSH_DELAY) {
+        OutputFlush(hnd);
+      }
       break;
 
     case REC_terminate:
-      fprintf(hnd->file, "<record type=\"terminate\" />\n");
+      OUTPUT_LIT(hnd, "<record type=\"terminate\" />\n\n");
+      OutputFlush(hnd);
       if (SNetDistribIsRootNode()) SNetDistribGlobalStop();
       break;
 
     default:
       SNetRecUnknown(__func__, rec);
   }
-
-  fprintf(hnd->file, "\n");
-  fflush(hnd->file);
 }
 
 /* Output a record to stdout */
@@ -101,8 +242,17 @@ void SNetNodeOutput(snet_stream_desc_t *desc, snet_record_t *rec)
   trace(__func__);
   switch (REC_DESCR(rec)) {
     case REC_data:
+      if (DATA_REC(rec, trace)) {
+        SNetLatencyOutput(rec);
+      }
+      LOCK(out->flush_lock);
       printRec(rec, out);
+      UNLOCK(out->flush_lock);
       SNetRecDestroy(rec);
+      /* More output may allow more input. */
+      if (SNetInputThrottle()) {
+        SNetWorkerNotifyInput(desc->landing->worker);
+      }
       break;
 
     case REC_sync:
@@ -114,13 +264,31 @@ void SNetNodeOutput(snet_stream_desc_t *desc, snet_record_t *rec)
   }
 }
 
+/* Flush buffered output when a worker runs out of work. */
+void SNetOutputIdle(worker_t *worker)
+{
+  node_t        *node = worker->config->output_node;
+  output_arg_t  *out;
+
+  if (node && (out = NODE_SPEC(node, output))->dirty &&
+      TRYLOCK(out->flush_lock) == 0)
+  {
+    if (out->dirty) {
+      OutputFlush(out);
+    }
+    UNLOCK(out->flush_lock);
+  }
+}
+
 /* Terminate an output landing. */
 void SNetTermOutput(landing_t *land, fifo_t *fifo)
 {
   snet_record_t *rec = SNetRecCreate(REC_terminate);
 
   trace(__func__);
+  LOCK(NODE_SPEC(land->node, output)->flush_lock);
   printRec(rec, NODE_SPEC(land->node, output));
+  UNLOCK(NODE_SPEC(land->node, output)->flush_lock);
   NODE_SPEC(land->node, output)->terminated = true;
   SNetRecDestroy(rec);
   SNetFreeLanding(land);
@@ -129,7 +297,21 @@ void SNetTermOutput(landing_t *land, fifo_t *fifo)
 /* Destroy an output node. */
 void SNetStopOutput(node_t *node, fifo_t *fifo)
 {
+  output_arg_t *out = NODE_SPEC(node, output);
+  int i;
+
   trace(__func__);
+  OutputFlush(out);
+  for (i = 0; i < out->num_label_xml; ++i) {
+    SNetMemFree(out->label_xml[i]);
+  }
+  for (i = 0; i < out->num_iface_xml; ++i) {
+    SNetMemFree(out->iface_xml[i]);
+  }
+  SNetMemFree(out->label_xml);
+  SNetMemFree(out->iface_xml);
+  SNetMemFree(out->buf);
+  LOCK_DESTROY(out->flush_lock);
   SNetDelete(node);
 }
 
@@ -151,5 +333,14 @@ void SNetInOutputInit(FILE *file,
   out->interfaces = interfaces;
   out->num_outputs = 0;
   out->terminated = false;
+  out->buf = SNetMemAlloc(OUTPUT_BUF_SIZE);
+  out->buf_len = 0;
+  out->flush_time = SNetRealTime();
+  out->dirty = false;
+  LOCK_INIT(out->flush_lock);
+  out->label_xml = NULL;
+  out->num_label_xml = 0;
+  out->iface_xml = NULL;
+  out->num_iface_xml = 0;
 }
 
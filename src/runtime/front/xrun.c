@@ -8,6 +8,7 @@
 #if ENABLE_RESSERV
 #include "resdefs.h"
 #include "resconf.h"
+#include "restopo.h"
 #endif
 
 #define WAIT_FOREVER    (-1.0)
@@ -53,6 +54,10 @@ worker_config_t* SNetCreateWorkerConfig(
   } else {
     LOCK_INIT(config->idle_lock);
   }
+  config->park_count = 0;
+  config->park_epoch = 0;
+  config->input_parked = false;
+  config->bind_epoch = 0;
   config->pipe_send = pipe_send;
   config->input_node = input->from;
   config->output_node = output->dest;
@@ -196,6 +201,11 @@ void SNetMasterStartOne(int id, worker_config_t* config, int proc)
     config->workers[id]->is_idle = WorkerBusy;
   }
   SNetThreadCreate(SNetNodeThreadStart, config->workers[id], proc);
+  if (proc >= 0) {
+    /* Publish the new binding before thieves re-order their victims. */
+    BAR();
+    AAF(&config->bind_epoch, 1);
+  }
 }
 
 /* Return a bitmask of 1/2/3 when input is available within a given delay. */
@@ -312,6 +322,32 @@ void SNetBindLogicalProc(int proc)
 #endif
 }
 
+/* Classify how close two logical processors are in the local topology. */
+proc_distance_t SNetProcDistance(int proc, int other)
+{
+#if ENABLE_RESSERV
+  host_t *host = res_local_host();
+
+  if (host && proc >= 0 && proc < host->nprocs &&
+      other >= 0 && other < host->nprocs)
+  {
+    const core_t *core = host->procs[proc]->core;
+    const core_t *peer = host->procs[other]->core;
+
+    if (core == peer) {
+      return ProcSameCore;
+    }
+    if (core->cache == peer->cache) {
+      return ProcSameCache;
+    }
+    if (core->cache->numa == peer->cache->numa) {
+      return ProcSameNuma;
+    }
+  }
+#endif
+  return ProcRemote;
+}
+
 /* Dynamic resource management via the resource server. */
 void SNetMasterResource(worker_config_t* config, int recv)
 {
@@ -515,6 +551,9 @@ void SNetNodeRun(snet_stream_t *input, snet_info_t *info, snet_stream_t *output)
     worker_config_t* config =
       SNetCreateWorkerConfig(total_workers, max_worker, fildes[1], input, output);
 
+    SNetMetricsStart(config);
+    SNetTraceStart(config);
+
     /* Create managers with new threads. */
     for (mg = 1; mg <= num_managers; ++mg) {
       int id = mg + num_workers;
@@ -534,6 +573,10 @@ void SNetNodeRun(snet_stream_t *input, snet_info_t *info, snet_stream_t *output)
       SNetMasterStatic(num_workers, num_managers, config, fildes[0]);
     }
 
+    SNetLatencyReport();
+    SNetMetricsStop();
+    SNetTraceStop();
+
     close(fildes[0]);
     close(fildes[1]);
     SNetDestroyWorkerConfig(config, max_worker);
@@ -2,6 +2,63 @@
 
 enum { WriteCollector = -1 };
 
+/* How many of the least recently used instances to inspect for eviction. */
+#define SPLIT_EVICT_SCAN        8
+
+/* Unlink an instance from the list of instances in LRU order. */
+static void SplitInstUnlink(landing_split_t *land, split_inst_t *inst)
+{
+  if (inst->newer) {
+    inst->newer->older = inst->older;
+  } else {
+    land->newest = inst->older;
+  }
+  if (inst->older) {
+    inst->older->newer = inst->newer;
+  } else {
+    land->oldest = inst->newer;
+  }
+}
+
+/* Make an instance the most recently used one. */
+static void SplitInstLink(landing_split_t *land, split_inst_t *inst)
+{
+  inst->newer = NULL;
+  inst->older = land->newest;
+  if (land->newest) {
+    land->newest->newer = inst;
+  } else {
+    land->oldest = inst;
+  }
+  land->newest = inst;
+}
+
+/* Retire least recently used instances which have drained until at most
+ * 'limit' remain. An instance has drained when the split holds the only
+ * reference to its stream: no records are queued or being processed.
+ * Records which are deeper inside the instance keep their own references,
+ * and so do detrefs, hence dropping ours terminates the instance safely.
+ * Instances which contain synchro-cells or zippers are never retired,
+ * because these may still store records for a later match. */
+static void SplitEvict(landing_split_t *land, int limit)
+{
+  split_inst_t  *inst = land->oldest;
+  int            scan = SPLIT_EVICT_SCAN;
+
+  while (inst && land->split_count > limit && scan-- > 0) {
+    split_inst_t *newer = inst->newer;
+    if (inst->desc->refs == 1 && inst->desc->landing->id == 0) {
+      HashtabRemove(land->hashtab, inst->index);
+      SplitInstUnlink(land, inst);
+      SNetDescDone(inst->desc);
+      SNetDelete(inst);
+      land->split_count--;
+      land->num_evicted++;
+    }
+    inst = newer;
+  }
+}
+
 /* Write a record to a stream which may have to be opened first. */
 static void SplitWrite(
     int idx,
@@ -11,7 +68,7 @@ static void SplitWrite(
 {
   const split_arg_t     *sarg = DESC_NODE_SPEC(desc, split);
   landing_split_t       *land = DESC_LAND_SPEC(desc, split);
-  snet_stream_desc_t    *instdesc;
+  split_inst_t          *inst;
 
   if (idx == WriteCollector) {
     if (land->colldesc == NULL) {
@@ -23,8 +80,15 @@ static void SplitWrite(
     SNetWrite(&land->colldesc, rec, last);
   } else {
     /* Write to an instance: look for an existing connection. */
-    void **inst_ptr = HashtabGetPointer( land->hashtab, idx);
-    if (inst_ptr == NULL) {
+    inst = HashtabGet( land->hashtab, idx);
+    if (inst == NULL) {
+      const int limit = SNetOptSplitLimit();
+      /* Make room by retiring drained instances; not for indexed placement,
+       * nor when instances may store records for a later match. */
+      if (limit > 0 && land->split_count >= limit &&
+          !sarg->is_byloc && !sarg->is_stateful) {
+        SplitEvict(land, limit - 1);
+      }
       /* Make sure the collector landing is on top. */
       if (SNetTopLanding(desc) != land->collland) {
         SNetPushLanding(desc, land->collland);
@@ -35,18 +99,22 @@ static void SplitWrite(
         desc->landing->dyn_locs[DESC_NODE(desc)->loc_split_level - 1] = idx;
       }
       /* Connect via a stream to the subnetwork. */
-      instdesc = SNetStreamOpen( sarg->instance, desc);
+      inst = SNetNew(split_inst_t);
+      inst->desc = SNetStreamOpen( sarg->instance, desc);
+      inst->index = idx;
       /* Remember the connection for future use. */
-      HashtabPut( land->hashtab, idx, instdesc);
+      HashtabPut( land->hashtab, idx, inst);
       /* Count the number of outgoing connections. */
-      land->split_count++;
-      /* This is tricky because we pass a pointer to a local variable,
-       * but the first write after open cannot be garbage collected. */
-      SNetWrite(&instdesc, rec, last);
+      land->num_created++;
+      if (++land->split_count > land->split_peak) {
+        land->split_peak = land->split_count;
+      }
     } else {
       /* Reuse an existing connection. */
-      SNetWrite((snet_stream_desc_t **) inst_ptr, rec, last);
+      SplitInstUnlink(land, inst);
     }
+    SplitInstLink(land, inst);
+    SNetWrite(&inst->desc, rec, last);
   }
 }
 
@@ -69,12 +137,17 @@ void SNetNodeSplit(snet_stream_desc_t *desc, snet_record_t *rec)
       ltag_val = SNetRecGetTag( rec, sarg->ltag);
       utag_val = SNetRecGetTag( rec, sarg->utag);
 
+      /* Wake up idle workers once for all instances. */
+      SNetWorkerNotifyDefer(desc->landing->worker);
+
       /* for all tag values */
       for (i = ltag_val; i <= utag_val; i++) {
         /* copy record for all but the last tag value */
         bool last = (i == utag_val);
         SplitWrite( i, last ? rec : SNetRecCopy(rec), desc, last);
       }
+
+      SNetWorkerNotifyFlush(desc->landing->worker);
       break;
 
     case REC_detref:
@@ -95,22 +168,26 @@ void SNetNodeSplit(snet_stream_desc_t *desc, snet_record_t *rec)
 void SNetTermSplit(landing_t *land, fifo_t *fifo)
 {
   landing_split_t       *lsplit = LAND_SPEC(land, split);
-  hashtab_iter_t        *iter;
-  snet_stream_desc_t    *desc;
+  split_inst_t          *inst;
 
   trace(__func__);
 
-  if (lsplit->split_count > 0) {
-    /* Loop over all open instances */
-    iter = HashtabIterCreate(lsplit->hashtab);
-    while ((desc = HashtabIterNext(iter)) != NULL) {
-      SNetFifoPut(fifo, desc);
-    }
-    HashtabIterDestroy(iter);
+  if (SNetVerbose() && lsplit->num_evicted > 0) {
+    printf("split: %zu instances created, %zu retired, %d live at most\n",
+           lsplit->num_created, lsplit->num_evicted, lsplit->split_peak);
+  }
 
-    if (lsplit->colldesc) {
-      SNetFifoPut(fifo, lsplit->colldesc);
-    }
+  /* Loop over all open instances */
+  while ((inst = lsplit->newest) != NULL) {
+    lsplit->newest = inst->older;
+    SNetFifoPut(fifo, inst->desc);
+    SNetDelete(inst);
+  }
+  lsplit->oldest = NULL;
+  lsplit->split_count = 0;
+
+  if (lsplit->colldesc) {
+    SNetFifoPut(fifo, lsplit->colldesc);
   }
 
   SNetLandingDone(lsplit->collland);
@@ -159,6 +236,16 @@ void SNetLocSplitDecrLevel(void)
   assert(snet_loc_split_level >= 0);
 }
 
+/* Count the created nodes which store records, like synchro-cells. */
+static int snet_stateful_count;
+
+/* Note the creation of a node which stores records across its input. */
+void SNetSplitAddStateful(void)
+{
+  trace(__func__);
+  ++snet_stateful_count;
+}
+
 /* Keep track of the nesting level of combinator subnetworks. */
 static int snet_subnet_level;
 
@@ -206,6 +293,7 @@ snet_stream_t *CreateSplit(
   node_t        *node;
   split_arg_t   *sarg;
   snet_locvec_t *locvec;
+  int            stateful;
 
   locvec = SNetLocvecGet(info);
   SNetLocvecSplitEnter(locvec);
@@ -234,7 +322,9 @@ snet_stream_t *CreateSplit(
   /* create replica */
   sarg->instance = SNetNodeStreamCreate(node);
   SNetSubnetIncrLevel();
+  stateful = snet_stateful_count;
   instout = (*box_a)(sarg->instance, info, is_byloc ? LOCATION_UNKNOWN : location);
+  sarg->is_stateful = (snet_stateful_count > stateful);
   SNetSubnetDecrLevel();
   SNetCollectorAddStream(STREAM_DEST(sarg->collector), instout);
 
@@ -223,6 +223,7 @@ static snet_stream_t *CreateStar(
   sarg->collector = output;
   sarg->exit_patterns = exit_patterns;
   sarg->guards = guards;
+  SNetExprListCompile( guards);
   sarg->is_incarnate = is_incarnate;
   sarg->is_det = is_det;
   sarg->is_detsup = (SNetDetGetLevel() > 0);
@@ -1,6 +1,9 @@
 #include <stdlib.h>
 #include "node.h"
 
+/* Publish a write batch when it holds this many records. */
+#define WRITE_BATCH_MAX         64
+
 /* Allocate a new stream */
 snet_stream_t *SNetStreamCreate(int capacity)
 {
@@ -32,10 +35,18 @@ void *SNetStreamRead(snet_stream_desc_t *sd)
 /* Enqueue a record to a stream and add a note to the todo list. */
 void SNetStreamWrite(snet_stream_desc_t *desc, snet_record_t *rec)
 {
-  DESC_INCR(desc);
-  SNetFifoPut(&desc->fifo, rec);
-  assert(desc->source->worker);
-  SNetWorkerTodo(desc->source->worker, desc);
+  worker_t *worker = desc->source->worker;
+
+  assert(worker);
+  if (worker->write_batch && worker->write_batch->desc == desc) {
+    SNetWriteAppend(worker->write_batch, rec);
+  } else {
+    int depth = DESC_INCR(desc);
+    SNetMetricsRecOut(worker, desc->source->node, 1);
+    SNetMetricsDepth(worker, DESC_NODE(desc), depth);
+    SNetFifoPut(&desc->fifo, rec);
+    SNetWorkerTodo(worker, desc);
+  }
 }
 
 /* Merge a stream to an identity landing with the subsequent stream. */
@@ -93,6 +104,9 @@ void SNetWrite(snet_stream_desc_t **desc_ptr, snet_record_t *rec, bool last)
   snet_stream_desc_t    *desc = *desc_ptr;
   landing_t             *land = desc->landing;
   worker_t              *worker = desc->source->worker;
+  int                    depth;
+
+  SNetMetricsRecOut(worker, desc->source->node, 1);
 
   /* Test if we can garbage collect this stream together with its landing. */
   if (land->type == LAND_identity && trylock_landing(land, worker)) {
@@ -101,7 +115,8 @@ void SNetWrite(snet_stream_desc_t **desc_ptr, snet_record_t *rec, bool last)
   }
 
   /* Increase the reference count to the destination stream. */
-  DESC_INCR(desc);
+  depth = DESC_INCR(desc);
+  SNetMetricsDepth(worker, land->node, depth);
 
   /* If this write was the last statement in the caller function and we can
    * lock the destination landing then process the record right away. */
@@ -119,6 +134,94 @@ void SNetWrite(snet_stream_desc_t **desc_ptr, snet_record_t *rec, bool last)
   }
 }
 
+/* Start a batch of writes to a stream. */
+void SNetWriteBegin(write_batch_t *batch, snet_stream_desc_t **desc_ptr)
+{
+  snet_stream_desc_t    *desc = *desc_ptr;
+  landing_t             *land = desc->landing;
+  worker_t              *worker = desc->source->worker;
+
+  /* Test if we can garbage collect this stream together with its landing. */
+  if (land->type == LAND_identity && trylock_landing(land, worker)) {
+    desc = SNetMergeStreams(desc_ptr);
+  }
+
+  batch->desc = desc;
+  batch->worker = worker;
+  batch->first = NULL;
+  batch->last = NULL;
+  batch->count = 0;
+
+  /* Wake up idle workers only once for all new work. */
+  SNetWorkerNotifyDefer(worker);
+}
+
+/* Publish all batched records with a single update of the FIFO,
+ * of the reference count and of the todo list. */
+static void SNetWriteFlush(write_batch_t *batch)
+{
+  if (batch->count > 0) {
+    snet_stream_desc_t *desc = batch->desc;
+    int depth = AAF(&(desc->refs), batch->count);
+
+    SNetMetricsDepth(batch->worker, DESC_NODE(desc), depth);
+    SNetFifoPutTail(&desc->fifo, batch->first, batch->last);
+    SNetWorkerTodoCount(batch->worker, desc, batch->count);
+    batch->first = NULL;
+    batch->last = NULL;
+    batch->count = 0;
+  }
+}
+
+/* Add a record to a batch of writes. */
+void SNetWriteAppend(write_batch_t *batch, snet_record_t *rec)
+{
+  fifo_node_t *node = SNetFifoNode(&batch->desc->fifo, rec);
+
+  SNetMetricsRecOut(batch->worker, batch->desc->source->node, 1);
+
+  if (batch->last) {
+    batch->last->next = node;
+  } else {
+    batch->first = node;
+  }
+  batch->last = node;
+
+  /* Don't let downstream nodes wait too long for long batches. */
+  if (++batch->count >= WRITE_BATCH_MAX) {
+    SNetWriteFlush(batch);
+  }
+}
+
+/* Publish a batch of writes. If 'last' then the caller is about to
+ * return and the first record may be processed right away. */
+void SNetWriteCommit(write_batch_t *batch, bool last)
+{
+  snet_stream_desc_t    *desc = batch->desc;
+  landing_t             *land = desc->landing;
+  worker_t              *worker = batch->worker;
+
+  if (last && batch->count > 0 && land->id == 0 &&
+      trylock_landing(land, worker))
+  {
+    SNetMetricsDepth(worker, land->node, AAF(&(desc->refs), batch->count));
+    SNetFifoPutTail(&desc->fifo, batch->first, batch->last);
+    /* Make sure we process records in stream FIFO order. */
+    worker->continue_rec = (snet_record_t *) SNetFifoGet(&desc->fifo);
+    assert(worker->continue_rec);
+    worker->continue_desc = desc;
+    if (batch->count > 1) {
+      SNetWorkerTodoCount(worker, desc, batch->count - 1);
+    }
+    batch->first = NULL;
+    batch->last = NULL;
+    batch->count = 0;
+  } else {
+    SNetWriteFlush(batch);
+  }
+  SNetWorkerNotifyFlush(worker);
+}
+
 /* Dequeue a record and process it. */
 void SNetStreamWork(snet_stream_desc_t *desc, worker_t *worker)
 {
@@ -131,6 +234,8 @@ void SNetStreamWork(snet_stream_desc_t *desc, worker_t *worker)
   }
 
   worker->continue_desc = NULL;
+  SNetMetricsRecIn(worker, land->node);
+  SNetMetricsHop(land->node, rec);
   (*land->node->work)(desc, rec);
   if (land->type != LAND_box && land->id == worker->id) {
     unlock_landing(land);
@@ -148,6 +253,8 @@ void SNetStreamWork(snet_stream_desc_t *desc, worker_t *worker)
     }
 
     worker->continue_desc = NULL;
+    SNetMetricsRecIn(worker, land->node);
+    SNetMetricsHop(land->node, rec);
     (*land->node->work)(desc, rec);
     if (land->type != LAND_box && land->id == worker->id) {
       unlock_landing(land);
@@ -369,6 +476,8 @@ snet_stream_desc_t *SNetStreamOpen(
       desc->landing = SNetNewLanding(STREAM_DEST(stream), prev, LAND_zipper);
       DESC_LAND_SPEC(desc, zipper)->outdesc = NULL;
       DESC_LAND_SPEC(desc, zipper)->head = NULL;
+      DESC_LAND_SPEC(desc, zipper)->groups = NULL;
+      DESC_LAND_SPEC(desc, zipper)->seqnr = 0;
       break;
 
     case NODE_observer:
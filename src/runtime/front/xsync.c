@@ -300,9 +300,11 @@ snet_stream_t *SNetSync(
   node = SNetNodeNew(NODE_sync, location, &input, 1, &output, 1,
                      SNetNodeSync, SNetStopSync, SNetTermSync);
   sarg = NODE_SPEC(node, sync);
+  SNetSplitAddStateful();
   sarg->output = output;
   sarg->patterns = patterns;
   sarg->guard_exprs = guard_exprs;
+  SNetExprListCompile( guard_exprs);
   sarg->num_patterns = SNetVariantListLength( sarg->patterns);
   sarg->merged_pattern = GetMergedTypeVariant(sarg->patterns);
   sarg->garbage_collect = SNetGarbageCollection();
@@ -16,6 +16,8 @@ static int              num_thieves;
 static const char      *program_name;
 static const char      *opt_concurrency;
 static bool             opt_debug;
+static bool             opt_deque;
+static int              opt_batch_delay;
 static bool             opt_debug_df;
 static bool             opt_debug_gc;
 static bool             opt_debug_rs;
@@ -27,8 +29,15 @@ static bool             opt_garbage_collection;
 static double           opt_input_factor;
 static double           opt_input_offset;
 static bool             opt_input_throttle;
+static int              opt_latency;
+static const char      *opt_latency_file;
+static const char      *opt_metrics;
+static double           opt_metrics_interval;
 static bool             opt_resource;
+static const char      *opt_trace;
+static size_t           opt_trace_size;
 static const char      *opt_resource_server;
+static int              opt_split_limit;
 static size_t           opt_thread_stack_size;
 static bool             opt_verbose;
 static bool             opt_zipper;
@@ -108,6 +117,25 @@ bool SNetFeedbackDeterministic(void)
   return opt_feedback_deterministic;
 }
 
+/* Whether to schedule work with work-stealing deques. */
+bool SNetOptDeque(void)
+{
+  return opt_deque;
+}
+
+/* The number of live instances per split beyond which idle ones retire. */
+int SNetOptSplitLimit(void)
+{
+  return opt_split_limit;
+}
+
+/* The deadline in microseconds for batching distributed records,
+ * or zero when records are sent one at a time. */
+int SNetOptBatchDelay(void)
+{
+  return opt_batch_delay;
+}
+
 /* Whether to use dynamic resource management. */
 bool SNetOptResource(void)
 {
@@ -120,6 +148,42 @@ const char* SNetOptResourceServer(void)
   return opt_resource_server;
 }
 
+/* The file to dump metrics to, if metrics are enabled. */
+const char* SNetOptMetrics(void)
+{
+  return opt_metrics;
+}
+
+/* The interval in seconds between periodic metrics dumps, if positive. */
+double SNetOptMetricsInterval(void)
+{
+  return opt_metrics_interval;
+}
+
+/* Trace the latency of every so many input records, if positive. */
+int SNetOptLatency(void)
+{
+  return opt_latency;
+}
+
+/* The file to write the latency report to, or NULL for stderr. */
+const char* SNetOptLatencyFile(void)
+{
+  return opt_latency_file;
+}
+
+/* The file to export the event trace to, if tracing is enabled. */
+const char* SNetOptTrace(void)
+{
+  return opt_trace;
+}
+
+/* The number of recent events which each worker retains for the trace. */
+size_t SNetOptTraceSize(void)
+{
+  return opt_trace_size;
+}
+
 /* Whether to use optimized sync-star. */
 bool SNetZipperEnabled(void)
 {
@@ -242,10 +306,17 @@ int SNetThreadingInit(int argc, char**argv)
   opt_garbage_collection = true;
   opt_zipper = true;
   opt_concurrency = "2D";
+  opt_trace_size = TRACE_RING_SIZE;
 
   for (i = 0; i < argc; ++i) {
     if (argv[i][0] != '-') {
     }
+    else if (EQ(argv[i], "-B") && ++i < argc) {
+      if ((opt_batch_delay = atoi(argv[i])) < 0) {
+        SNetUtilDebugFatal("[%s]: Invalid batch delay %d.",
+                           __func__, opt_batch_delay);
+      }
+    }
     else if (EQ(argv[i], "-c") && ++i < argc) {
       opt_concurrency = argv[i];
     }
@@ -261,9 +332,40 @@ int SNetThreadingInit(int argc, char**argv)
         if (strstr(argv[i], "ws")) { opt_debug_ws = true; }
       }
     }
+    else if (EQ(argv[i], "-e") && ++i < argc) {
+      opt_trace = argv[i];
+    }
+    else if (EQ(argv[i], "-E") && ++i < argc) {
+      if (atoi(argv[i]) <= 0) {
+        SNetUtilDebugFatal("[%s]: Invalid trace ring size %s.",
+                           __func__, argv[i]);
+      }
+      opt_trace_size = atoi(argv[i]);
+    }
     else if (EQ(argv[i], "-g")) {
       opt_garbage_collection = false;
     }
+    else if (EQ(argv[i], "-l") && ++i < argc) {
+      if ((opt_latency = atoi(argv[i])) <= 0) {
+        SNetUtilDebugFatal("[%s]: Invalid latency sampling interval %s.",
+                           __func__, argv[i]);
+      }
+    }
+    else if (EQ(argv[i], "-L") && ++i < argc) {
+      opt_latency_file = argv[i];
+    }
+    else if (EQ(argv[i], "-m") && ++i < argc) {
+      opt_metrics = argv[i];
+    }
+    else if (EQ(argv[i], "-M") && ++i < argc) {
+      if ((opt_metrics_interval = atof(argv[i])) <= 0) {
+        SNetUtilDebugFatal("[%s]: Invalid metrics interval %s.",
+                           __func__, argv[i]);
+      }
+    }
+    else if (EQ(argv[i], "-q")) {
+      opt_deque = true;
+    }
     else if (EQ(argv[i], "-r")) {
       opt_resource = true;
     }
@@ -279,6 +381,12 @@ int SNetThreadingInit(int argc, char**argv)
                            __func__, argv[i], PTHREAD_STACK_MIN);
       }
     }
+    else if (EQ(argv[i], "-S") && ++i < argc) {
+      if ((opt_split_limit = atoi(argv[i])) <= 0) {
+        SNetUtilDebugFatal("[%s]: Invalid split instance limit %d.",
+                           __func__, opt_split_limit);
+      }
+    }
     else if (EQ(argv[i], "-t") && ++i < argc) {
       SNetEnableTracing(atoi(argv[i]));
     }
@@ -349,10 +457,11 @@ int SNetThreadingInit(int argc, char**argv)
   }
 
   if (opt_verbose) {
-    printf("W=%d,GC=%s,Z=%s,R=%s,RS=%s.\n",
+    printf("W=%d,GC=%s,Z=%s,Q=%s,R=%s,RS=%s.\n",
            num_workers,
            opt_garbage_collection ? "true" : "false",
            opt_zipper ? "true" : "false",
+           opt_deque ? "true" : "false",
            opt_resource ? "true" : "false",
            opt_resource_server ? "true" : "false"
            );
@@ -419,6 +528,10 @@ int SNetThreadingCleanup(void)
 
   pthread_key_delete(thread_self_key);
 
+  if (opt_verbose) {
+    SNetMemPrintStats(stdout);
+  }
+
   SNetReferenceDestroy();
 
   SNetNodeCleanup();
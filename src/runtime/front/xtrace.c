@@ -0,0 +1,143 @@
+#include <string.h>
+#include <limits.h>
+#include "node.h"
+
+/* The workers to export and the time at which the network started. */
+static worker_config_t *trace_config;
+static uint64_t         trace_start;
+
+/* The category, name and argument name of each kind of event. */
+static const struct trace_kind_info {
+  const char           *cat;
+  const char           *name;
+  const char           *arg;
+  bool                  instant;
+} trace_kinds[] = {
+  [TraceBox]       = { "box",     NULL,        NULL,     false },
+  [TraceSteal]     = { "steal",   "steal",     "victim", true  },
+  [TraceContended] = { "lock",    "contended", "holder", true  },
+  [TracePark]      = { "park",    "park",      "woken",  false },
+  [TraceSend]      = { "distrib", "send",      "dest",   false },
+  [TraceRecv]      = { "distrib", "recv",      "source", false },
+};
+
+/* Create the event ring of a new worker, if tracing is enabled. */
+trace_ring_t *SNetTraceWorkerCreate(void)
+{
+  trace_ring_t *ring = NULL;
+  uint64_t      size = 1;
+
+  if (SNetOptTrace()) {
+    while (size < SNetOptTraceSize()) {
+      size <<= 1;
+    }
+    ring = SNetMemAlloc(sizeof(trace_ring_t) + size * sizeof(trace_event_t));
+    ring->count = 0;
+    ring->mask = size - 1;
+    ring->contended = NULL;
+  }
+  return ring;
+}
+
+/* Free the event ring of a worker. */
+void SNetTraceWorkerDestroy(trace_ring_t *ring)
+{
+  SNetMemFree(ring);
+}
+
+/* Return a time stamp for a distributed message, or 0 if not tracing. */
+uint64_t SNetTraceClock(void)
+{
+  return SNetOptTrace() ? SNetMetricsClock() : 0;
+}
+
+/* Record the transfer of a distributed message by the current worker. */
+void SNetTraceMessage(bool send, uint64_t start, int peer)
+{
+  worker_t *worker;
+
+  if (start && (worker = SNetThreadGetSelf()) != NULL) {
+    SNetTraceSpan(worker, send ? TraceSend : TraceRecv, NULL, start, peer);
+  }
+}
+
+/* Remember the workers whose events will be exported at the end. */
+void SNetTraceStart(worker_config_t *config)
+{
+  if (SNetOptTrace()) {
+    trace_config = config;
+    trace_start = SNetMetricsClock();
+  }
+}
+
+/* Write one event in the Chrome Trace Event format. */
+static void TraceWrite(FILE *fp, const trace_event_t *ev, int pid, int tid)
+{
+  const struct trace_kind_info *info = &trace_kinds[ev->kind];
+  const double ts = (ev->start > trace_start)
+                  ? (ev->start - trace_start) * 1e-3 : 0;
+
+  fprintf(fp, ",\n{\"name\":\"%s\",\"cat\":\"%s\",\"pid\":%d,\"tid\":%d,"
+          "\"ts\":%.3f", ev->name ? ev->name : info->name, info->cat,
+          pid, tid, ts);
+  if (info->instant) {
+    fputs(",\"ph\":\"i\",\"s\":\"t\"", fp);
+  } else {
+    fprintf(fp, ",\"ph\":\"X\",\"dur\":%.3f", ev->dur * 1e-3);
+  }
+  if (info->arg && ev->arg >= 0) {
+    fprintf(fp, ",\"args\":{\"%s\":%d}", info->arg, ev->arg);
+  }
+  fputc('}', fp);
+}
+
+/* Export the events of all workers as a Chrome Trace Event JSON file. */
+void SNetTraceStop(void)
+{
+  worker_config_t *config = trace_config;
+  const char      *name = SNetOptTrace();
+  const int        pid = SNetDistribGetNodeId();
+  char             buf[PATH_MAX];
+  FILE            *fp;
+  uint64_t         i, first, dropped = 0;
+  int              id;
+
+  if (config == NULL) {
+    return;
+  }
+  /* Every location of a distributed network writes its own file. */
+  if (SNetDistribIsDistributed()) {
+    snprintf(buf, sizeof(buf), "%s.%d", name, pid);
+    name = buf;
+  }
+  if ((fp = fopen(name, "w")) == NULL) {
+    SNetUtilDebugFatal("[%s]: Cannot open trace file %s: %s",
+                       __func__, name, strerror(errno));
+  }
+
+  fprintf(fp, "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n"
+          "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":%d,"
+          "\"args\":{\"name\":\"location %d\"}}", pid, pid);
+  for (id = 1; id <= config->worker_count; ++id) {
+    worker_t *worker = config->workers[id];
+    trace_ring_t *ring;
+
+    if (worker == NULL || (ring = worker->trace) == NULL) {
+      continue;
+    }
+    fprintf(fp, ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":%d,"
+            "\"tid\":%d,\"args\":{\"name\":\"%s %d\"}}", pid, id,
+            worker->role == DataWorker ? "worker" : "manager", id);
+    /* Only the most recent events survive in the ring. */
+    first = (ring->count > ring->mask) ? ring->count - ring->mask - 1 : 0;
+    dropped += first;
+    for (i = first; i < ring->count; ++i) {
+      TraceWrite(fp, &ring->events[i & ring->mask], pid, id);
+    }
+  }
+  fprintf(fp, "\n],\"otherData\":{\"dropped_events\":%llu}}\n",
+          (unsigned long long) dropped);
+  fclose(fp);
+
+  trace_config = NULL;
+}
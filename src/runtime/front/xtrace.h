@@ -0,0 +1,90 @@
+#ifndef _XTRACE_H
+#define _XTRACE_H
+
+#include <stdint.h>
+
+/* The default number of events which each worker retains. */
+#define TRACE_RING_SIZE         65536
+
+/* The kinds of recorded events. */
+typedef enum trace_kind {
+  TraceBox,                     /* execution of a box function */
+  TraceSteal,                   /* theft of work from a victim */
+  TraceContended,               /* a landing was locked by another worker */
+  TracePark,                    /* a worker waited for work */
+  TraceSend,                    /* a distributed message was sent */
+  TraceRecv,                    /* a distributed message was received */
+} trace_kind_t;
+
+/* One event: a span of 'dur' nanoseconds from 'start',
+ * or an instant for steals and contention. */
+typedef struct trace_event {
+  uint64_t              start;
+  uint64_t              dur;
+  const char           *name;           /* box name for box events */
+  trace_kind_t          kind;
+  int                   arg;            /* a worker, peer location, or -1 */
+} trace_event_t;
+
+/* The most recent events of one worker. Only the owning worker writes,
+ * older events are overwritten once the ring is full. */
+struct trace_ring {
+  uint64_t              count;          /* total number of recorded events */
+  uint64_t              mask;           /* ring size minus one */
+  const landing_t      *contended;      /* last recorded busy landing */
+  trace_event_t         events[];
+};
+
+/* Append an event to the ring of a worker. */
+static inline void SNetTraceEvent(worker_t *worker, trace_kind_t kind,
+                                  const char *name, uint64_t start,
+                                  uint64_t dur, int arg)
+{
+  trace_ring_t  *ring = worker->trace;
+  trace_event_t *ev = &ring->events[ring->count++ & ring->mask];
+
+  ev->start = start;
+  ev->dur = dur;
+  ev->name = name;
+  ev->kind = kind;
+  ev->arg = arg;
+}
+
+/* Record a span which started at 'start' and ends now. */
+static inline void SNetTraceSpan(worker_t *worker, trace_kind_t kind,
+                                 const char *name, uint64_t start, int arg)
+{
+  if (worker->trace) {
+    SNetTraceEvent(worker, kind, name, start, SNetMetricsClock() - start, arg);
+  }
+}
+
+/* Record an event without duration. */
+static inline void SNetTraceInstant(worker_t *worker, trace_kind_t kind,
+                                    int arg)
+{
+  if (worker->trace) {
+    SNetTraceEvent(worker, kind, NULL, SNetMetricsClock(), 0, arg);
+  }
+}
+
+/* Record a failure to lock a landing, but only once per landing in a row,
+ * because a worker may retry the same item many times. */
+static inline void SNetTraceContended(worker_t *worker, const landing_t *land)
+{
+  if (worker->trace && worker->trace->contended != land) {
+    worker->trace->contended = land;
+    SNetTraceEvent(worker, TraceContended, NULL, SNetMetricsClock(), 0,
+                   land->id);
+  }
+}
+
+/* Forget the last contended landing after a landing was locked. */
+static inline void SNetTraceAcquired(worker_t *worker)
+{
+  if (worker->trace) {
+    worker->trace->contended = NULL;
+  }
+}
+
+#endif
@@ -1,11 +1,24 @@
 #include <unistd.h>
+#include <string.h>
+#include <limits.h>
 #include "node.h"
+#ifdef __linux__
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#endif
+
+/* Number of failed steal attempts before an idle worker parks. */
+#define WORKER_SPINS            100
+
+/* Maximum time in nanoseconds a worker remains parked. */
+#define WORKER_PARK_NSEC        1000000
 
 /* Initialize a new empty work list. */
 static void WorkerTodoInit(work_list_t *q)
 {
   q->head.next_item = NULL;
   q->head.next_free = NULL;
+  q->head.next_return = NULL;
   q->head.desc = NULL;
   q->head.count = 0;
   q->head.lock = 0;
@@ -35,11 +48,18 @@ worker_t *SNetWorkerCreate(
   worker->id = worker_id;
   worker->role = role;
   worker->victim_id = worker_id;
+  worker->victims = NULL;
+  worker->victims_size = 0;
+  worker->victims_epoch = 0;
 
   WorkerTodoInit(&worker->todo);
 
   worker->prev = worker->iter = &worker->todo.head;
 
+  worker->use_deque = SNetOptDeque();
+  SNetDequeInit(&worker->deque);
+  worker->returns = NULL;
+
   WorkerFreeInit(&worker->free);
 
   if (config->input_node) {
@@ -65,6 +85,15 @@ worker_t *SNetWorkerCreate(
   worker->idle_seqnr = 0;
   worker->proc_bind = NO_PROC;
   worker->proc_revoked = false;
+  worker->num_parks = 0;
+  worker->num_unparks = 0;
+  worker->num_notifies = 0;
+  worker->notify_defer = 0;
+  worker->notify_pending = 0;
+  worker->write_batch = NULL;
+  memset(worker->num_steals, 0, sizeof(worker->num_steals));
+  worker->metrics = SNetMetricsWorkerCreate();
+  worker->trace = SNetTraceWorkerCreate();
 
   return worker;
 }
@@ -90,6 +119,19 @@ void SNetWorkerDestroy(worker_t *worker)
     } while ((desc = SNetHashPtrNext(worker->hash_ptab, desc)) != NULL);
   }
 
+  if (SNetVerbose() && worker->num_parks) {
+    printf("worker %d: parked %zu times, %zu woken, %zu wakeups sent\n",
+           worker->id, worker->num_parks, worker->num_unparks,
+           worker->num_notifies);
+  }
+  if (SNetVerbose() && worker->victims) {
+    printf("worker %d: stole %zu core, %zu cache, %zu numa, %zu remote\n",
+           worker->id, worker->num_steals[ProcSameCore],
+           worker->num_steals[ProcSameCache], worker->num_steals[ProcSameNuma],
+           worker->num_steals[ProcRemote]);
+    SNetMemFree(worker->victims);
+  }
+
   /* Free hash table. */
   SNetHashPtrTabDestroy(worker->hash_ptab);
 
@@ -100,6 +142,12 @@ void SNetWorkerDestroy(worker_t *worker)
     SNetDelete(item);
   }
 
+  /* Free deque. */
+  SNetDequeDone(&worker->deque);
+
+  SNetMetricsWorkerDestroy(worker->metrics);
+  SNetTraceWorkerDestroy(worker->trace);
+
   /* Free lock */
   SNetDelete(worker->steal_lock);
   SNetDelete(worker->steal_turn);
@@ -143,6 +191,7 @@ static work_item_t *GetFreeWorkItem(worker_t *worker)
   }
   item->turn = 0;
   item->next_free = NULL;
+  item->next_return = NULL;
   item->count = 0;
   return item;
 }
@@ -165,28 +214,203 @@ static void PutFreeWorkItem(worker_t *worker, work_item_t *item)
   ++worker->free.count;
 }
 
+/* Announce to parked workers that something changed. The caller must
+ * have issued a full barrier after publishing the change: a worker which
+ * parks first increments park_count and then looks for work again. */
+static void WorkerNotify(worker_t *worker, int count)
+{
+  worker_config_t *config = worker->config;
+
+  if (config->park_count > 0) {
+    AAF(&config->park_epoch, 1);
+#ifdef __linux__
+    syscall(SYS_futex, &config->park_epoch, FUTEX_WAKE_PRIVATE,
+            count, NULL, NULL, 0);
+#endif
+    worker->num_notifies += 1;
+  }
+}
+
+/* Register as a parked worker and return the current epoch. */
+static unsigned WorkerParkPrepare(worker_t *worker)
+{
+  AAF(&worker->config->park_count, 1);
+  return worker->config->park_epoch;
+}
+
+/* Deregister as a parked worker without waiting. */
+static void WorkerParkCancel(worker_t *worker)
+{
+  SAF(&worker->config->park_count, 1);
+}
+
+/* Wait until the epoch advances beyond 'epoch' or a timeout expires. */
+static void WorkerParkCommit(worker_t *worker, unsigned epoch)
+{
+  worker_config_t *config = worker->config;
+  uint64_t start = (worker->metrics || worker->trace) ? SNetMetricsClock() : 0;
+
+#ifdef __linux__
+  struct timespec timeout = { 0, WORKER_PARK_NSEC };
+  syscall(SYS_futex, &config->park_epoch, FUTEX_WAIT_PRIVATE,
+          epoch, &timeout, NULL, 0);
+#else
+  if (config->park_epoch == epoch) {
+    usleep(WORKER_PARK_NSEC / 1000);
+  }
+#endif
+  SAF(&config->park_count, 1);
+  if (worker->metrics) {
+    worker->metrics->park_nsec += SNetMetricsClock() - start;
+  }
+  worker->num_parks += 1;
+  if (config->park_epoch != epoch) {
+    worker->num_unparks += 1;
+  }
+  SNetTraceSpan(worker, TracePark, NULL, start, config->park_epoch != epoch);
+}
+
+/* Whether any work items remain. */
+static bool WorkerHasWork(worker_t *worker)
+{
+  if (worker->use_deque) {
+    return SNetDequeNonEmpty(&worker->deque) || worker->returns != NULL;
+  } else {
+    return worker->todo.head.next_item != NULL;
+  }
+}
+
+/* Remove an empty work item which was taken from the deque. */
+static bool WorkerDequeRelease(worker_t *worker, work_item_t *item)
+{
+  assert(item->count == 0);
+  if (item->lock == worker->id || trylock_work_item(item, worker)) {
+    if (item->desc) {
+      SNetHashPtrRemove(worker->hash_ptab, item->desc);
+    }
+    PutFreeWorkItem(worker, item);
+    return true;
+  }
+  return false;
+}
+
+/* Push a list of work items, which are linked by 'next_item', on the deque. */
+static void WorkerDequeRequeue(worker_t *worker, work_item_t *item)
+{
+  while (item) {
+    work_item_t *next = item->next_item;
+    item->next_item = NULL;
+    SNetDequePush(&worker->deque, item);
+    item = next;
+  }
+}
+
+/* Requeue or free the work items which thieves have returned. */
+static void WorkerReclaimReturns(worker_t *worker)
+{
+  work_item_t *item;
+
+  if (worker->returns) {
+    item = __sync_lock_test_and_set(&worker->returns, NULL);
+    while (item) {
+      work_item_t *next = item->next_return;
+      item->next_return = NULL;
+      if (item->count > 0 || !WorkerDequeRelease(worker, item)) {
+        SNetDequePush(&worker->deque, item);
+      }
+      item = next;
+    }
+  }
+}
+
+/* Take back returned items while idle: return true iff work remains. */
+static bool WorkerIdleReturns(worker_t *worker)
+{
+  if (worker->use_deque && worker->returns) {
+    WorkerReclaimReturns(worker);
+    worker->has_work = WorkerHasWork(worker);
+  }
+  return worker->has_work;
+}
+
+/* Wake up a parked worker now, or later if wakeups are deferred. */
+static void WorkerTodoNotify(worker_t *worker)
+{
+  if (worker->notify_defer) {
+    worker->notify_pending += 1;
+  } else {
+    WorkerNotify(worker, 1);
+  }
+}
+
+/* Postpone wakeups for new work until SNetWorkerNotifyFlush. */
+void SNetWorkerNotifyDefer(worker_t *worker)
+{
+  worker->notify_defer += 1;
+}
+
+/* Wake the input worker if it parked until more input is allowed. */
+void SNetWorkerNotifyInput(worker_t *worker)
+{
+  if (worker->config->input_parked) {
+    worker->config->input_parked = false;
+    BAR();
+    WorkerNotify(worker, INT_MAX);
+  }
+}
+
+/* Issue the wakeups which were postponed by SNetWorkerNotifyDefer. */
+void SNetWorkerNotifyFlush(worker_t *worker)
+{
+  assert(worker->notify_defer > 0);
+  if (--worker->notify_defer == 0 && worker->notify_pending > 0) {
+    BAR();
+    WorkerNotify(worker, worker->notify_pending);
+    worker->notify_pending = 0;
+  }
+}
+
 /* Add a new unit of work to the worker's todo list.
  * At return iterator should point to the new item.
  */
 void SNetWorkerTodo(worker_t *worker, snet_stream_desc_t *desc)
+{
+  SNetWorkerTodoCount(worker, desc, 1);
+}
+
+/* Add 'count' new units of work for one stream to the todo list. */
+void SNetWorkerTodoCount(worker_t *worker, snet_stream_desc_t *desc, int count)
 {
   work_item_t   *item = SNetHashPtrLookup(worker->hash_ptab, desc);
 
+  assert(count > 0);
   if (item) {
     /* Item may be locked by a thief. */
-    AAF(&item->count, 1);
+    const int total = AAF(&item->count, count);
+    if (total >= 2 && total - count < 2) {
+      /* Now there is enough to share with a thief. */
+      WorkerTodoNotify(worker);
+    }
   } else {
     item = GetFreeWorkItem(worker);
-    item->count = 1;
+    item->count = count;
     item->desc = desc;
     item->lock = 0;
     item->next_free = NULL;
-    item->next_item = worker->prev->next_item;
-    BAR();
-    worker->prev->next_item = item;
-    worker->prev = item;
+    if (worker->use_deque) {
+      /* Items stay queued until they are empty. */
+      item->next_item = NULL;
+      SNetDequePush(&worker->deque, item);
+    } else {
+      item->next_item = worker->prev->next_item;
+      BAR();
+      worker->prev->next_item = item;
+      worker->prev = item;
+    }
     SNetHashPtrStore(worker->hash_ptab, desc, item);
     worker->has_work = true;
+    BAR();
+    WorkerTodoNotify(worker);
   }
 }
 
@@ -211,9 +435,11 @@ static bool SNetWorkerWorkItem(work_item_t *const item, worker_t *worker)
 
   /* Claim destination landing. */
   if (trylock_landing(item->desc->landing, worker) == false) {
+    SNetTraceContended(worker, item->desc->landing);
     /* Nothing can be done. */
     return false;
   }
+  SNetTraceAcquired(worker);
 
   /* Bring item descriptors past any garbage collectable landings. */
   while (item->desc->landing->type == LAND_garbage) {
@@ -273,6 +499,7 @@ static bool SNetWorkerWorkItem(work_item_t *const item, worker_t *worker)
 
       /* Claim destination landing. */
       if (trylock_landing(item->desc->landing, worker) == false) {
+        SNetTraceContended(worker, item->desc->landing);
         /* We made progress anyway. */
         return true;
       }
@@ -331,6 +558,65 @@ static bool SNetWorkerInput(worker_t *worker)
   return worker->has_input;
 }
 
+/* Process work items from the work-stealing deque.
+ * An item remains owned by this worker until its count drops to zero:
+ * it is either on the deque, being processed, or on loan to a thief.
+ */
+static bool WorkerDequeWork(worker_t *worker)
+{
+  bool          didwork = true;
+  work_item_t  *item;
+  work_item_t  *stalled;
+
+  trace(__func__);
+
+  /* Loop until no more work could be done. */
+  while (didwork) {
+    didwork = false;
+    stalled = NULL;
+
+    WorkerReclaimReturns(worker);
+
+    /* Pop items until work is done. */
+    while (!didwork && (item = SNetDequePop(&worker->deque)) != NULL) {
+
+      if (trylock_work_item(item, worker)) {
+
+        /* Test if work to be done. */
+        if (item->count > 0 && SNetWorkerWorkItem(item, worker)) {
+          didwork = true;
+        }
+
+        /* Remove empty items. */
+        if (item->count == 0 && WorkerDequeRelease(worker, item)) {
+          continue;
+        }
+        else if (item->lock == worker->id) {
+          unlock_work_item(item, worker);
+        }
+      }
+
+      if (didwork) {
+        SNetDequePush(&worker->deque, item);
+      } else {
+        /* Set aside items which cannot make progress now. */
+        item->next_item = stalled;
+        stalled = item;
+      }
+    }
+
+    WorkerDequeRequeue(worker, stalled);
+
+    if (worker->proc_revoked) {
+      assert(SNetOptResource());
+      break;
+    }
+  }
+
+  worker->has_work = WorkerHasWork(worker);
+  return worker->has_work;
+}
+
 /* Process work items from the to-do list. */
 static bool SNetWorkerWork(worker_t *worker)
 {
@@ -338,6 +624,10 @@ static bool SNetWorkerWork(worker_t *worker)
 
   trace(__func__);
 
+  if (worker->use_deque) {
+    return WorkerDequeWork(worker);
+  }
+
   /* Loop until no more work could be done. */
   while (didwork) {
     didwork = false;
@@ -385,57 +675,64 @@ static bool SNetWorkerWork(worker_t *worker)
     }
   }
 
-  worker->has_work = (worker->todo.head.next_item != NULL);
+  worker->has_work = WorkerHasWork(worker);
   return worker->has_work;
 }
 
+/* Take a share of the read licenses of a locked work item of a victim. */
+static void WorkerStealItem(work_item_t *item, worker_t *thief)
+{
+  int            amount;
+
+  if (item->count > 0 && item->desc && DESC_LOCK(item->desc) == 0) {
+    work_item_t *lookup = (work_item_t *)
+        SNetHashPtrLookup(thief->hash_ptab, item->desc);
+    if (lookup) {
+      if (item->desc->landing->type == LAND_garbage) {
+        /* Take everything. */
+        amount = item->count;
+      } else {
+        /* Split the work evenly. */
+        amount = (item->count - lookup->count) / 2;
+      }
+      if (amount > 0) {
+        FAS(&item->count, amount);
+        thief->loot.count = amount;
+      } else {
+        thief->loot.count = 0;
+      }
+      thief->loot.desc = item->desc;
+      thief->loot.item = lookup;
+      thief->has_work = true;
+    }
+    else /* (lookup == NULL) */ {
+      if (item->desc->landing->type == LAND_garbage) {
+        /* Take everything. */
+        amount = item->count;
+      } else {
+        /* Talk half of it, but at least one. */
+        amount = (item->count + 1) / 2;
+      }
+      if (amount > 0) {
+        FAS(&item->count, amount);
+        thief->loot.count = amount;
+        thief->loot.desc = item->desc;
+        thief->loot.item = NULL;
+        thief->has_work = true;
+      }
+    }
+  }
+}
+
 /* Steal a work item from another worker */
 void SNetWorkerStealVictim(worker_t *victim, worker_t *thief)
 {
   work_item_t   *item = victim->todo.head.next_item;
-  int            amount;
 
   assert(thief->loot.desc == NULL);
   for (; item && !thief->loot.desc; item = item->next_item) {
     if (item->count > 0 && trylock_work_item(item, thief)) {
-      if (item->count > 0 && item->desc && DESC_LOCK(item->desc) == 0) {
-        work_item_t *lookup = (work_item_t *)
-            SNetHashPtrLookup(thief->hash_ptab, item->desc);
-        if (lookup) {
-          if (item->desc->landing->type == LAND_garbage) {
-            /* Take everything. */
-            amount = item->count;
-          } else {
-            /* Split the work evenly. */
-            amount = (item->count - lookup->count) / 2;
-          }
-          if (amount > 0) {
-            FAS(&item->count, amount);
-            thief->loot.count = amount;
-          } else {
-            thief->loot.count = 0;
-          }
-          thief->loot.desc = item->desc;
-          thief->loot.item = lookup;
-          thief->has_work = true;
-        }
-        else /* (lookup == NULL) */ {
-          if (item->desc->landing->type == LAND_garbage) {
-            /* Take everything. */
-            amount = item->count;
-          } else {
-            /* Talk half of it, but at least one. */
-            amount = (item->count + 1) / 2;
-          }
-          if (amount > 0) {
-            FAS(&item->count, amount);
-            thief->loot.count = amount;
-            thief->loot.desc = item->desc;
-            thief->loot.item = NULL;
-            thief->has_work = true;
-          }
-        }
-      }
+      WorkerStealItem(item, thief);
       unlock_work_item(item, thief);
     }
   }
@@ -444,6 +741,129 @@ void SNetWorkerStealVictim(worker_t *victim, worker_t *thief)
   }
 }
 
+/* Steal a work item from the deque of another worker.
+ * After taking a share the item is returned to its owner.
+ */
+static void WorkerStealDeque(worker_t *victim, worker_t *thief)
+{
+  work_item_t   *item = SNetDequeSteal(&victim->deque);
+  int            remains;
+
+  assert(thief->loot.desc == NULL);
+  if (item) {
+    if (trylock_work_item(item, thief)) {
+      WorkerStealItem(item, thief);
+      unlock_work_item(item, thief);
+    }
+    remains = item->count;
+    /* Once in 'returns' the owner may reclaim and free the item,
+     * so it must not be touched after the exchange. */
+    do {
+      item->next_return = victim->returns;
+    } while (!CAS(&victim->returns, item->next_return, item));
+
+    /* The owner may be parked while licenses remain in the item. */
+    if (remains > 0) {
+      BAR();
+      WorkerNotify(thief, INT_MAX);
+    }
+
+    if (thief->loot.desc && SNetDebugWS()) {
+      printf("steal\n");
+    }
+  }
+}
+
+/* Visit one victim: return true if that produced loot. */
+static bool WorkerStealFrom(worker_t *thief, int victim_id)
+{
+  worker_t *victim = thief->config->workers[victim_id];
+
+  if (victim && thief->use_deque) {
+    WorkerStealDeque(victim, thief);
+  }
+  else if (victim && trylock_worker(victim, thief)) {
+    AAF(&victim->steal_turn->turn, 1);
+    SNetWorkerStealVictim(victim, thief);
+    AAF(&victim->steal_turn->turn, 1);
+    unlock_worker(victim, thief);
+  }
+  if (thief->loot.desc) {
+    SNetTraceInstant(thief, TraceSteal, victim_id);
+    return true;
+  }
+  return false;
+}
+
+/* Order all other workers by their topological distance to a thief. */
+static void WorkerOrderVictims(worker_t *thief)
+{
+  worker_config_t  *config = thief->config;
+  const int         count = config->worker_count;
+  int               i, d, dist[count + 1];
+
+  thief->victims_epoch = config->bind_epoch;
+  BAR();
+  if (thief->victims_size < count) {
+    SNetMemFree(thief->victims);
+    thief->victims = SNetMemAlloc(count * sizeof(int));
+    thief->victims_size = count;
+  }
+
+  /* Count victims per distance, then place them with a prefix sum. */
+  memset(thief->victim_tiers, 0, sizeof(thief->victim_tiers));
+  for (i = 1; i <= count; ++i) {
+    worker_t *victim = config->workers[i];
+    if (i == thief->id) {
+      dist[i] = ProcDistances;
+    } else {
+      dist[i] = (victim && victim->proc_bind >= 0)
+              ? SNetProcDistance(thief->proc_bind, victim->proc_bind)
+              : ProcRemote;
+      thief->victim_tiers[dist[i] + 1] += 1;
+    }
+  }
+  for (d = 0; d < ProcDistances; ++d) {
+    thief->victim_tiers[d + 1] += thief->victim_tiers[d];
+  }
+  {
+    int fill[ProcDistances];
+    memcpy(fill, thief->victim_tiers, sizeof(fill));
+    for (i = 1; i <= count; ++i) {
+      if (dist[i] < ProcDistances) {
+        thief->victims[fill[dist[i]]++] = i;
+      }
+    }
+  }
+}
+
+/* Steal from the nearest victims first: the same core, the same cache,
+ * the same NUMA node and then the rest, rotating within each tier. */
+static bool WorkerStealNearest(worker_t *thief)
+{
+  int           d, i;
+
+  if (thief->victims == NULL ||
+      thief->victims_epoch != thief->config->bind_epoch)
+  {
+    WorkerOrderVictims(thief);
+  }
+
+  thief->victim_id = (thief->victim_id + 1) & INT_MAX;
+  for (d = 0; d < ProcDistances; ++d) {
+    const int first = thief->victim_tiers[d];
+    const int size = thief->victim_tiers[d + 1] - first;
+    for (i = 0; i < size; ++i) {
+      const int victim_id = thief->victims[first + (thief->victim_id + i) % size];
+      if (WorkerStealFrom(thief, victim_id)) {
+        thief->num_steals[d] += 1;
+        return true;
+      }
+    }
+  }
+  return false;
+}
+
 /* Scan other workers for stealable items */
 static bool SNetWorkerSteal(worker_t *thief)
 {
@@ -452,22 +872,35 @@ static bool SNetWorkerSteal(worker_t *thief)
   assert(thief->loot.desc == NULL);
   assert(thief->loot.item == NULL);
 
+  if (thief->proc_bind >= 0) {
+    return WorkerStealNearest(thief);
+  }
+
   for (i = 0; i < thief->config->worker_count && !thief->loot.desc; ++i) {
     thief->victim_id = 1 + (thief->victim_id % thief->config->worker_count);
     if (thief->victim_id != thief->id) {
-      worker_t *victim = thief->config->workers[thief->victim_id];
-      if (victim && trylock_worker(victim, thief)) {
-        AAF(&victim->steal_turn->turn, 1);
-        SNetWorkerStealVictim(victim, thief);
-        AAF(&victim->steal_turn->turn, 1);
-        unlock_worker(victim, thief);
-      }
+      WorkerStealFrom(thief, thief->victim_id);
     }
   }
 
   return (thief->loot.desc != NULL);
 }
 
+/* Steal while respecting the global limit on concurrent thieves. */
+static bool WorkerStealLimited(worker_t *thief)
+{
+  bool stolen;
+
+  if (thief->config->thief_limit) {
+    LOCK(thief->config->idle_lock);
+  }
+  stolen = SNetWorkerSteal(thief);
+  if (thief->config->thief_limit) {
+    UNLOCK(thief->config->idle_lock);
+  }
+  return stolen;
+}
+
 /* Process a stolen item. */
 static void SNetWorkerLoot(worker_t *worker)
 {
@@ -502,15 +935,19 @@ static void SNetWorkerLoot(worker_t *worker)
         PutFreeWorkItem(worker, item);
       } else {
         item->lock = 0;
-        item->next_item = worker->prev->next_item;
-        BAR();
-        worker->prev->next_item = worker->iter = item;
+        if (worker->use_deque) {
+          SNetDequePush(&worker->deque, item);
+        } else {
+          item->next_item = worker->prev->next_item;
+          BAR();
+          worker->prev->next_item = worker->iter = item;
+        }
       }
     }
     worker->loot.desc = NULL;
     worker->loot.count = 0;
     worker->loot.item = NULL;
-    worker->has_work = (worker->todo.head.next_item != NULL);
+    worker->has_work = WorkerHasWork(worker);
   }
 }
 
@@ -569,6 +1006,9 @@ bool SNetWorkerOthersBusy(worker_t *worker)
   }
   if (change == false) {
     worker->is_idle += 1;
+    /* Let parked workers observe the new idle state. */
+    BAR();
+    WorkerNotify(worker, INT_MAX);
   }
 
   return (worker->is_idle < WorkerExit);
@@ -577,6 +1017,23 @@ bool SNetWorkerOthersBusy(worker_t *worker)
 /* Cleanup unused memory. */
 void SNetWorkerMaintenaince(worker_t *worker)
 {
+  if (worker->use_deque) {
+    work_item_t *item, *keep = NULL;
+
+    /* Take back returned items and release all empty items. */
+    WorkerReclaimReturns(worker);
+    while ((item = SNetDequePop(&worker->deque)) != NULL) {
+      if (item->count > 0 || !WorkerDequeRelease(worker, item)) {
+        item->next_item = keep;
+        keep = item;
+      }
+    }
+    WorkerDequeRequeue(worker, keep);
+    worker->has_work = WorkerHasWork(worker);
+    ReduceWorkItems(worker);
+    return;
+  }
+
   /* Initialize iterator to the head of the to-do list. */
   worker->prev = &worker->todo.head;
   worker->iter = worker->prev->next_item;
@@ -613,7 +1070,7 @@ void SNetWorkerMaintenaince(worker_t *worker)
   }
 
   /* Signal thieves about potential work. */
-  worker->has_work = (worker->todo.head.next_item != NULL);
+  worker->has_work = WorkerHasWork(worker);
 
   /* Reduce length of free item list. */
   ReduceWorkItems(worker);
@@ -624,7 +1081,7 @@ void SNetWorkerWait(worker_t *worker)
 {
   while (SNetWorkerOthersBusy(worker)) {
     SNetWorkerMaintenaince(worker);
-    usleep(1000);
+    WorkerParkCommit(worker, WorkerParkPrepare(worker));
   }
 }
 
@@ -649,9 +1106,12 @@ void SNetWorkerSlave(worker_t *worker)
     }
     else if (worker->has_input && SNetWorkerInput(worker)) {
     }
+    else if (WorkerIdleReturns(worker)) {
+    }
     else if (SNetWorkerSteal(worker)) {
     }
     else {
+      SNetOutputIdle(worker);
       state = SlaveDone;
     }
     if (worker->proc_revoked) {
@@ -670,53 +1130,62 @@ void SNetWorkerSlave(worker_t *worker)
 /* Process work forever and read input until EOF. */
 void SNetWorkerRun(worker_t *worker)
 {
-  useconds_t            udelay;
-  // const useconds_t      max_udelay = 100;
-
   trace(__func__);
 
   for (;;) {
     if (worker->has_work || worker->has_input) {
-      udelay = 10;
-      do {
-        if (!SNetWorkerInput(worker)) {
+      int spins = 0;
+      /* Read input until it yields work. While the input is throttled,
+       * look for other work and then park until the output advances. */
+      while (SNetWorkerInput(worker) && !worker->has_work) {
+        if (WorkerIdleReturns(worker) || WorkerStealLimited(worker)) {
+          break;
+        }
+        if (++spins < WORKER_SPINS) {
           sched_yield();
-          if (!SNetWorkerSteal(worker) && !worker->has_work) {
-            usleep(udelay);
-            /* if ((udelay *= 2) > max_udelay) {
-              udelay = max_udelay;
-            } */
-          }
-          else if (worker->loot.desc) {
-            SNetWorkerLoot(worker);
+        } else {
+          /* Park, but only after a last look for input once registered. */
+          unsigned epoch;
+          SNetOutputIdle(worker);
+          epoch = WorkerParkPrepare(worker);
+          worker->config->input_parked = true;
+          BAR();
+          if (!SNetWorkerInput(worker) || worker->has_work ||
+              WorkerIdleReturns(worker) || WorkerStealLimited(worker)) {
+            WorkerParkCancel(worker);
+            break;
           }
+          WorkerParkCommit(worker, epoch);
+          spins = 0;
         }
-      } while (!worker->has_work && worker->has_input);
-      if (worker->has_work) {
+      }
+      if (worker->loot.desc) {
+        SNetWorkerLoot(worker);
+        SNetWorkerWork(worker);
+      }
+      else if (worker->has_work) {
         SNetWorkerWork(worker);
       }
     }
     else {
-      udelay = 10;
+      int spins = 0;
+      /* Do not let batched remote records wait for a deadline,
+       * nor buffered output records. */
+      SNetDistribFlush();
+      SNetOutputIdle(worker);
       do {
         sched_yield();
-        if (worker->config->thief_limit) {
-          LOCK(worker->config->idle_lock);
-        }
-        if (SNetWorkerSteal(worker)) {
-          if (worker->config->thief_limit) {
-            UNLOCK(worker->config->idle_lock);
-          }
+        if (WorkerIdleReturns(worker) || WorkerStealLimited(worker)) {
           break;
         }
-        if (!worker->has_work) {
-          usleep(udelay);
-          /* if ((udelay *= 2) > max_udelay) {
-            udelay = max_udelay;
-          } */
-        }
-        if (worker->config->thief_limit) {
-          UNLOCK(worker->config->idle_lock);
+        if (!worker->has_work && ++spins >= WORKER_SPINS) {
+          /* Park, but only after a last look for work once registered. */
+          unsigned epoch = WorkerParkPrepare(worker);
+          if (WorkerIdleReturns(worker) || WorkerStealLimited(worker)) {
+            WorkerParkCancel(worker);
+            break;
+          }
+          WorkerParkCommit(worker, epoch);
         }
       } while (!worker->has_work && SNetWorkerOthersBusy(worker));
       if (worker->loot.desc) {
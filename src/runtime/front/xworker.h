@@ -24,6 +24,18 @@ typedef struct worker_config {
   /* The lock to use when there is a thief_limit. */
   lock_t                idle_lock;
 
+  /* An eventcount for idle workers: the number of parked workers
+   * and an epoch which is advanced to wake them up. */
+  int                   park_count __attribute__((aligned(LINE_SIZE)));
+  unsigned              park_epoch;
+
+  /* Set while the input worker parks because input is throttled. */
+  int                   input_parked;
+
+  /* Advanced whenever a worker is started on a processor,
+   * which invalidates the victim orders of thieves. */
+  unsigned              bind_epoch;
+
   /* An output file descriptor to a pipe to the initial thread. */
   int                   pipe_send;
 
@@ -44,6 +56,15 @@ typedef enum worker_role {
   InputManager,
 } worker_role_t;
 
+/* The topological distance between the processors of two workers. */
+typedef enum proc_distance {
+  ProcSameCore,         /* Hyperthreads which share a core. */
+  ProcSameCache,        /* Cores which share a level 3 cache. */
+  ProcSameNuma,         /* Caches on the same NUMA node. */
+  ProcRemote,           /* Another NUMA node or an unknown binding. */
+  ProcDistances,        /* The number of distinct distances. */
+} proc_distance_t;
+
 /* A work item represents a license to read from a descriptor. */
 typedef struct work_item {
   /* A pointer to the next work item in the to-do list. */
@@ -52,6 +73,9 @@ typedef struct work_item {
   /* A pointer to the next work item in the freed work item list. */
   struct work_item      *next_free;
 
+  /* A pointer to the next work item which thieves have returned. */
+  struct work_item      *next_return;
+
   /* A pointer to the stream which contains at least 'count' records. */
   snet_stream_desc_t    *desc;
 
@@ -124,9 +148,25 @@ struct worker {
   /* The ID of the current or last visited worker when stealing. */
   int                    victim_id;
 
+  /* Victim IDs ordered by distance when this worker is bound to a processor:
+   * victims with distance 'd' are at [victim_tiers[d]..victim_tiers[d+1]). */
+  int                   *victims;
+  int                    victims_size;
+  int                    victim_tiers[ProcDistances + 1];
+  unsigned               victims_epoch;
+
+  /* Whether work is scheduled by the deque instead of the to-do list. */
+  bool                   use_deque;
+
   /* A list of work to be done. */
   work_list_t            todo;
 
+  /* A work-stealing deque of work to be done, if use_deque. */
+  work_deque_t           deque;
+
+  /* Work items which thieves return after taking their share. */
+  work_item_t           *returns __attribute__((aligned(LINE_SIZE)));
+
   /* An iterator over the to-do list. */
   work_item_t           *iter;
 
@@ -172,6 +212,27 @@ struct worker {
 
   /* Whether the processor this worker is executing on has been revoked. */
   bool                   proc_revoked;
+
+  /* How often this worker parked, was woken up, and woke up others. */
+  size_t                 num_parks;
+  size_t                 num_unparks;
+  size_t                 num_notifies;
+
+  /* Wakeups for new work are postponed while notify_defer is non-zero. */
+  int                    notify_defer;
+  int                    notify_pending;
+
+  /* A batch of writes which collects the output of the current box. */
+  struct write_batch    *write_batch;
+
+  /* How many thefts succeeded per distance to the victim. */
+  size_t                 num_steals[ProcDistances];
+
+  /* Counters for the metrics dump, if enabled. */
+  worker_metrics_t      *metrics;
+
+  /* Recent events for the trace export, if enabled. */
+  trace_ring_t          *trace;
 };
 
 
@@ -5,29 +5,34 @@
  *****************************************************************************/
 
 #include "node.h"
+#include "hashtable.h"
 
 /* test a single bit in mask */
-#define HAS_BIT(mask,bit)       ((mask) & (1 << (bit)))
+#define HAS_BIT(mask,bit)       ((mask) & (1UL << (bit)))
 /* set a single bit in mask */
-#define SET_BIT(mask,bit)       ((mask) |= (1 << (bit)))
+#define SET_BIT(mask,bit)       ((mask) |= (1UL << (bit)))
 /* clear a single bit in mask */
-#define CLR_BIT(mask,bit)       ((mask) &= ~(1 << (bit)))
+#define CLR_BIT(mask,bit)       ((mask) &= ~(1UL << (bit)))
 /* create a new mask of given width with all bits set */
 #define NEW_MASK(width)         ((1UL << (width)) - 1UL)
 
 typedef unsigned long mask_t;   /* at most 64 bits wide synchro-cells */
 
-/* a matching is a synchro-cell in progress */
+/* A matching is a synchro-cell in progress. Pending matchings are kept
+ * in groups of equal 'unmatched' masks, which are ordered by creation.
+ * Group heads are linked by 'next' and indexed by mask in the landing
+ * hashtable. A record goes to the oldest matching which seeks it. */
 struct matching {
-  matching_t     *next;         /* pointer to next matching in linked list */
+  matching_t     *next;         /* pointer to next group head in linked list */
   matching_t     *same;         /* pointer in list with same unmatched value */
-  matching_t     *tail;         /* tail pointer in same list */
+  matching_t     *tail;         /* last matching in group of a group head */
+  unsigned long   seqnr;        /* creation order of matchings */
   mask_t          unmatched;    /* mask of patterns which are still sought for */
   snet_record_t  *storage[0];   /* array of pointers to records */
 };
 
 /* Create a new matching */
-static matching_t *NewMatching(unsigned int sync_width)
+static matching_t *NewMatching(landing_zipper_t *land, unsigned int sync_width)
 {
   matching_t *match = (matching_t *)SNetMemAlloc(sizeof(matching_t) +
                                     sync_width * sizeof(snet_record_t *) +
@@ -35,10 +40,113 @@ static matching_t *NewMatching(unsigned int sync_width)
   match->next = NULL;
   match->same = NULL;
   match->tail = NULL;
+  match->seqnr = ++land->seqnr;
   match->unmatched = NEW_MASK(sync_width);
   return match;
 }
 
+/* The position of a matching: its group, the preceding group head,
+ * and its predecessor within the group. */
+typedef struct position {
+  matching_t     *group;
+  matching_t     *prev_group;
+  matching_t     *prev_same;
+} position_t;
+
+/* Find the oldest matching created after 'after' which seeks one
+ * of the patterns in 'matches'. */
+static matching_t *FindOldest(
+    landing_zipper_t *land,
+    mask_t matches,
+    unsigned long after,
+    position_t *pos)
+{
+  matching_t     *group, *prev = NULL, *match, *same, *best = NULL;
+
+  for (group = land->head; group; prev = group, group = group->next) {
+    if (group->unmatched & matches) {
+      for (same = NULL, match = group; match && match->seqnr <= after;
+           same = match, match = match->same) {
+      }
+      if (match && (best == NULL || match->seqnr < best->seqnr)) {
+        best = match;
+        pos->group = group;
+        pos->prev_group = prev;
+        pos->prev_same = same;
+      }
+    }
+  }
+  return best;
+}
+
+/* Take a matching out of its group. */
+static void TakeMatching(
+    landing_zipper_t *land,
+    matching_t *match,
+    const position_t *pos)
+{
+  matching_t     *group = pos->group;
+  matching_t     *next;
+
+  if (match != group) {
+    pos->prev_same->same = match->same;
+    if (group->tail == match) {
+      group->tail = pos->prev_same;
+    }
+  } else {
+    if ((next = group->same) != NULL) {
+      next->next = group->next;
+      next->tail = group->tail;
+      SNetHashtableReplace(land->groups, group->unmatched, next);
+    } else {
+      next = group->next;
+      SNetHashtableRemove(land->groups, group->unmatched);
+    }
+    if (pos->prev_group) {
+      pos->prev_group->next = next;
+    } else {
+      land->head = next;
+    }
+  }
+  match->next = match->same = match->tail = NULL;
+}
+
+/* Insert a matching into the group of its mask by creation order,
+ * or start a new group. */
+static void PutMatching(landing_zipper_t *land, matching_t *match)
+{
+  matching_t     *group = SNetHashtableGet(land->groups, match->unmatched);
+  matching_t     *prev, **link;
+
+  if (group == NULL) {
+    match->tail = match;
+    match->next = land->head;
+    land->head = match;
+    SNetHashtablePut(land->groups, match->unmatched, match);
+  }
+  else if (match->seqnr > group->tail->seqnr) {
+    group->tail->same = match;
+    group->tail = match;
+  }
+  else if (match->seqnr < group->seqnr) {
+    /* The matching becomes the head of the group. */
+    for (link = &land->head; *link != group; link = &(*link)->next) {
+    }
+    *link = match;
+    match->next = group->next;
+    match->tail = group->tail;
+    match->same = group;
+    group->next = group->tail = NULL;
+    SNetHashtableReplace(land->groups, match->unmatched, match);
+  }
+  else {
+    for (prev = group; prev->same->seqnr < match->seqnr; prev = prev->same) {
+    }
+    match->same = prev->same;
+    prev->same = match;
+  }
+}
+
 /* Test if a record matches one of several exit conditions */
 static bool MatchExitPatterns(snet_record_t *rec, const zipper_arg_t *zarg)
 {
@@ -107,77 +215,58 @@ void SNetNodeZipperData(
 {
   snet_variant_t *pattern;
   snet_expr_t    *expr;
-  matching_t     *match = land->head;
-  matching_t     *prev = NULL;
-  mask_t          untested = NEW_MASK(zarg->sync_width);
-  int             new_matches = 0;
+  matching_t     *match;
+  position_t      pos;
+  mask_t          matches, fill;
+  unsigned long   after = 0;
+  bool            stored;
   int             i;
-  
-  if (match == NULL) {
-    match = land->head = NewMatching(zarg->sync_width);
+
+  if (land->groups == NULL) {
+    land->groups = SNetHashtableCreate(0);
   }
-  while (untested) {
-    if ((untested & match->unmatched) != 0) {
-      LIST_ZIP_ENUMERATE(zarg->sync_patterns, zarg->sync_guards, i, pattern, expr) {
-        if (HAS_BIT(untested & match->unmatched, i)) {
-          CLR_BIT(untested, i);
-          if (SNetRecPatternMatches(pattern, rec) && SNetEevaluateBool(expr, rec)) {
-            match->storage[i] = (++new_matches == 1) ? rec : NULL;
-            if (CLR_BIT(match->unmatched, i) == 0) {
-              break;
-            }
-          }
-        }
+  for (;;) {
+    /* Test each synchro pattern only once per record. */
+    matches = 0;
+    LIST_ZIP_ENUMERATE(zarg->sync_patterns, zarg->sync_guards, i, pattern, expr) {
+      if (SNetRecPatternMatches(pattern, rec) && SNetEevaluateBool(expr, rec)) {
+        SET_BIT(matches, i);
       }
-      if (new_matches) {
-        if (match->same) {
-          assert(match->same->next == NULL);
-          match->same->next = match->next;
-          match->next = match->same;
-          assert(match->same->tail == NULL);
-          match->same->tail = match->tail;
-          match->same = match->tail = NULL;
-        }
-        if (match->unmatched) {
-          SNetRecDetrefDestroy(rec, &land->outdesc);
-          if (prev && prev->unmatched == match->unmatched) {
-            prev->next = match->next;
-            match->next = NULL;
-            if (prev->tail) {
-              prev->tail->same = match;
-              prev->tail = match;
-              assert(match->same == NULL);
-              assert(match->tail == NULL);
-            } else {
-              assert(prev->same == NULL);
-              prev->same = prev->tail = match;
-            }
-          }
-          return;
-        }
-        rec = MergeFromStorage(zarg, match, rec);
-        if (prev) {
-          prev->next = match->next;
-        } else {
-          land->head = match->next;
-        }
-        SNetDelete(match);
-        if (MatchExitPatterns(rec, zarg)) {
-          SNetWrite(&land->outdesc, rec, true);
-          return;
-        }
-        match = prev;
-        untested = NEW_MASK(zarg->sync_width);
-        new_matches = 0;
+    }
+    if (matches == 0) {
+      break;
+    }
+    stored = false;
+
+    /* The oldest matching which seeks this record, but a merged record
+     * only continues with the matchings after the one it completed. */
+    if ((match = FindOldest(land, matches, after, &pos)) != NULL) {
+      TakeMatching(land, match, &pos);
+    } else {
+      match = NewMatching(land, zarg->sync_width);
+    }
+    /* Store the record once, at the first pattern which it fills. */
+    fill = match->unmatched & matches;
+    match->unmatched &= ~matches;
+    for (i = 0; fill; ++i) {
+      if (HAS_BIT(fill, i)) {
+        match->storage[i] = stored ? NULL : rec;
+        stored = true;
+        CLR_BIT(fill, i);
       }
     }
-    if ((prev = match) == NULL) {
-      assert(land->head == NULL);
-      match = land->head = NewMatching(zarg->sync_width);
+
+    if (match->unmatched) {
+      SNetRecDetrefDestroy(rec, &land->outdesc);
+      PutMatching(land, match);
+      return;
     }
-    else if ((match = match->next) == NULL) {
-      match = prev->next = NewMatching(zarg->sync_width);
-      assert(!prev || prev->unmatched != match->unmatched);
+    rec = MergeFromStorage(zarg, match, rec);
+    after = match->seqnr;
+    SNetDelete(match);
+    if (MatchExitPatterns(rec, zarg)) {
+      SNetWrite(&land->outdesc, rec, true);
+      return;
     }
   }
   SNetUtilDebugNoticeEnt(zarg->entity,
@@ -213,6 +302,10 @@ void SNetNodeZipperTerminate(landing_zipper_t *land, zipper_arg_t *zarg)
       SNetDelete(match);
     } while ((match = same) != NULL);
   }
+  if (land->groups) {
+    SNetHashtableDestroy(land->groups);
+    land->groups = NULL;
+  }
   if (count) {
     SNetUtilDebugNoticeEnt(zarg->entity, "[MERGE] Warning: "
       "Destroying %u partially synchronized sync-cells!", count);
@@ -301,11 +394,14 @@ snet_stream_t *SNetZipper(
   node = SNetNodeNew(NODE_zipper, location, &input, 1, &output, 1,
                      SNetNodeZipper, SNetStopZipper, SNetTermZipper);
   zarg                = NODE_SPEC(node, zipper);
+  SNetSplitAddStateful();
   zarg->output        = output;
   zarg->exit_patterns = exit_patterns;
   zarg->exit_guards   = exit_guards;
   zarg->sync_patterns = sync_patterns;
   zarg->sync_guards   = sync_guards;
+  SNetExprListCompile( exit_guards);
+  SNetExprListCompile( sync_guards);
   zarg->sync_width    = SNetVariantListLength( zarg->sync_patterns);
   zarg->entity = SNetEntityCreate( ENTITY_star, location, SNetLocvecGet(info),
                                    "<syncstar>", NULL, (void *) zarg);
@@ -564,6 +564,7 @@ snet_stream_t *SNetFeedbackDet( snet_stream_t *input,
     fbdarg->out = output;
     fbdarg->back_patterns = back_patterns;
     fbdarg->guards = guards;
+    SNetExprListCompile( guards);
     SNetThreadingSpawn(
         SNetEntityCreate( ENTITY_fbdisp, location, locvec,
           "<fbdisp>", FeedbackDispTask, (void*)fbdarg)
@@ -372,6 +372,7 @@ snet_stream_t *SNetFeedback(
 
     feed->back_patterns = back_patterns;
     feed->guards = guards;
+    SNetExprListCompile( guards);
 
     feed->input = input;
     feed->operand = SNetStreamCreate(feed->capacity);
@@ -47,6 +47,7 @@ snet_filter_instr_t *SNetCreateFilterInstruction( snet_filter_opcode_t opcode, .
     case snet_btag:
       instr->name = va_arg( args, int);
       instr->expr = va_arg( args, snet_expr_t*);
+      SNetExprCompile( instr->expr);
       break;
     case snet_field:
       instr->newName = va_arg( args, int);
@@ -384,6 +385,7 @@ static snet_stream_t* CreateFilter( snet_stream_t *instream,
     farg->output = outstream;
     farg->input_variant = input_variant;
     farg->guard_exprs = guard_exprs;
+    SNetExprListCompile( guard_exprs);
     farg->filter_instructions = instr_list;
 
     SNetThreadingSpawn(
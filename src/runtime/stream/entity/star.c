@@ -403,6 +403,7 @@ static snet_stream_t *CreateStar( snet_stream_t *input,
     sarg->selffun = box_b;
     sarg->exit_patterns = exit_patterns;
     sarg->guards = guards;
+    SNetExprListCompile( guards);
     sarg->info = SNetInfoCopy(info);
     SNetLocvecSet(sarg->info, SNetLocvecCopy(locvec));
     sarg->is_incarnate = is_incarnate;
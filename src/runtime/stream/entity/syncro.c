@@ -309,6 +309,7 @@ snet_stream_t *SNetSync( snet_stream_t *input,
     sarg->output = output;
     sarg->patterns = patterns;
     sarg->guard_exprs = guard_exprs;
+    SNetExprListCompile( guard_exprs);
 
     SNetThreadingSpawn(
         SNetEntityCreate( ENTITY_sync, location, locvec,
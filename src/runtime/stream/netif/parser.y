@@ -56,6 +56,9 @@
 #define MODE_TEXTUAL 1
 #define INTERFACE_UNKNOWN -1
 
+/* Size of the stdio buffer of the input file. */
+#define INPUT_BUF_SIZE (256 * 1024)
+
  extern int yylex(void);
  extern void yylex_destroy();
  void yyerror(char *error);
@@ -156,6 +159,18 @@
    return NULL;
  }
 
+ /* Skip the remainder of field data up to the start of the next tag. */
+ static void skipToTag(void){
+   int c;
+
+   flockfile(yyin);
+   while((c = getc_unlocked(yyin)) != '<' && c != EOF);
+   funlockfile(yyin);
+   if(c == EOF || ungetc('<', yyin) == EOF){
+     SNetUtilDebugFatal("Input: Reading error.");
+   }
+ }
+
 %}
 
 %union {
@@ -528,20 +543,12 @@ Field:    FIELD_BEGIN Attributes STARTTAG_SHORTEND
 		      yyerror("Could not decode data!");
 	      }
 	     
-	      while(getc(yyin) != '<');		  
-	      if(ungetc('<', yyin) == EOF){
-		/* This is an error. First char of the next tag is already consumed! */
-      		SNetUtilDebugFatal("Input: Reading error.");
-	      }
+	      skipToTag();
 	      yyrestart(yyin);
 	    }else { 
 	      /* If we cannot deserialise the data we must ignore it! */
 	     
-	      while(getc(yyin) != '<');
-	      if(ungetc('<', yyin) == EOF){
-		/* This is an error. First char of the next tag is already consumed! */
-		SNetUtilDebugFatal("Input: Reading error.");
-	      }
+	      skipToTag();
 	    }
           }
           FIELD_END_BEGIN TAG_END
@@ -746,6 +753,9 @@ void SNetInParserInit(FILE *file,
                       snet_stream_desc_t *output,
                       snet_entity_t *ent)
 {
+  /* Read the input in large blocks. Nothing has been read from it yet. */
+  setvbuf(file, NULL, _IOFBF, INPUT_BUF_SIZE);
+
   yyin = file;
   parser.labels = labels;
   parser.interface = interfaces;
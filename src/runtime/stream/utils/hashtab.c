@@ -8,16 +8,24 @@
  * and a hashtable size (capacity) of m = 2^n.
  * The keys are integers, the values unspecified pointers (void*).
  *
- * The hash-function simply is h(k) = k % m.
+ * The hash-function is Fibonacci hashing h(k) = (k * 2^32/phi) >> (32 - n),
+ * which takes the high bits of the product and thereby spreads consecutive
+ * and strided keys over the whole table.
  * The probing function is h(k,i) = (h(k,i-1) + i) % m  with h(k,0) = h(k).
  * A nice property thereof is, that the values h(k,i) for i in [0,m − 1] are
  * all distinct, meaning that all buckets are probed.
  *
  * Upon a load > 0.75, which is particulary easy to compute for
- * table size >= 2^2, the capacity is doubled and each element is rehashed.
+ * table size >= 2^2, the capacity is doubled. Resizing is incremental:
+ * the previous table is kept and every put or remove migrates a few of
+ * its buckets into the new table, while lookups consult both tables.
+ * Thus no single insertion pays for rehashing the whole table.
  *
  * There are functions for putting values into and retrieving values from
- * the table, no function for deleting is provided.
+ * the table. Every int is a valid key, because the state of a bucket is kept
+ * apart from its key. Deleted entries leave a tombstone behind, which keeps probe
+ * sequences intact. Tombstones are reused by later insertions of the same
+ * probe sequence and are dropped when the table is rehashed.
  */
 
 #include <stdlib.h>
@@ -26,18 +34,33 @@
 #include "hashtab.h"
 #include "bool.h"
 
-#define HASHTAB_NOT_KEY         (-1)
+/* the state of a bucket */
+#define HASHTAB_FREE            0
+#define HASHTAB_USED            1
+#define HASHTAB_DELETED         2
+
+/* number of buckets of the previous table to migrate per put or remove */
+#define HASHTAB_MIGRATE_STEP    8
 
 
 typedef struct hashtab_entry {
   int key;
+  int state;            /* free, used or deleted */
   void *value;
 } hashtab_entry_t;
 
-struct hashtab {
+typedef struct hashtab_array {
   int capacity;
-  int count;
+  int power;            /* capacity == 2^power */
   hashtab_entry_t *table;
+} hashtab_array_t;
+
+struct hashtab {
+  hashtab_array_t cur;
+  hashtab_array_t old;  /* previous table while resizing, or NULL table */
+  int migrated;         /* buckets of the previous table migrated so far */
+  int count;            /* live entries plus tombstones of cur */
+  int live;             /* live entries of both tables */
 };
 
 struct hashtab_iter {
@@ -62,10 +85,25 @@ void HashtabIterDestroy( hashtab_iter_t *hti)
   free(hti);
 }
 
+/* the entry at an iterator index: the current table, then the previous */
+static hashtab_entry_t *IterEntry( hashtab_t *ht, int idx)
+{
+  if (idx < ht->cur.capacity) {
+    return &ht->cur.table[idx];
+  }
+  idx -= ht->cur.capacity;
+  if (ht->old.table != NULL && idx < ht->old.capacity) {
+    return &ht->old.table[idx];
+  }
+  return NULL;
+}
+
 int HashtabIterHasNext( hashtab_iter_t *hti)
 {
-  while (!hti->found && ++hti->idx < hti->ht->capacity) {
-    if (hti->ht->table[hti->idx].key != HASHTAB_NOT_KEY) {
+  hashtab_entry_t *hte;
+
+  while (!hti->found && (hte = IterEntry(hti->ht, ++hti->idx)) != NULL) {
+    if (hte->state == HASHTAB_USED) {
       hti->found = true;
     }
   }
@@ -76,7 +114,7 @@ void *HashtabIterNext( hashtab_iter_t *hti)
 {
   if (hti->found || HashtabIterHasNext(hti)) {
     hti->found = false;
-    return hti->ht->table[hti->idx].value;
+    return IterEntry(hti->ht, hti->idx)->value;
   }
   return NULL;
 }
@@ -87,6 +125,21 @@ void HashtabIterReset( hashtab_iter_t *hti)
   hti->found = false;
 }
 
+/* allocate an empty table of capacity 2^power */
+static void ArrayInit( hashtab_array_t *arr, int power)
+{
+  int i;
+
+  arr->power = power;
+  arr->capacity = 1 << power;
+  arr->table = (hashtab_entry_t *) malloc(
+      arr->capacity * sizeof(hashtab_entry_t));
+
+  for (i=0; i<arr->capacity; i++) {
+    arr->table[i].state = HASHTAB_FREE;
+  }
+}
+
 /**
  * Create a hashtable
  *
@@ -98,16 +151,12 @@ void HashtabIterReset( hashtab_iter_t *hti)
 hashtab_t *HashtabCreate( int init_cap2)
 {
   hashtab_t *ht = (hashtab_t *) malloc( sizeof(hashtab_t));
-  int i;
 
-  ht->capacity = 1 << init_cap2;
+  ArrayInit( &ht->cur, init_cap2);
+  ht->old.table = NULL;
+  ht->migrated = 0;
   ht->count = 0;
-  ht->table = (hashtab_entry_t *) malloc(
-      ht->capacity * sizeof(hashtab_entry_t));
-
-  for (i=0; i<ht->capacity; i++) {
-    ht->table[i].key = HASHTAB_NOT_KEY;
-  }
+  ht->live = 0;
   return ht;
 }
 
@@ -118,7 +167,8 @@ hashtab_t *HashtabCreate( int init_cap2)
  */
 void HashtabDestroy( hashtab_t *ht)
 {
-  free(ht->table);
+  free(ht->old.table);
+  free(ht->cur.table);
   free(ht);
 }
 
@@ -127,24 +177,53 @@ void HashtabDestroy( hashtab_t *ht)
 #define MOD_SIZE(size, key)    ((key) & ((size)-1))
 /* computes the key for the i-th probe, assuming the key of the (i-1)-th probe */
 #define HASH_K_I(size,key,i)  (MOD_SIZE((size),(key)+(i)))
+/* Fibonacci hashing of a key into a table of 2^power buckets */
+#define HASH_K(power,key) \
+  ((int) (((unsigned) (key) * 2654435769u) >> (32 - (power))))
+
+/**
+ * Find the entry of key in a table, or NULL if key does not exist.
+ */
+static hashtab_entry_t *Probe( hashtab_array_t *arr, int key)
+{
+  int pos, i;
+
+  /* find the position in the table through quadratic probing */
+  pos = HASH_K( arr->power, key);
+  for (i=0; i<arr->capacity; i++) {
+    pos = HASH_K_I( arr->capacity, pos, i);
+    if (arr->table[pos].state == HASHTAB_FREE) {
+      break;
+    }
+    if (arr->table[pos].state == HASHTAB_USED && arr->table[pos].key == key) {
+      return &arr->table[pos];
+    }
+  }
+  return NULL;
+}
 
 /**
  * Get a hashtab entry to store key.
- * If key exists, the entry of that key will be returned.
+ * If key exists, the entry of that key will be returned,
+ * otherwise the first tombstone or free entry on the probe sequence.
  */
-static hashtab_entry_t *ProbePut( hashtab_t *ht, int key)
+static hashtab_entry_t *ProbePut( hashtab_array_t *arr, int key)
 {
   int pos, i;
   hashtab_entry_t *res = NULL;
 
   /* find the position in the table through quadratic probing */
-  pos = key;
-  for (i=0; i<ht->capacity; i++) {
-    pos = HASH_K_I( ht->capacity, pos, i);
-    if (ht->table[pos].key == HASHTAB_NOT_KEY ||
-        ht->table[pos].key == key) {
-      res = &ht->table[pos];
-      break;
+  pos = HASH_K( arr->power, key);
+  for (i=0; i<arr->capacity; i++) {
+    pos = HASH_K_I( arr->capacity, pos, i);
+    if (arr->table[pos].state == HASHTAB_USED && arr->table[pos].key == key) {
+      return &arr->table[pos];
+    }
+    if (arr->table[pos].state == HASHTAB_FREE) {
+      return res ? res : &arr->table[pos];
+    }
+    if (arr->table[pos].state == HASHTAB_DELETED && res == NULL) {
+      res = &arr->table[pos];
     }
   }
   /* every element is probed due to the nature of the
@@ -152,56 +231,90 @@ static hashtab_entry_t *ProbePut( hashtab_t *ht, int key)
   return res;
 }
 
+/**
+ * Migrate up to step buckets of the previous table into the current one.
+ * Migrated entries leave a tombstone behind in the previous table.
+ */
+static void Migrate( hashtab_t *ht, int step)
+{
+  hashtab_entry_t *hte;
+
+  while (ht->old.table != NULL && step-- > 0) {
+    hashtab_entry_t *from = &ht->old.table[ht->migrated];
+    if (from->state == HASHTAB_USED) {
+      hte = ProbePut( &ht->cur, from->key);
+      assert( hte != NULL && hte->state != HASHTAB_USED);
+      if (hte->state == HASHTAB_FREE) {
+        ht->count += 1;
+      }
+      hte->key   = from->key;
+      hte->state = HASHTAB_USED;
+      hte->value = from->value;
+      from->state = HASHTAB_DELETED;
+    }
+    if (++ht->migrated == ht->old.capacity) {
+      free( ht->old.table);
+      ht->old.table = NULL;
+      ht->migrated = 0;
+    }
+  }
+}
+
+/* Start an incremental rehash into a table of capacity 2^power. */
+static void Rehash( hashtab_t *ht, int power)
+{
+  /* complete a previous resize first */
+  Migrate( ht, ht->old.capacity);
+
+  ht->old = ht->cur;
+  ht->migrated = 0;
+  ht->count = 0;
+  ArrayInit( &ht->cur, power);
+}
+
 
 /**
  * Put a key-value pair into the hashtable.
  * If key already exists, the value will be overwritten.
  *
  * @param ht    pointer to the hashtable
- * @param key   key >= 0
+ * @param key   any key
  * @param value value != NULL
- * @pre   (key >= 0) && (value != NULL)
+ * @pre   value != NULL
  */
 void HashtabPut( hashtab_t *ht, int key, void *value)
 {
   hashtab_entry_t *hte;
 
-  ht->count += 1;
-  /* a load factor of 75% is used */
-  if (ht->count > (ht->capacity - (ht->capacity >> 2))) {
-    /* resize and rehash*/
-    int i;
-    int oldcap = ht->capacity;
-    hashtab_entry_t *oldtab = ht->table;
-
-    /* create a new table */
-    ht->capacity = oldcap << 1; /* double */
-    ht->table = (hashtab_entry_t *) malloc(
-        ht->capacity * sizeof(hashtab_entry_t));
-    for (i=0; i<ht->capacity; i++) {
-      ht->table[i].key = HASHTAB_NOT_KEY;
+  Migrate( ht, HASHTAB_MIGRATE_STEP);
+
+  /* get a pointer to the table entry */
+  hte = ProbePut( &ht->cur, key);
+  assert( hte != NULL);
+  if (hte->state != HASHTAB_USED) {
+    hashtab_entry_t *prev = ht->old.table ? Probe( &ht->old, key) : NULL;
+    if (prev != NULL) {
+      /* move the key out of the previous table */
+      prev->state = HASHTAB_DELETED;
+    } else {
+      ht->live += 1;
     }
-    /* fill the old entries */
-    for (i=0; i<oldcap; i++) {
-      int key = oldtab[i].key;
-      if (key != HASHTAB_NOT_KEY) {
-        /* get a pointer to the table entry */
-        hte = ProbePut( ht, key);
-        assert( hte != NULL);
-        /* put the item in the table */
-        hte->key   = key;
-        hte->value = oldtab[i].value;
+    if (hte->state == HASHTAB_FREE) {
+      ht->count += 1;
+      /* a load factor of 75% is used, including tombstones */
+      if (ht->count > (ht->cur.capacity - (ht->cur.capacity >> 2))) {
+        /* double, unless mostly tombstones are dropped by rehashing */
+        Rehash( ht, (ht->live > (ht->cur.capacity >> 1))
+                    ? (ht->cur.power + 1) : ht->cur.power);
+        hte = ProbePut( &ht->cur, key);
+        assert( hte != NULL && hte->state == HASHTAB_FREE);
+        ht->count += 1;
       }
     }
-    /* free the old table */
-    free( oldtab);
   }
-
-  /* get a pointer to the table entry */
-  hte = ProbePut( ht, key);
-  assert( hte != NULL);
   /* put the item in the table */
   hte->key   = key;
+  hte->state = HASHTAB_USED;
   hte->value = value;
 }
 
@@ -216,28 +329,16 @@ void HashtabPut( hashtab_t *ht, int key, void *value)
  */
 void *HashtabGet( hashtab_t *ht, int key)
 {
-  int pos, i;
-  void *res = NULL;
+  void **res = HashtabGetPointer( ht, key);
 
-  /* find the position in the table through quadratic probing */
-  pos = key;
-  for (i=0; i<ht->capacity; i++) {
-    pos = HASH_K_I( ht->capacity, pos, i);
-    if (ht->table[pos].key == HASHTAB_NOT_KEY) {
-      break;
-    }
-    if (ht->table[pos].key == key) {
-      res = ht->table[pos].value;
-      break;
-    }
-  }
-  return res;
+  return res ? *res : NULL;
 }
 
 
 /**
  * Get a pointer to the value for a key from the hashtable.
  * If key does not exist, NULL will be returned.
+ * The pointer is only valid until the next put or remove.
  *
  * @param ht  pointer to hashtable
  * @param key key for which the value should be retrieved
@@ -245,21 +346,36 @@ void *HashtabGet( hashtab_t *ht, int key)
  */
 void **HashtabGetPointer( hashtab_t *ht, int key)
 {
-  int pos, i;
-  void **res = NULL;
+  hashtab_entry_t *hte = Probe( &ht->cur, key);
 
-  /* find the position in the table through quadratic probing */
-  pos = key;
-  for (i=0; i<ht->capacity; i++) {
-    pos = HASH_K_I( ht->capacity, pos, i);
-    if (ht->table[pos].key == HASHTAB_NOT_KEY) {
-      break;
-    }
-    if (ht->table[pos].key == key) {
-      res = &ht->table[pos].value;
-      break;
-    }
+  if (hte == NULL && ht->old.table != NULL) {
+    hte = Probe( &ht->old, key);
+  }
+  return hte ? &hte->value : NULL;
+}
+
+/**
+ * Remove a key from the hashtable.
+ *
+ * @param ht  pointer to hashtable
+ * @param key key for which the entry should be removed
+ * @return the value which was stored for the key, or NULL if key did not exist
+ */
+void *HashtabRemove( hashtab_t *ht, int key)
+{
+  hashtab_entry_t *hte = Probe( &ht->cur, key);
+  void *res = NULL;
+
+  if (hte == NULL && ht->old.table != NULL) {
+    hte = Probe( &ht->old, key);
+  }
+  if (hte != NULL) {
+    res = hte->value;
+    hte->state = HASHTAB_DELETED;
+    hte->value = NULL;
+    ht->live -= 1;
   }
+  Migrate( ht, HASHTAB_MIGRATE_STEP);
   return res;
 }
 
@@ -276,10 +392,21 @@ void HashtabPrintDebug( hashtab_t *ht, FILE *outf)
 {
   int i;
 
-  fprintf( outf, "Hashtab capacity %d, count %d\n", ht->capacity, ht->count);
-  for (i=0; i<ht->capacity; i++) {
-    hashtab_entry_t *hte = &ht->table[i];
-    fprintf( outf, "[%3d] key %4d, value %p\n", i, hte->key, hte->value);
+  fprintf( outf, "Hashtab capacity %d, count %d, live %d\n",
+           ht->cur.capacity, ht->count, ht->live);
+  for (i=0; i<ht->cur.capacity; i++) {
+    hashtab_entry_t *hte = &ht->cur.table[i];
+    fprintf( outf, "[%3d] key %4d, state %d, value %p\n",
+             i, hte->key, hte->state, hte->value);
+  }
+  if (ht->old.table != NULL) {
+    fprintf( outf, "Previous capacity %d, migrated %d\n",
+             ht->old.capacity, ht->migrated);
+    for (i=0; i<ht->old.capacity; i++) {
+      hashtab_entry_t *hte = &ht->old.table[i];
+      fprintf( outf, "[%3d] key %4d, state %d, value %p\n",
+             i, hte->key, hte->state, hte->value);
+    }
   }
 }
 #endif
@@ -16,6 +16,7 @@ void HashtabDestroy( hashtab_t *ht);
 void *HashtabGet( hashtab_t *ht, int key);
 void  HashtabPut( hashtab_t *ht, int key, void *value);
 void **HashtabGetPointer( hashtab_t *ht, int key);
+void *HashtabRemove( hashtab_t *ht, int key);
 
 
 #ifdef DEBUG
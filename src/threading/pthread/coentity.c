@@ -0,0 +1,577 @@
+/*
+ * M:N threading backend: entities run as coroutines which are multiplexed
+ * onto a fixed pool of worker threads. Every worker owns a run queue and
+ * steals from the others when its own queue is empty. An entity which has
+ * to wait for a stream parks itself and gives its worker to the next one.
+ *
+ * Entities of type ENTITY_other (input, output and distribution managers)
+ * may block in system calls and therefore keep a dedicated thread.
+ */
+
+#include <stdarg.h>
+#include <string.h>
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <sched.h>
+#include <time.h>
+#include <sys/mman.h>
+
+#include <pthread.h>
+#include <ucontext.h>
+#include <assert.h>
+
+#include "threading.h"
+
+/* local includes (only for pthread backend) */
+#include "entity.h"
+#include "monitorer.h"
+
+#include "debug.h"
+#include "distribution.h"
+#include "memfun.h"
+
+/* Stack size of coroutines for boxes: the default of a pthread. */
+#define MN_BOX_STACK            (8 * 1024 * 1024)
+
+/* Stack size of coroutines for the other network entities. */
+#define MN_ENTITY_STACK         (256 * 1024)
+
+/* How long an idle worker sleeps before it looks for work again. */
+#define MN_IDLE_NSEC            1000000
+
+/* The kinds of entities, which each have their own pool of descriptors. */
+typedef enum {
+  MN_dedicated,
+  MN_entity,
+  MN_box,
+  MN_kinds
+} mn_kind_t;
+
+/* Why a coroutine switched back to its worker. */
+typedef enum {
+  MN_run,
+  MN_yield,
+  MN_park,
+  MN_exit
+} mn_reason_t;
+
+/* A worker thread with its run queue. */
+typedef struct mn_worker {
+  pthread_mutex_t       lock;
+  snet_thread_t        *head;
+  snet_thread_t        *tail;
+  snet_thread_t        *current;
+  ucontext_t            context;
+  pthread_t             thread;
+  int                   id;
+} __attribute__((aligned(LINE_SIZE))) mn_worker_t;
+
+static unsigned int entity_count = 0;
+static pthread_mutex_t entity_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t  entity_cond = PTHREAD_COND_INITIALIZER;
+static pthread_key_t thread_self_key;
+static pthread_key_t worker_key;
+
+static mn_worker_t *workers;
+static int num_workers;
+static unsigned int next_worker;
+static volatile int mn_stop;
+
+/* Idle workers sleep on this condition. */
+static pthread_mutex_t idle_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t  idle_cond = PTHREAD_COND_INITIALIZER;
+static volatile int idle_workers;
+
+/* Descriptors are never freed but reused for new entities of the same kind:
+ * a late unpark of a terminated entity merely causes a spurious wakeup. */
+static pthread_mutex_t pool_lock = PTHREAD_MUTEX_INITIALIZER;
+static snet_thread_t *pool[MN_kinds];
+
+
+static void *WorkerThread(void *arg);
+static void *EntityThread(void *arg);
+static void TaskMain(void);
+static void TaskReady(snet_thread_t *thr);
+static void ThreadDestroy(snet_thread_t *thr);
+static mn_kind_t EntityKind(snet_entity_descr_t descr);
+
+
+unsigned long SNetThreadingGetId()
+{
+  mn_worker_t *w = pthread_getspecific(worker_key);
+
+  /* coroutines move between workers: identify them by their descriptor */
+  if (w != NULL && w->current != NULL) {
+    return (unsigned long) w->current;
+  }
+  return (unsigned long) pthread_self(); /* returns a pointer on Mac */
+}
+
+int SNetThreadingInit(int argc, char **argv)
+{
+  int i;
+#ifdef USE_USER_EVENT_LOGGING
+  char fname[32];
+#endif
+  /* initialize the entity counter to 0 */
+  entity_count = 0;
+  mn_stop = 0;
+  idle_workers = 0;
+  next_worker = 0;
+
+  pthread_key_create(&thread_self_key, NULL);
+  pthread_key_create(&worker_key, NULL);
+
+  /* by default one worker per online processor */
+  num_workers = (int) sysconf(_SC_NPROCESSORS_ONLN);
+  for (i=0; i<argc; i++) {
+    if(strcmp(argv[i], "-w") == 0 && i + 1 < argc) {
+      /* Number of workers */
+      i = i + 1;
+      num_workers = atoi(argv[i]);
+    }
+  }
+  if (num_workers < 1) {
+    num_workers = 1;
+  }
+
+#ifdef USE_USER_EVENT_LOGGING
+  snprintf(fname, 31, "mon_n%02u_info.log", SNetDistribGetNodeId());
+  SNetThreadingMonitoringInit(fname);
+#endif
+
+  workers = SNetNewAlignN(num_workers, mn_worker_t);
+  for (i = 0; i < num_workers; i++) {
+    mn_worker_t *w = &workers[i];
+    pthread_mutex_init(&w->lock, NULL);
+    w->head = NULL;
+    w->tail = NULL;
+    w->current = NULL;
+    w->id = i;
+  }
+  for (i = 0; i < num_workers; i++) {
+    if (pthread_create(&workers[i].thread, NULL, WorkerThread, &workers[i])) {
+      SNetUtilDebugFatal("[%s]: Cannot create worker thread %d.", __func__, i);
+    }
+  }
+
+  return 0;
+}
+
+
+int SNetThreadingStop(void)
+{
+  int i;
+
+  /* Wait for the entities */
+  pthread_mutex_lock( &entity_lock );
+  while (entity_count > 0) {
+    pthread_cond_wait( &entity_cond, &entity_lock );
+  }
+  pthread_mutex_unlock( &entity_lock );
+
+  /* Then for the workers */
+  pthread_mutex_lock( &idle_lock );
+  mn_stop = 1;
+  pthread_cond_broadcast( &idle_cond );
+  pthread_mutex_unlock( &idle_lock );
+  for (i = 0; i < num_workers; i++) {
+    pthread_join(workers[i].thread, NULL);
+  }
+
+  return 0;
+}
+
+
+int SNetThreadingCleanup(void)
+{
+  snet_thread_t *thr;
+  int i;
+
+  for (i = 0; i < num_workers; i++) {
+    pthread_mutex_destroy(&workers[i].lock);
+  }
+  SNetMemFree(workers);
+  workers = NULL;
+
+  for (i = 0; i < MN_kinds; i++) {
+    while ((thr = pool[i]) != NULL) {
+      pool[i] = thr->next;
+      if (thr->stack) {
+        munmap(thr->stack, (i == MN_box) ? MN_BOX_STACK : MN_ENTITY_STACK);
+      }
+      pthread_mutex_destroy( &thr->lock );
+      pthread_cond_destroy(  &thr->pollcond );
+      SNetMemFree(thr);
+    }
+  }
+
+  pthread_key_delete(worker_key);
+  pthread_key_delete(thread_self_key);
+  SNetThreadingMonitoringCleanup();
+  return 0;
+}
+
+
+int SNetThreadingSpawn(snet_entity_t *ent)
+{
+  mn_kind_t kind = EntityKind( SNetEntityDescr(ent) );
+  snet_thread_t *thr;
+
+  /* reuse a descriptor of the same kind or create one */
+  pthread_mutex_lock( &pool_lock );
+  if ((thr = pool[kind]) != NULL) {
+    pool[kind] = thr->next;
+  }
+  pthread_mutex_unlock( &pool_lock );
+
+  if (thr == NULL) {
+    thr = SNetNew(snet_thread_t);
+    pthread_mutex_init( &thr->lock, NULL );
+    pthread_cond_init( &thr->pollcond, NULL );
+    thr->kind = kind;
+    thr->stack = NULL;
+    if (kind != MN_dedicated) {
+      size_t size = (kind == MN_box) ? MN_BOX_STACK : MN_ENTITY_STACK;
+      /* reserve the stack lazily, with a guard page at its end */
+      thr->stack = mmap(NULL, size, PROT_READ | PROT_WRITE,
+                        MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+      if (thr->stack == MAP_FAILED) {
+        SNetUtilDebugFatal("[%s]: Cannot allocate a stack.", __func__);
+      }
+      mprotect(thr->stack, sysconf(_SC_PAGESIZE), PROT_NONE);
+    }
+  }
+  thr->wakeup_sd = NULL;
+  thr->entity = ent;
+  thr->reason = MN_run;
+  thr->permit = 0;
+  thr->parked = 0;
+  thr->next = NULL;
+
+  /* increment entity counter */
+  pthread_mutex_lock( &entity_lock );
+  entity_count += 1;
+  pthread_mutex_unlock( &entity_lock );
+
+  if (kind == MN_dedicated) {
+    pthread_t p;
+    pthread_attr_t attr;
+
+    /* all threads are detached */
+    (void) pthread_attr_init( &attr);
+    (void) pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+    if (pthread_create( &p, &attr, EntityThread, thr) != 0) {
+      return 1;
+    }
+    pthread_attr_destroy( &attr);
+  } else {
+    getcontext(&thr->context);
+    thr->context.uc_stack.ss_sp = thr->stack;
+    thr->context.uc_stack.ss_size =
+      (kind == MN_box) ? MN_BOX_STACK : MN_ENTITY_STACK;
+    thr->context.uc_link = NULL;
+    makecontext(&thr->context, TaskMain, 0);
+    TaskReady(thr);
+  }
+
+  return 0;
+}
+
+
+#ifdef USE_USER_EVENT_LOGGING
+void SNetThreadingEventSignal(snet_entity_t *ent, snet_moninfo_t *moninfo)
+{
+  SNetThreadingMonitoringAppend( moninfo, SNetEntityStr(ent) );
+}
+#endif
+
+
+/* Switch from the calling coroutine back to its worker. */
+static void TaskSwitch(snet_thread_t *self, mn_reason_t reason)
+{
+  /* the worker must be looked up again after every switch */
+  mn_worker_t *w = pthread_getspecific(worker_key);
+
+  self->reason = reason;
+  swapcontext(&self->context, &w->context);
+}
+
+void SNetThreadingYield(void)
+{
+  mn_worker_t *w = pthread_getspecific(worker_key);
+
+  if (w != NULL) {
+    TaskSwitch(w->current, MN_yield);
+  } else {
+    sched_yield();
+  }
+}
+
+
+void SNetThreadingPark(void)
+{
+  snet_thread_t *self = SNetThreadingSelf();
+
+  if (self == NULL) {
+    /* not an entity: the caller polls again */
+    usleep(50);
+    return;
+  }
+  if (__sync_lock_test_and_set(&self->permit, 0)) {
+    return;
+  }
+  if (self->kind == MN_dedicated) {
+    pthread_mutex_lock( &self->lock );
+    while (self->permit == 0) {
+      pthread_cond_wait( &self->pollcond, &self->lock );
+    }
+    self->permit = 0;
+    pthread_mutex_unlock( &self->lock );
+  } else {
+    /* the worker completes the park after the context has been saved */
+    TaskSwitch(self, MN_park);
+    (void) __sync_lock_test_and_set(&self->permit, 0);
+  }
+}
+
+
+void SNetThreadingUnpark(snet_thread_t *thr)
+{
+  if (thr->kind == MN_dedicated) {
+    pthread_mutex_lock( &thr->lock );
+    thr->permit = 1;
+    pthread_cond_signal( &thr->pollcond );
+    pthread_mutex_unlock( &thr->lock );
+  } else {
+    thr->permit = 1;
+    /* either we see the park or the worker sees the permit */
+    __sync_synchronize();
+    if (thr->parked && __sync_bool_compare_and_swap(&thr->parked, 1, 0)) {
+      TaskReady(thr);
+    }
+  }
+}
+
+
+snet_thread_t *SNetThreadingSelf(void)
+{
+  mn_worker_t *w = pthread_getspecific(worker_key);
+
+  if (w != NULL) {
+    return w->current;
+  }
+  return (snet_thread_t *) pthread_getspecific(thread_self_key);
+}
+
+
+/* void function, to support task migration for lpel_hrc */
+void SNetThreadingCheckMigrate() {
+}
+
+
+/******************************************************************************
+ * Private functions
+ *****************************************************************************/
+
+/* Append a ready coroutine to the run queue of this worker,
+ * or distribute it over the workers when called from elsewhere. */
+static void TaskReady(snet_thread_t *thr)
+{
+  mn_worker_t *w = pthread_getspecific(worker_key);
+
+  if (w == NULL) {
+    w = &workers[__sync_fetch_and_add(&next_worker, 1) % num_workers];
+  }
+
+  thr->next = NULL;
+  pthread_mutex_lock( &w->lock );
+  if (w->tail) {
+    w->tail->next = thr;
+  } else {
+    w->head = thr;
+  }
+  w->tail = thr;
+  pthread_mutex_unlock( &w->lock );
+
+  if (idle_workers > 0) {
+    pthread_mutex_lock( &idle_lock );
+    pthread_cond_signal( &idle_cond );
+    pthread_mutex_unlock( &idle_lock );
+  }
+}
+
+/* Remove the oldest coroutine from a run queue. */
+static snet_thread_t *TaskTake(mn_worker_t *w)
+{
+  snet_thread_t *thr;
+
+  if (w->head == NULL) {
+    return NULL;
+  }
+  pthread_mutex_lock( &w->lock );
+  if ((thr = w->head) != NULL) {
+    if ((w->head = thr->next) == NULL) {
+      w->tail = NULL;
+    }
+  }
+  pthread_mutex_unlock( &w->lock );
+  return thr;
+}
+
+/* Find work in the own queue first, then steal from the other workers. */
+static snet_thread_t *TaskNext(mn_worker_t *self)
+{
+  snet_thread_t *thr;
+  int i;
+
+  if ((thr = TaskTake(self)) == NULL) {
+    for (i = 1; i < num_workers && thr == NULL; i++) {
+      thr = TaskTake(&workers[(self->id + i) % num_workers]);
+    }
+  }
+  return thr;
+}
+
+/* Sleep until work may have arrived. */
+static void WorkerIdle(void)
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_REALTIME, &ts);
+  ts.tv_nsec += MN_IDLE_NSEC;
+  if (ts.tv_nsec >= 1000000000) {
+    ts.tv_nsec -= 1000000000;
+    ts.tv_sec += 1;
+  }
+
+  pthread_mutex_lock( &idle_lock );
+  if (!mn_stop) {
+    idle_workers += 1;
+    pthread_cond_timedwait( &idle_cond, &idle_lock, &ts );
+    idle_workers -= 1;
+  }
+  pthread_mutex_unlock( &idle_lock );
+}
+
+static void *WorkerThread(void *arg)
+{
+  mn_worker_t *self = (mn_worker_t *)arg;
+  snet_thread_t *thr;
+
+  pthread_setspecific(worker_key, self);
+
+  while (!mn_stop) {
+    if ((thr = TaskNext(self)) == NULL) {
+      WorkerIdle();
+      continue;
+    }
+
+    self->current = thr;
+    thr->reason = MN_run;
+    swapcontext(&self->context, &thr->context);
+    self->current = NULL;
+
+    switch (thr->reason) {
+      case MN_yield:
+        TaskReady(thr);
+        break;
+      case MN_park:
+        thr->parked = 1;
+        /* an unpark may have come before the park was visible */
+        __sync_synchronize();
+        if (thr->permit && __sync_bool_compare_and_swap(&thr->parked, 1, 0)) {
+          TaskReady(thr);
+        }
+        break;
+      case MN_exit:
+        ThreadDestroy(thr);
+        break;
+      default:
+        assert(0);
+    }
+  }
+
+  return NULL;
+}
+
+/* Entry point of every coroutine. */
+static void TaskMain(void)
+{
+  snet_thread_t *thr = SNetThreadingSelf();
+
+  SNetEntityCall(thr->entity);
+  SNetEntityDestroy(thr->entity);
+
+  /* the worker releases the stack, which is never resumed */
+  TaskSwitch(thr, MN_exit);
+}
+
+static void *EntityThread(void *arg)
+{
+  snet_thread_t *thr = (snet_thread_t *)arg;
+
+  pthread_setspecific(thread_self_key, thr);
+
+  SNetEntityCall(thr->entity);
+  SNetEntityDestroy(thr->entity);
+
+  ThreadDestroy(thr);
+
+  return NULL;
+}
+
+/**
+ * Return the descriptor to its pool
+ */
+static void ThreadDestroy(snet_thread_t *thr)
+{
+  pthread_mutex_lock( &pool_lock );
+  thr->next = pool[thr->kind];
+  pool[thr->kind] = thr;
+  pthread_mutex_unlock( &pool_lock );
+
+  /* decrement and signal entity counter */
+  pthread_mutex_lock( &entity_lock );
+  entity_count -= 1;
+  if (entity_count == 0) {
+    pthread_cond_signal( &entity_cond );
+  }
+  pthread_mutex_unlock( &entity_lock );
+}
+
+static mn_kind_t EntityKind(snet_entity_descr_t descr)
+{
+  mn_kind_t kind;
+
+  switch(descr) {
+    case ENTITY_parallel:
+    case ENTITY_star:
+    case ENTITY_split:
+    case ENTITY_fbcoll:
+    case ENTITY_fbdisp:
+    case ENTITY_fbbuf:
+    case ENTITY_fbnond:
+    case ENTITY_sync:
+    case ENTITY_filter:
+    case ENTITY_nameshift:
+    case ENTITY_collect:
+      kind = MN_entity;
+      break;
+    case ENTITY_box:
+      kind = MN_box;
+      break;
+    case ENTITY_other:
+      /* may block in system calls */
+      kind = MN_dedicated;
+      break;
+    default:
+      /* we do not want an unhandled case here */
+      assert(0);
+      kind = MN_dedicated;
+  }
+
+  return kind;
+}
@@ -2,19 +2,39 @@
 #define _ENTITY_H_
 
 //#include <pthread.h>
+#ifdef SNET_THREADING_MN
+#include <ucontext.h>
+#endif
 
 #include "threading.h"
 
 
-typedef struct {
+typedef struct snet_thread {
   snet_entity_t      *entity;
   // void               *inarg;
   //pthread_t           thread;
   pthread_mutex_t     lock;
   pthread_cond_t      pollcond;
   snet_stream_desc_t *wakeup_sd;
+#ifdef SNET_THREADING_MN
+  /* M:N backend: entities are coroutines on a pool of worker threads. */
+  ucontext_t          context;
+  char               *stack;
+  int                 kind;
+  int                 reason;
+  volatile int        permit;
+  volatile int        parked;
+  struct snet_thread *next;
+#endif
 } snet_thread_t;
 
 extern snet_thread_t *SNetThreadingSelf(void);
 
+#ifdef SNET_THREADING_MN
+/* Suspend the calling entity until it is unparked. May return spuriously. */
+extern void SNetThreadingPark(void);
+/* Resume a parked entity, or let its next park return at once. */
+extern void SNetThreadingUnpark(snet_thread_t *thr);
+#endif
+
 #endif /* _ENTITY_H_ */
@@ -3,6 +3,12 @@
 #include <string.h>
 #include <pthread.h>
 #include <assert.h>
+#include <unistd.h>
+#include <sched.h>
+#ifdef __linux__
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#endif
 
 #include "threading.h"
 
@@ -12,6 +18,82 @@
 #include "stream.h"
 #include "entity.h"
 
+/* Number of times to check a ring before going to sleep on it. */
+#define STREAM_SPINS  100
+
+/* Advance a ring index. */
+#define NEXT(s, i)    (((i) + 1) % ((s)->size + 1))
+
+#define EMPTY(s)      ((s)->head == (s)->tail)
+#define FULL(s)       (NEXT(s, (s)->tail) == (s)->head)
+
+
+#ifdef SNET_THREADING_MN
+/* Park the calling entity while 'flag' still holds one. */
+static void StreamSleep(volatile int *flag)
+{
+  if (*flag == 1) {
+    SNetThreadingPark();
+  }
+}
+
+/* Unpark the other side if it sleeps on 'flag'.
+ * The caller must have issued a full barrier after its update. */
+static void StreamWake(volatile int *flag, snet_thread_t *task)
+{
+  if (*flag && __sync_bool_compare_and_swap(flag, 1, 0)) {
+    SNetThreadingUnpark(task);
+  }
+}
+
+/* Record which entity is going to sleep on a flag. */
+#define STREAM_ANNOUNCE(task)   ((task) = SNetThreadingSelf())
+#else
+/* Sleep while 'flag' still holds one. */
+static void StreamSleep(volatile int *flag)
+{
+#ifdef __linux__
+  syscall(SYS_futex, flag, FUTEX_WAIT_PRIVATE, 1, NULL, NULL, 0);
+#else
+  if (*flag == 1) {
+    usleep(50);
+  }
+#endif
+}
+
+/* Wake the other side if it sleeps on 'flag'.
+ * The caller must have issued a full barrier after its update. */
+static void StreamWake(volatile int *flag, snet_thread_t *task)
+{
+  (void) task; /* NOT USED */
+  if (*flag && __sync_bool_compare_and_swap(flag, 1, 0)) {
+#ifdef __linux__
+    syscall(SYS_futex, flag, FUTEX_WAKE_PRIVATE, 1, NULL, NULL, 0);
+#endif
+  }
+}
+
+#define STREAM_ANNOUNCE(task)   ((void) 0)
+#endif
+
+/* Wait while 'cond' holds: spin first, then sleep on 'flag'. */
+#define STREAM_WAIT(cond, flag, task) \
+  do { \
+    int spins = 0; \
+    while (cond) { \
+      if (++spins < STREAM_SPINS) { \
+        __sync_synchronize(); \
+      } else { \
+        STREAM_ANNOUNCE(task); \
+        (flag) = 1; \
+        __sync_synchronize(); \
+        if (cond) { \
+          StreamSleep(&(flag)); \
+        } \
+        (flag) = 0; \
+      } \
+    } \
+  } while (0)
 
 
 void SNetStreamSetSource(snet_stream_t *s, snet_locvec_t *lv)
@@ -42,23 +124,22 @@ void *SNetStreamGetCallbackArg(snet_stream_desc_t *sd)
 
 snet_stream_t *SNetStreamCreate(int capacity)
 {
-  snet_stream_t *s = SNetMemAlloc(sizeof(snet_stream_t));
-  pthread_mutex_init(&s->lock, NULL);
-  pthread_cond_init(&s->notempty, NULL);
-  pthread_cond_init(&s->notfull, NULL);
-
+  snet_stream_t *s = SNetNewAlign(snet_stream_t);
 
   s->size = (capacity > 0) ? capacity : SNET_STREAM_DEFAULT_CAPACITY;
   s->head = 0;
   s->tail = 0;
-  s->count = 0;
-  s->buffer = SNetMemAlloc( s->size*sizeof(void*) );
+  s->read_wait = 0;
+  s->write_wait = 0;
+  s->read_task = NULL;
+  s->write_task = NULL;
+  s->buffer = SNetMemAlloc( (s->size+1)*sizeof(void*) );
 
   s->producer = NULL;
   s->consumer = NULL;
   s->is_poll = 0;
 
-  memset( s->buffer, 0, s->size*sizeof(void*) );
+  memset( s->buffer, 0, (s->size+1)*sizeof(void*) );
 
   s->source = NULL;
 
@@ -72,10 +153,6 @@ snet_stream_t *SNetStreamCreate(int capacity)
 /* convenience */
 void SNetStreamDestroy(snet_stream_t *s)
 {
-  pthread_mutex_destroy(&s->lock);
-  pthread_cond_destroy(&s->notempty);
-  pthread_cond_destroy(&s->notfull);
-
   if (s->source != NULL) {
     SNetLocvecDestroy(s->source);
   }
@@ -88,7 +165,7 @@ void SNetStreamDestroy(snet_stream_t *s)
 snet_stream_desc_t *SNetStreamOpen(snet_stream_t *stream, char mode)
 {
   assert( mode=='w' || mode=='r' );
-  snet_stream_desc_t *sd = SNetMemAlloc(sizeof(snet_stream_t));
+  snet_stream_desc_t *sd = SNetMemAlloc(sizeof(snet_stream_desc_t));
   sd->thr = SNetThreadingSelf();
   sd->stream = stream;
   sd->next = NULL;
@@ -116,10 +193,9 @@ void SNetStreamReplace(snet_stream_desc_t *sd, snet_stream_t *new_stream)
 {
   assert( sd->mode == 'r' );
   SNetStreamDestroy(sd->stream);
-  pthread_mutex_lock( &new_stream->lock);
   new_stream->consumer = sd;
   new_stream->is_poll = 0;
-  pthread_mutex_unlock( &new_stream->lock);
+  __sync_synchronize();
   sd->stream = new_stream;
 }
 
@@ -136,19 +212,18 @@ void *SNetStreamRead(snet_stream_desc_t *sd)
   snet_stream_t *s = sd->stream;
   void *item;
 
-  pthread_mutex_lock( &s->lock);
-  while(s->count == 0){
-    pthread_cond_wait(&s->notempty, &s->lock);
-  }
+  STREAM_WAIT(EMPTY(s), s->read_wait, s->read_task);
 
+  /* the slot was written before the tail was published */
+  __sync_synchronize();
   item = s->buffer[s->head];
   s->buffer[s->head] = NULL;
-  s->head = (s->head+1) % s->size;
-  s->count--;
+  /* release the slot only after reading it */
+  __sync_synchronize();
+  s->head = NEXT(s, s->head);
 
-  if (s->count == s->size-1) pthread_cond_signal(&s->notfull);
-
-  pthread_mutex_unlock( &s->lock);
+  __sync_synchronize();
+  StreamWake(&s->write_wait, s->write_task);
 
   /* call the read callback function */
   if (s->callback_read.func) {
@@ -166,11 +241,10 @@ void *SNetStreamPeek(snet_stream_desc_t *sd)
   void *top = NULL;
   snet_stream_t *s = sd->stream;
 
-  pthread_mutex_lock( &s->lock);
-  if (s->count > 0) {
+  if (!EMPTY(s)) {
+    __sync_synchronize();
     top = s->buffer[s->head];
   }
-  pthread_mutex_unlock( &s->lock);
 
   return top;
 }
@@ -180,31 +254,45 @@ void SNetStreamWrite(snet_stream_desc_t *sd, void *item)
   assert( sd->mode == 'w' );
   snet_stream_t *s = sd->stream;
 
-  pthread_mutex_lock( &s->lock);
-  while(s->count == s->size){
-    pthread_cond_wait(&s->notfull, &s->lock);
-  }
+  STREAM_WAIT(FULL(s), s->write_wait, s->write_task);
 
   s->buffer[s->tail] = item;
-  s->tail = (s->tail+1) % s->size;
-  s->count++;
+  /* publish the item before the new tail */
+  __sync_synchronize();
+  s->tail = NEXT(s, s->tail);
 
-  if (s->count==1) pthread_cond_signal(&s->notempty);
+  /* order the tail before the checks of the consumer flags */
+  __sync_synchronize();
+  StreamWake(&s->read_wait, s->read_task);
 
-  /* stream was registered to poll on */
-  assert(s->is_poll == 0 || s->is_poll == 1);
-  if (s->is_poll) {
-    s->is_poll = 0;
+  /* stream was registered to poll on: claim the notification */
+  assert(s->is_poll >= 0 && s->is_poll <= 2);
+  if (s->is_poll == 1 && __sync_bool_compare_and_swap(&s->is_poll, 1, 2)) {
     snet_thread_t *cons = s->consumer->thr;
 
+    bool wake = false;
+
     pthread_mutex_lock( &cons->lock );
     if (cons->wakeup_sd == NULL) {
       cons->wakeup_sd = s->consumer;
+      wake = true;
+#ifndef SNET_THREADING_MN
       pthread_cond_signal( &cons->pollcond );
+#endif
     }
     pthread_mutex_unlock( &cons->lock );
+    /* the poller waits for this before it resets its streams */
+    __sync_synchronize();
+    s->is_poll = 0;
+#ifdef SNET_THREADING_MN
+    /* descriptors are reused, so the consumer may have moved on */
+    if (wake) {
+      SNetThreadingUnpark(cons);
+    }
+#else
+    (void) wake;
+#endif
   }
-  pthread_mutex_unlock( &s->lock);
 }
 
 int SNetStreamTryWrite(snet_stream_desc_t *sd, void *item)
@@ -213,12 +301,10 @@ int SNetStreamTryWrite(snet_stream_desc_t *sd, void *item)
 
   snet_stream_t *s = sd->stream;
 
-  pthread_mutex_lock( &s->lock);
-  if (s->count == s->size) {
-    pthread_mutex_unlock( &s->lock);
+  /* only the producer fills the ring */
+  if (FULL(s)) {
     return -1;
   }
-  pthread_mutex_unlock( &s->lock);
 
   SNetStreamWrite(sd, item);
   return 0;
@@ -246,10 +332,7 @@ snet_stream_desc_t *SNetStreamPoll(snet_streamset_t *set)
   {
     while( SNetStreamIterHasNext(iter)) {
       snet_stream_desc_t *sd = SNetStreamIterNext( iter);
-      snet_stream_t *s = sd->stream;
-      pthread_mutex_lock(&s->lock);
-      if (s->count > 0) result = sd;
-      pthread_mutex_unlock(&s->lock);
+      if (!EMPTY(sd->stream)) result = sd;
     }
     if (result != NULL) {
       goto poll_fastpath;
@@ -270,48 +353,49 @@ snet_stream_desc_t *SNetStreamPoll(snet_streamset_t *set)
     snet_stream_desc_t *sd = SNetStreamIterNext( iter);
     snet_stream_t *s = sd->stream;
 
-    /* lock stream (prod-side) */
-    pthread_mutex_lock( &s->lock);
-    { /* CS BEGIN */
-      /* check if there is something in the buffer */
-      if ( s->count > 0 ) {
-        /* yes, we can stop iterating through streams. */
-        pthread_mutex_lock( &self->lock );
-        if (self->wakeup_sd == NULL) {
-          self->wakeup_sd = sd;
-        }
-        /* unlock self */
-        pthread_mutex_unlock( &self->lock );
-        /* unlock stream */
-        pthread_mutex_unlock( &s->lock);
-        /* exit loop */
-        break;
-
-      } else {
-        /* nothing in the buffer, register stream as activator */
-        s->is_poll = 1;
-        cnt++;
+    /* register stream as activator, then check the buffer:
+     * either we see the item or the producer sees is_poll */
+    s->is_poll = 1;
+    cnt++;
+    __sync_synchronize();
+    if (!EMPTY(s)) {
+      /* yes, we can stop iterating through streams. */
+      pthread_mutex_lock( &self->lock );
+      if (self->wakeup_sd == NULL) {
+        self->wakeup_sd = sd;
       }
-    } /* CS END */
-    /* unlock stream */
-    pthread_mutex_unlock( &s->lock);
+      /* unlock self */
+      pthread_mutex_unlock( &self->lock );
+      /* exit loop */
+      break;
+    }
   } /* end for each stream */
 
   /* wait until wakeup_sd is set */
   pthread_mutex_lock( &self->lock );
   while( self->wakeup_sd == NULL ) {
+#ifdef SNET_THREADING_MN
+    pthread_mutex_unlock( &self->lock );
+    SNetThreadingPark();
+    pthread_mutex_lock( &self->lock );
+#else
     pthread_cond_wait(&self->pollcond, &self->lock);
+#endif
   }
   result = self->wakeup_sd;
   self->wakeup_sd = NULL;
   pthread_mutex_unlock( &self->lock );
 
+  /* deregister, but wait for writers which are still notifying us,
+   * lest they set wakeup_sd during the next poll */
   SNetStreamIterReset(iter, set);
   while( SNetStreamIterHasNext(iter)) {
     snet_stream_t *s = (SNetStreamIterNext(iter))->stream;
-    pthread_mutex_lock(&s->lock);
-    s->is_poll = 0;
-    pthread_mutex_unlock(&s->lock);
+    if (!__sync_bool_compare_and_swap(&s->is_poll, 1, 0)) {
+      while (s->is_poll != 0) {
+        sched_yield();
+      }
+    }
     if (--cnt == 0) break;
   }
 
@@ -5,25 +5,33 @@
 
 #include "threading.h"
 #include "entity.h"
+#include "memfun.h"
 
 /* Keep this in sync with include/stream.h. */
 #define SNET_STREAM_DEFAULT_CAPACITY  16
 
 
+/* A stream is a single-producer/single-consumer ring buffer of size + 1
+ * slots. The consumer advances 'head' and the producer advances 'tail',
+ * each on its own cache line. A side which finds the ring empty or full
+ * sleeps on its wait flag after announcing itself there. Under the M:N
+ * backend the sleeping entity is parked and recorded in its wait task. */
 struct snet_stream_t {
-  pthread_mutex_t lock;
-  pthread_cond_t  notempty;
-  pthread_cond_t  notfull;
+  volatile int head __attribute__((aligned(LINE_SIZE)));
+  volatile int read_wait;
+  snet_thread_t *volatile read_task;
 
-  void **buffer;
-  int head, tail;
+  volatile int tail __attribute__((aligned(LINE_SIZE)));
+  volatile int write_wait;
+  snet_thread_t *volatile write_task;
+
+  void **buffer __attribute__((aligned(LINE_SIZE)));
   int size;
-  int count;
 
   snet_stream_desc_t *producer;
   snet_stream_desc_t *consumer;
 
-  int is_poll;
+  volatile int is_poll;         /* 0 idle, 1 polled, 2 writer notifying */
 
   snet_locvec_t *source;
 
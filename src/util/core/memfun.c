@@ -7,6 +7,9 @@
 #include <stdio.h>
 #include <errno.h>
 #include "memfun.h"
+#if ENABLE_SLAB_ALLOC
+#include "memslab.h"
+#endif
 
 #ifdef _SNET_MEMFUN_BSD
 #include <malloc/malloc.h>
@@ -25,6 +28,11 @@ void SNetMemFailed(void)
 void *SNetMemAlloc( size_t size)
 {
   void *ptr = NULL;
+#if ENABLE_SLAB_ALLOC
+  if (size && (ptr = SNetSlabAlloc(size, false)) != NULL) {
+    return ptr;
+  }
+#endif
   if (size && (ptr = malloc(size)) == NULL) {
     SNetMemFailed();
   }
@@ -33,12 +41,25 @@ void *SNetMemAlloc( size_t size)
 
 void *SNetMemCalloc( size_t nmemb, size_t size)
 {
-  void *ptr = calloc(nmemb, size);
+  void *ptr;
+#if ENABLE_SLAB_ALLOC
+  ptr = (nmemb && size <= ((size_t) -1) / nmemb)
+            ? SNetSlabAlloc(nmemb * size, false) : NULL;
+  if (ptr) {
+    return memset(ptr, 0, nmemb * size);
+  }
+#endif
+  ptr = calloc(nmemb, size);
   if (!ptr) { SNetMemFailed(); }
   return ptr;
 }
 
 size_t SNetMemSize(void *ptr) {
+#if ENABLE_SLAB_ALLOC
+  if (SNetSlabOwns(ptr)) {
+    return SNetSlabSize(ptr);
+  }
+#endif
 #ifdef _SNET_MEMFUN_BSD
   return malloc_size(ptr);
 #else
@@ -54,6 +75,24 @@ void *SNetMemResize( void *ptr, size_t size)
     return NULL;
   }
 
+#if ENABLE_SLAB_ALLOC
+  /* slab blocks have a fixed size: move to a fitting allocation */
+  if (ptr == NULL) {
+    return SNetMemAlloc(size);
+  }
+  if (SNetSlabOwns(ptr)) {
+    size_t old_size = SNetSlabSize(ptr);
+    void *nptr;
+    if (size <= old_size) {
+      return ptr;
+    }
+    nptr = SNetMemAlloc(size);
+    memcpy(nptr, ptr, old_size);
+    SNetSlabFree(ptr);
+    return nptr;
+  }
+#endif
+
   /* try to realloc
    * this only fail if size > malloc_size/malloc_usable_size(ptr)
    * and free memory after the block of ptr is not enough to add up to size
@@ -78,6 +117,12 @@ void *SNetMemResize( void *ptr, size_t size)
 
 void SNetMemFree( void *ptr)
 {
+#if ENABLE_SLAB_ALLOC
+  if (SNetSlabOwns(ptr)) {
+    SNetSlabFree(ptr);
+    return;
+  }
+#endif
   free(ptr);
 }
 
@@ -88,6 +133,11 @@ void* SNetMemAlign( size_t size)
   size_t remain = size % LINE_SIZE;
   size_t request = remain ? (size + (LINE_SIZE - remain)) : size;
 
+#if ENABLE_SLAB_ALLOC
+  if ((vptr = SNetSlabAlloc(request, true)) != NULL) {
+    return vptr;
+  }
+#endif
   if ((retval = posix_memalign(&vptr, LINE_SIZE, request)) != 0) {
     errno = retval;
     SNetMemFailed();
@@ -104,3 +154,12 @@ char *SNetStrDup(const char *str)
   return ptr;
 }
 
+
+void SNetMemPrintStats(FILE *file)
+{
+#if ENABLE_SLAB_ALLOC
+  SNetSlabPrintStats(file);
+#else
+  (void) file;
+#endif
+}
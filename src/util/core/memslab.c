@@ -0,0 +1,325 @@
+/*
+ * Thread-local size class slab allocator
+ *
+ * Small allocations are served from per-thread caches of fixed size
+ * blocks. Blocks are carved from superblocks of SLAB_SUPER_SIZE bytes
+ * which are dedicated to a single size class and a single owning cache.
+ * Superblocks are taken from one large reservation of virtual memory,
+ * which allows to recognize slab pointers by a simple range check.
+ * The superblock header is found by masking the low bits of a pointer.
+ *
+ * A block which is freed by its owning thread goes onto a private
+ * free list. A block which is freed by another thread, for instance
+ * after a record was stolen by another worker, is pushed onto a
+ * lock-free list of remote frees of the owner, which the owner
+ * reclaims in one atomic swap when its private list runs dry.
+ *
+ * Caches of exited threads are kept on an orphan list and are
+ * adopted by newly created threads.
+ */
+
+#if ENABLE_SLAB_ALLOC
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <assert.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include "memfun.h"
+#include "memslab.h"
+
+/* Size of the virtual address range reserved for superblocks. */
+#define SLAB_REGION_SIZE        ((size_t) 1 << 36)
+
+/* Size and alignment of a superblock. */
+#define SLAB_SUPER_SIZE         ((size_t) 1 << 16)
+
+/* Blocks start after a superblock header of one cache line. */
+#define SLAB_HEADER_SIZE        LINE_SIZE
+
+/* Calculate the number of elements in a static array. */
+#define NUM_ELEMS(x)    (sizeof(x) / sizeof((x)[0]))
+
+/* Block sizes per size class. Beyond 64 bytes all classes which can
+ * be selected for cache line aligned requests are multiples of LINE_SIZE. */
+static const size_t slab_class_sizes[] = {
+  16, 32, 48, 64, 96, 128, 192, 256, 384, 512, 768, 1024, 1536, 2048,
+};
+#define SLAB_NUM_CLASSES        NUM_ELEMS(slab_class_sizes)
+#define SLAB_MAX_SIZE           slab_class_sizes[SLAB_NUM_CLASSES - 1]
+
+/* A free block links to the next free block. */
+typedef struct slab_block {
+  struct slab_block     *next;
+} slab_block_t;
+
+/* The per-thread state of one size class. */
+typedef struct slab_class {
+  /* Blocks freed by the owner: only accessed by the owner. */
+  slab_block_t          *local;
+
+  /* Unused remainder of the most recent superblock. */
+  char                  *bump;
+  char                  *bump_end;
+
+  /* Allocations and frees done by this thread in this size class. */
+  size_t                 allocs;
+  size_t                 frees;
+
+  /* Blocks freed by other threads: a lock-free stack. */
+  slab_block_t          *remote __attribute__((aligned(LINE_SIZE)));
+} __attribute__((aligned(LINE_SIZE))) slab_class_t;
+
+/* A thread-local cache of free blocks for all size classes. */
+typedef struct slab_cache {
+  slab_class_t           classes[SLAB_NUM_CLASSES];
+  struct slab_cache     *next_orphan;
+  struct slab_cache     *next_cache;
+} slab_cache_t;
+
+/* The header of a superblock. */
+typedef struct slab_super {
+  slab_cache_t          *owner;
+  size_t                 size_class;
+} slab_super_t;
+
+/* The reserved address range from which superblocks are taken. */
+static char            *slab_region_base;
+static char            *slab_region_end;
+static size_t           slab_region_next;
+static pthread_once_t   slab_once = PTHREAD_ONCE_INIT;
+
+/* Thread-local cache lookup and a destructor to orphan it at thread exit. */
+static pthread_key_t    slab_key;
+#if HAVE___THREAD
+static __thread slab_cache_t *slab_self;
+#endif
+
+/* All caches ever created, for statistics. */
+static slab_cache_t    *slab_caches;
+
+/* Caches of exited threads which can be adopted by new threads. */
+static slab_cache_t    *slab_orphans;
+static pthread_mutex_t  slab_orphan_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/* Put the cache of an exiting thread up for adoption. */
+static void SlabCacheOrphan(void *arg)
+{
+  slab_cache_t *cache = arg;
+
+  pthread_mutex_lock(&slab_orphan_lock);
+  cache->next_orphan = slab_orphans;
+  slab_orphans = cache;
+  pthread_mutex_unlock(&slab_orphan_lock);
+}
+
+/* Reserve the address range for superblocks once. */
+static void SlabInit(void)
+{
+  void *base = mmap(NULL, SLAB_REGION_SIZE, PROT_READ | PROT_WRITE,
+                    MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+  if (base != MAP_FAILED) {
+    /* Align the first superblock on a superblock boundary. */
+    uintptr_t first = ((uintptr_t) base + SLAB_SUPER_SIZE - 1)
+                    & ~(uintptr_t) (SLAB_SUPER_SIZE - 1);
+    slab_region_base = (char *) first;
+    slab_region_end = (char *) base + SLAB_REGION_SIZE;
+  }
+  pthread_key_create(&slab_key, SlabCacheOrphan);
+}
+
+/* Obtain the cache of the current thread: adopt an orphan or create one. */
+static slab_cache_t *SlabCacheGet(void)
+{
+  slab_cache_t *cache;
+
+#if HAVE___THREAD
+  if ((cache = slab_self) != NULL) {
+    return cache;
+  }
+#endif
+
+  pthread_once(&slab_once, SlabInit);
+  if (slab_region_base == NULL) {
+    return NULL;
+  }
+#if !HAVE___THREAD
+  if ((cache = pthread_getspecific(slab_key)) != NULL) {
+    return cache;
+  }
+#endif
+
+  pthread_mutex_lock(&slab_orphan_lock);
+  if ((cache = slab_orphans) != NULL) {
+    slab_orphans = cache->next_orphan;
+  }
+  pthread_mutex_unlock(&slab_orphan_lock);
+
+  if (cache == NULL) {
+    void *vptr;
+    if (posix_memalign(&vptr, LINE_SIZE, sizeof(slab_cache_t))) {
+      return NULL;
+    }
+    cache = memset(vptr, 0, sizeof(slab_cache_t));
+    do {
+      cache->next_cache = slab_caches;
+    } while (!__sync_bool_compare_and_swap(&slab_caches,
+                                           cache->next_cache, cache));
+  }
+  cache->next_orphan = NULL;
+
+  pthread_setspecific(slab_key, cache);
+#if HAVE___THREAD
+  slab_self = cache;
+#endif
+  return cache;
+}
+
+/* Find the smallest size class which fits a request, or -1. */
+static int SlabSizeClass(size_t size)
+{
+  int lo = 0, hi = SLAB_NUM_CLASSES - 1;
+
+  if (size > SLAB_MAX_SIZE) {
+    return -1;
+  }
+  while (lo < hi) {
+    int mid = (lo + hi) / 2;
+    if (slab_class_sizes[mid] < size) {
+      lo = mid + 1;
+    } else {
+      hi = mid;
+    }
+  }
+  return lo;
+}
+
+/* Dedicate a new superblock to a size class of a cache. */
+static bool SlabSuperNew(slab_cache_t *cache, int cls)
+{
+  size_t        offset = __sync_fetch_and_add(&slab_region_next,
+                                              SLAB_SUPER_SIZE);
+  char         *start = slab_region_base + offset;
+  slab_super_t *super = (slab_super_t *) start;
+
+  if (start + SLAB_SUPER_SIZE > slab_region_end) {
+    return false;
+  }
+  super->owner = cache;
+  super->size_class = cls;
+  cache->classes[cls].bump = start + SLAB_HEADER_SIZE;
+  cache->classes[cls].bump_end = start + SLAB_SUPER_SIZE;
+  return true;
+}
+
+/* Allocate from a size class slab. */
+void *SNetSlabAlloc(size_t size, bool align)
+{
+  slab_cache_t  *cache;
+  slab_class_t  *class;
+  slab_block_t  *block;
+  int            cls;
+
+  if (align) {
+    size_t remain = size % LINE_SIZE;
+    size = remain ? (size + (LINE_SIZE - remain)) : size;
+  }
+  if ((cls = SlabSizeClass(size)) < 0 || (cache = SlabCacheGet()) == NULL) {
+    return NULL;
+  }
+  assert(!align || slab_class_sizes[cls] % LINE_SIZE == 0);
+
+  class = &cache->classes[cls];
+  if ((block = class->local) == NULL) {
+    if (class->remote) {
+      /* Reclaim all blocks which were freed by other threads. */
+      block = __sync_lock_test_and_set(&class->remote, NULL);
+    }
+    if (block == NULL) {
+      const size_t block_size = slab_class_sizes[cls];
+      if (class->bump + block_size > class->bump_end &&
+          SlabSuperNew(cache, cls) == false)
+      {
+        return NULL;
+      }
+      block = (slab_block_t *) class->bump;
+      class->bump += block_size;
+      block->next = NULL;
+    }
+  }
+  class->local = block->next;
+  class->allocs += 1;
+
+  return block;
+}
+
+/* Test whether a pointer was allocated by SNetSlabAlloc. */
+bool SNetSlabOwns(const void *ptr)
+{
+  return (const char *) ptr >= slab_region_base &&
+         (const char *) ptr < slab_region_end;
+}
+
+/* Find the superblock header of a slab pointer. */
+static slab_super_t *SlabSuper(const void *ptr)
+{
+  return (slab_super_t *) ((uintptr_t) ptr & ~(uintptr_t) (SLAB_SUPER_SIZE - 1));
+}
+
+/* Return a slab allocation to its owning thread. */
+void SNetSlabFree(void *ptr)
+{
+  slab_super_t  *super = SlabSuper(ptr);
+  slab_cache_t  *self = SlabCacheGet();
+  slab_block_t  *block = ptr;
+  const int      cls = super->size_class;
+
+  assert(SNetSlabOwns(ptr));
+  if (self) {
+    self->classes[cls].frees += 1;
+  }
+  if (super->owner == self) {
+    block->next = self->classes[cls].local;
+    self->classes[cls].local = block;
+  } else {
+    slab_class_t *class = &super->owner->classes[cls];
+    do {
+      block->next = class->remote;
+    } while (!__sync_bool_compare_and_swap(&class->remote, block->next, block));
+  }
+}
+
+/* Return the usable size of a slab allocation. */
+size_t SNetSlabSize(const void *ptr)
+{
+  return slab_class_sizes[SlabSuper(ptr)->size_class];
+}
+
+/* Print the number of live bytes for each size class. */
+void SNetSlabPrintStats(FILE *file)
+{
+  size_t        total = 0;
+  size_t        supers = slab_region_next / SLAB_SUPER_SIZE;
+  size_t        i;
+
+  for (i = 0; i < SLAB_NUM_CLASSES; ++i) {
+    size_t        allocs = 0, frees = 0;
+    slab_cache_t *cache;
+
+    for (cache = slab_caches; cache; cache = cache->next_cache) {
+      allocs += cache->classes[i].allocs;
+      frees += cache->classes[i].frees;
+    }
+    if (allocs) {
+      size_t live = (allocs - frees) * slab_class_sizes[i];
+      fprintf(file, "slab %4zu: %10zu allocs %10zu frees %12zu live bytes\n",
+              slab_class_sizes[i], allocs, frees, live);
+      total += live;
+    }
+  }
+  fprintf(file, "slab: %zu live bytes in %zu superblocks of %zu bytes\n",
+          total, supers, SLAB_SUPER_SIZE);
+}
+
+#endif
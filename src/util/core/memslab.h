@@ -0,0 +1,38 @@
+/*
+ * Thread-local size class slab allocator
+ */
+
+#ifndef MEMSLAB_H
+#define MEMSLAB_H
+
+#include <stdio.h>
+#include "bool.h"
+
+/*
+ * Allocate from a size class slab, cache line aligned if 'align' is set.
+ * RETURNS: NULL if size exceeds the largest size class
+ * or if no more slab memory is available.
+ */
+void *SNetSlabAlloc(size_t size, bool align);
+
+/*
+ * Test whether a pointer was allocated by SNetSlabAlloc.
+ */
+bool SNetSlabOwns(const void *ptr);
+
+/*
+ * Return a slab allocation to its owning thread.
+ */
+void SNetSlabFree(void *ptr);
+
+/*
+ * Return the usable size of a slab allocation.
+ */
+size_t SNetSlabSize(const void *ptr);
+
+/*
+ * Print the number of live bytes for each size class.
+ */
+void SNetSlabPrintStats(FILE *file);
+
+#endif